@@ -1,7 +1,44 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
 
+#ifdef BINDLESS
+/* Global texture table (Backend::BindlessTextureTable), indexed by the material */
+#extension GL_EXT_nonuniform_qualifier : require
+layout(set = 1, binding = 0) uniform sampler2D textures[];
+layout(push_constant) uniform material_constants { uint texture_index; }
+material;
+#define SAMPLE_ALBEDO(uv) texture(textures[material.texture_index], uv)
+#else
 layout(binding = 1) uniform sampler2D tex_sampler;
+#define SAMPLE_ALBEDO(uv) texture(tex_sampler, uv)
+#endif
+
+/* Variant constants, filled by Backend::ShaderVariantCache (Src/ShaderVariants.h).
+ * The ids must match the order of Backend::ShaderConstants. */
+layout(constant_id = 0) const uint LIGHTING_MODEL = 2; /* 0: Unlit, 1: Phong, 2: Toon */
+layout(constant_id = 1) const bool USE_TEXTURE = false;
+layout(constant_id = 2) const bool USE_DIFFUSE = true;
+layout(constant_id = 3) const bool USE_SPECULAR = true;
+layout(constant_id = 4) const bool USE_RIM = true;
+layout(constant_id = 5) const float GLOSSINESS = 64.0;
+layout(constant_id = 6) const float RIM_AMOUNT = 0.716;
+layout(constant_id = 7) const float AMBIENT_STRENGTH = 0.4;
+layout(constant_id = 8) const float AMBIENT_R = 0.24725;
+layout(constant_id = 9) const float AMBIENT_G = 0.1995;
+layout(constant_id = 10) const float AMBIENT_B = 0.0745;
+layout(constant_id = 11) const float DIFFUSE_R = 0.75164;
+layout(constant_id = 12) const float DIFFUSE_G = 0.60648;
+layout(constant_id = 13) const float DIFFUSE_B = 0.22648;
+layout(constant_id = 14) const float SPECULAR_R = 0.628281;
+layout(constant_id = 15) const float SPECULAR_G = 0.555802;
+layout(constant_id = 16) const float SPECULAR_B = 0.366065;
+layout(constant_id = 17) const float OBJECT_R = 0.4;
+layout(constant_id = 18) const float OBJECT_G = 0.3;
+layout(constant_id = 19) const float OBJECT_B = 0.2;
+
+const uint LIGHTING_UNLIT = 0;
+const uint LIGHTING_PHONG = 1;
+const uint LIGHTING_TOON = 2;
 
 layout(location = 0) in vec3 frag_color;
 layout(location = 1) in vec2 frag_texcoord;
@@ -11,55 +48,61 @@ layout(location = 3) in vec3 frag_pos;
 layout(location = 0) out vec4 color_output;
 
 void main() {
-  // color_output = texture(tex_sampler, frag_texcoord);
   vec3 view_pos = vec3(0.0f, 0.f, 2.2f);
-  vec3 obj_color = vec3(0.4f, 0.3f, 0.2f);
+  vec3 obj_color = vec3(OBJECT_R, OBJECT_G, OBJECT_B);
   vec3 light_color = vec3(1.f, 1.f, 1.f);
   vec3 light_pos = vec3(-3.f, 3.f, -3.f);
 
+  if (USE_TEXTURE) {
+    obj_color *= SAMPLE_ALBEDO(frag_texcoord).rgb;
+  }
+
+  if (LIGHTING_MODEL == LIGHTING_UNLIT) {
+    color_output = vec4(obj_color, 1.f);
+    return;
+  }
+
   vec3 normal = normalize(frag_normal);
   vec3 light_dir = normalize(light_pos - frag_pos);
   vec3 view_dir = normalize(view_pos - frag_pos);
   vec3 reflect_dir = reflect(-light_dir, normal);
 
-  // float ambient_str = 0.3f;
-  // vec3 ambient = ambient_str * light_color;
-
-  // float diff = max(dot(normal, light_dir), 0);
-  // vec3 diffuse = diff * light_color;
-
-  // vec3 result = (ambient + diffuse) * obj_color;
-
-  /* TOON */
-  // Ambient
-  float toon_ambient_str = 0.4f;
-  vec3 toon_ambient = toon_ambient_str * vec3(0.24725, 0.1995, 0.0745);
-
-  // Diffuse
-  vec3 diff_color = vec3(0.75164, 0.60648, 0.22648);
-  float diff = max(dot(normal, light_dir), 0);
-  float toon_diff_intensity =
-      smoothstep(0, 0.01, diff); // 1st arg: min, 2d arg: threshold, 3rd arg:
-                                 // the value to be interpolated
-  vec3 toon_diffuse = toon_diff_intensity * diff_color;
-
-  // Specular
-  vec3 spec_color = vec3(0.628281, 0.555802, 0.366065); // vec3(0.9f);
-  float glossiness = 64;
-
-  float spec = pow(dot(view_dir, reflect_dir), glossiness);
-  float toon_spec_intensity = smoothstep(0.005f, 0.01f, spec);
+  vec3 ambient_color = vec3(AMBIENT_R, AMBIENT_G, AMBIENT_B);
+  vec3 diff_color = vec3(DIFFUSE_R, DIFFUSE_G, DIFFUSE_B);
+  vec3 spec_color = vec3(SPECULAR_R, SPECULAR_G, SPECULAR_B);
 
-  vec3 toon_specular = toon_spec_intensity * spec_color;
+  vec3 result = AMBIENT_STRENGTH * ambient_color;
 
-  // Rim Lighting
-  float rim_amount = 0.716;
-  float rim_light = 1 - dot(view_dir, normal);
-  float rim_intensity =
-      smoothstep(rim_amount - 0.01, rim_amount + 0.01, rim_light);
-  // rim_light = rim_intensity * rim_light;
+  if (LIGHTING_MODEL == LIGHTING_PHONG) {
+    if (USE_DIFFUSE) {
+      float diff = max(dot(normal, light_dir), 0);
+      result += diff * diff_color * light_color;
+    }
+    if (USE_SPECULAR) {
+      float spec = pow(max(dot(view_dir, reflect_dir), 0), GLOSSINESS);
+      result += spec * spec_color * light_color;
+    }
+  } else {
+    /* TOON */
+    if (USE_DIFFUSE) {
+      float diff = max(dot(normal, light_dir), 0);
+      float toon_diff_intensity =
+          smoothstep(0, 0.01, diff); // 1st arg: min, 2d arg: threshold, 3rd
+                                     // arg: the value to be interpolated
+      result += toon_diff_intensity * diff_color;
+    }
+    if (USE_SPECULAR) {
+      float spec = pow(dot(view_dir, reflect_dir), GLOSSINESS);
+      float toon_spec_intensity = smoothstep(0.005f, 0.01f, spec);
+      result += toon_spec_intensity * spec_color;
+    }
+    if (USE_RIM) {
+      float rim_light = 1 - dot(view_dir, normal);
+      float rim_intensity =
+          smoothstep(RIM_AMOUNT - 0.01, RIM_AMOUNT + 0.01, rim_light);
+      result += rim_intensity * rim_light;
+    }
+  }
 
-  vec3 result =
-      (toon_ambient + toon_diffuse + toon_specular + rim_light) * obj_color;
-  color_output = vec4(result, 1.f);
-}
\ No newline at end of file
+  color_output = vec4(result * obj_color, 1.f);
+}
@@ -23,8 +23,32 @@
 #define TINYOBJLOADER_IMPLEMENTATION
 #include <tinyobjloader/tiny_obj_loader.h>
 
+#include "Benchmark.h"
+#include "BindlessDescriptors.h"
+#include "CommandRecorder.h"
+#include "CpuProfiler.h"
+#include "DescriptorAllocator.h"
+#include "DeletionQueue.h"
+#include "DescriptorWriter.h"
+#include "FrameAllocator.h"
+#include "FrameContext.h"
+#include "FramePacing.h"
+#include "FrameReadback.h"
+#include "FrameStatistics.h"
+#include "GpuProfiler.h"
+#include "HostAllocator.h"
+#include "JobSystem.h"
+#include "MemoryTracker.h"
+#include "PipelineStatistics.h"
+#include "ShaderVariants.h"
+#include "SpirvOptimizer.h"
+#include "TimelineSync.h"
+#include "TransformSystem.h"
+
 #include <algorithm>
 #include <array>
+#include <chrono>
+#include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
@@ -32,7 +56,9 @@
 #include <iostream>
 #include <optional>
 #include <set>
+#include <sstream>
 #include <stdexcept>
+#include <string>
 #include <vector>
 
 const int WIDTH                = 1280;
@@ -46,8 +72,69 @@ const std::vector<const char*> glb_device_extensions = {VK_KHR_SWAPCHAIN_EXTENSI
 const std::vector<const char*> glb_validation_layers = {
     "VK_LAYER_LUNARG_standard_validation"};
 
+/* Benchmarks run without them, unless VT_VALIDATION=1 */
 const bool glb_enable_validation_layers = true;
 
+/* Global texture array (VK_EXT_descriptor_indexing), falls back to one set per draw */
+const bool glb_enable_bindless = true;
+
+/* One timeline semaphore per queue (VK_KHR_timeline_semaphore), falls back to fences */
+const bool glb_enable_timeline_semaphores = true;
+
+/* Load time SPIR-V passes (see compile_shaders.sh for the offline ones). The debug info
+ * is stripped when built with SHADER_CONFIG=release. */
+const Backend::SpirvOptimizationLevel glb_shader_optimization =
+    Backend::SpirvOptimizationLevel::Performance;
+#ifdef STRIP_SHADER_DEBUG_INFO
+const bool glb_strip_shader_debug_info = true;
+#else
+const bool glb_strip_shader_debug_info = false;
+#endif
+
+/* Print raw vkUpdateDescriptorSets vs update template timings at startup */
+const bool glb_benchmark_descriptor_writes = false;
+
+/* Print SIMD vs scalar TransformSystem update timings (100k objects) at startup */
+const bool glb_benchmark_transforms = false;
+
+/* Print the JobSystem ParallelFor scaling on 1 to N threads at startup. Overridden by
+ * VT_BENCH_JOBS (N, 0 for one per core), which also doesn't need a rebuild. */
+const bool glb_benchmark_jobs = false;
+
+/* Present mode and frames in flight, overridden by VT_PACING and VT_FRAMES_IN_FLIGHT.
+ * P cycles the profiles at runtime. */
+const Backend::PacingProfile glb_pacing_profile = Backend::PacingProfile::Throughput;
+
+/* Render to offscreen images, without window, surface or swapchain (CI, render farm).
+ * Overridden by VT_HEADLESS (WIDTHxHEIGHT, 1 for the window size, 0 to disable) and
+ * VT_HEADLESS_FRAMES. */
+const bool     glb_headless        = false;
+const uint32_t glb_headless_frames = 300;
+
+/* Copy every frame back and write it to disk from a worker thread. Overridden by
+ * VT_CAPTURE (output prefix, ex: captures/frame_) and VT_CAPTURE_FORMAT (png, raw). */
+const bool glb_capture_frames = false;
+
+/* Pipeline statistics queries (vertices, invocations, primitives) around the passes,
+ * when the device supports them. Overridden by VT_PIPELINE_STATS (1, 0). */
+const bool glb_pipeline_statistics = false;
+
+/* Vulkan host allocations through Backend::HostAllocator (per scope arenas, counters in
+ * the per second report). Overridden by VT_HOST_ALLOCATOR (1, 0). */
+const bool glb_track_host_allocations = true;
+
+/* Benchmark mode, headless : VT_BENCHMARK=orbit|flyby|static (camera path) renders
+ * warmup then measured frames at a fixed time step and writes a JSON summary. See
+ * Backend::GetBenchmarkConfigFromEnv for the other VT_BENCH_* settings. */
+const uint32_t glb_benchmark_warmup_frames   = 60;
+const uint32_t glb_benchmark_measured_frames = 600;
+
+/* Job system threads, main thread included (0 : one per core). Runs the command
+ * recording and the asset import. Overridden by VT_JOB_THREADS. */
+const uint32_t glb_job_threads = 0;
+/* Split the model in N draws, to stress the recording with large draw lists */
+const uint32_t glb_model_draw_count = 1;
+
 VkResult CreateDebugUtilsMessengerEXT(
     VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo,
     const VkAllocationCallbacks* pAllocator, VkDebugUtilsMessengerEXT* pMessenger) {
@@ -173,6 +260,14 @@ struct UniformBufferObject {
     glm::mat4 view;
     glm::mat4 proj;
 };
+static_assert(sizeof(glm::mat4) == sizeof(Backend::Matrix4), "Model written as a Matrix4");
+
+/* One indexed draw of the scene */
+struct DrawItem {
+    uint32_t FirstIndex;
+    uint32_t IndexCount;
+    uint32_t TextureIndex; /* Slot in the bindless table */
+};
 
 //{0.26f, 0.23f, 0.31f, 1.0f}
 
@@ -187,125 +282,396 @@ class Application {
 
   private:
     void _InitWindow() {
+        _ReadHeadlessConfig();
+        _ReadBenchmarkConfig();
+        if (_headless) {
+            return; /* No display needed */
+        }
+
         glfwInit();
         glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-        glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
         _window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", nullptr, nullptr);
+        glfwSetWindowUserPointer(_window, this);
+        glfwSetFramebufferSizeCallback(_window, _FramebufferResizeCallback);
+        glfwSetKeyCallback(_window, _KeyCallback);
+    }
+
+    /*
+     * Not every platform reports a resize through acquire/present, flag it for
+     * _DrawFrame
+     */
+    static void _FramebufferResizeCallback(GLFWwindow* window, int width, int height) {
+        auto app = reinterpret_cast<Application*>(glfwGetWindowUserPointer(window));
+        app->_framebuffer_resized = true;
+    }
+
+    void _ReadHeadlessConfig() {
+        _headless        = glb_headless;
+        _headless_extent = {WIDTH, HEIGHT};
+        _headless_frames = glb_headless_frames;
+        if (const char* headless = std::getenv("VT_HEADLESS")) {
+            uint32_t width, height;
+            if (std::sscanf(headless, "%ux%u", &width, &height) == 2 && width > 0 &&
+                height > 0) {
+                _headless        = true;
+                _headless_extent = {width, height};
+            } else {
+                _headless = std::string(headless) != "0";
+            }
+        }
+        if (const char* frames = std::getenv("VT_HEADLESS_FRAMES")) {
+            _headless_frames = static_cast<uint32_t>(std::atoi(frames));
+        }
+        if (_headless) {
+            std::cout << "Headless:" << _headless_extent.width << "x"
+                      << _headless_extent.height << ", " << _headless_frames << " frames"
+                      << std::endl;
+        }
+    }
+
+    /*
+     * Scene and time step, a benchmark overrides them and forces the headless mode
+     */
+    void _ReadBenchmarkConfig() {
+        _benchmark                = {};
+        _benchmark.Camera         = Backend::CameraPath::Static;
+        _benchmark.Extent         = _headless_extent;
+        _benchmark.WarmupFrames   = glb_benchmark_warmup_frames;
+        _benchmark.MeasuredFrames = glb_benchmark_measured_frames;
+        _benchmark.TimeStep       = 1.0 / 60.0;
+        _benchmark.ModelPath      = "./Models/chalet.obj";
+        _benchmark.TexturePath    = "./Textures/chalet.jpg";
+        _benchmark.DrawCount      = glb_model_draw_count;
+        _benchmark.OutputPath     = "benchmark.json";
+
+        _benchmarking = Backend::GetBenchmarkConfigFromEnv(_benchmark);
+        _validation   = glb_enable_validation_layers && !_benchmarking;
+        if (const char* validation = std::getenv("VT_VALIDATION")) {
+            _validation = std::string(validation) != "0";
+        }
+        if (_benchmarking) {
+            _headless        = true;
+            _headless_extent = _benchmark.Extent;
+            _headless_frames = _benchmark.MeasuredFrames;
+            std::cout << "Benchmark:" << _benchmark.Name << ", " << _benchmark.Extent.width
+                      << "x" << _benchmark.Extent.height << ", " << _benchmark.WarmupFrames
+                      << "+" << _benchmark.MeasuredFrames << " frames" << std::endl;
+        }
+    }
+
+    void _ReadCaptureConfig() {
+        _capture        = glb_capture_frames;
+        _capture_prefix = "frame_";
+        _capture_format = Backend::CaptureFormat::Png;
+        if (const char* prefix = std::getenv("VT_CAPTURE")) {
+            _capture        = true;
+            _capture_prefix = prefix;
+        }
+        if (const char* format = std::getenv("VT_CAPTURE_FORMAT")) {
+            _capture_format = std::string(format) == "raw" ? Backend::CaptureFormat::Raw
+                                                           : Backend::CaptureFormat::Png;
+        }
+    }
+
+    static void _KeyCallback(GLFWwindow* window, int key, int scancode, int action,
+                             int mods) {
+        auto app = reinterpret_cast<Application*>(glfwGetWindowUserPointer(window));
+        if (key == GLFW_KEY_P && action == GLFW_PRESS) {
+            app->_pacing_switch_requested = true;
+        }
+        if (key == GLFW_KEY_M && action == GLFW_PRESS) {
+            app->_ReportMemory(true);
+        }
     }
 
     void _MainLoop() {
+        if (_headless) {
+            _HeadlessLoop();
+            vkDeviceWaitIdle(_device);
+            return;
+        }
+
         double   last_frame_time = glfwGetTime();
         uint32_t nb_frames       = 0;
 
         while (!glfwWindowShouldClose(_window)) {
             double curr_frame_time = glfwGetTime();
             nb_frames++;
-            /* If there is 1sec since last cout */
+            /* Once per second, written by the log worker */
             if (curr_frame_time - last_frame_time >= 1.0) {
-                std::cout << nb_frames << "fps" << std::endl;
-                std::cout << 1000.0 / double(nb_frames) << "ms" << std::endl;
+                std::ostringstream report;
+                report << nb_frames << "fps\n";
+                report << _command_recorder.LastRecordMs() << "ms recording ("
+                       << _draws.size() << " draws, "
+                       << _command_recorder.LastRecordedBuckets() << "/"
+                       << _command_recorder.LastBucketCount() << " buckets re-recorded)\n";
+                report << "Input to present: " << _latency.AveragePresentMs()
+                       << "ms, to GPU done: " << _latency.AverageCompleteMs() << "ms ("
+                       << Backend::PacingProfileName(_pacing.Profile) << ", "
+                       << _frames.FramesInFlight() << " frames in flight)\n";
+                _latency.ResetAverages();
+                _PrintGpuScopes(report);
+                _pipeline_stats.Report(report);
+                _memory_tracker.ReportHeaps(report);
+                Backend::HostAllocator::Get().Report(report);
+                _ReportFrameAllocations(report, nb_frames);
+                _frame_stats.Report(report.str());
+                if (_pipeline_stats.Enabled()) {
+                    std::string title = "Vulkan | " + _pipeline_stats.Summary();
+                    glfwSetWindowTitle(_window, title.c_str());
+                }
                 nb_frames = 0;
                 last_frame_time += 1.0;
             }
-            glfwPollEvents();
+            if (!_pacing.LateInput) {
+                /* Else polled by _DrawFrame once the frame slot and image are acquired */
+                glfwPollEvents();
+                _latency.OnInputSampled();
+            }
+            if (_pacing_switch_requested) {
+                _pacing_switch_requested = false;
+                _ApplyPacingProfile(Backend::NextPacingProfile(_pacing.Profile));
+            }
             _DrawFrame();
         }
         vkDeviceWaitIdle(_device);
+        _frame_stats.ReportHistogram();
+    }
+
+    /*
+     * Render a fixed number of frames as fast as the GPU allows, then print the timings
+     */
+    void _HeadlessLoop() {
+        if (_benchmarking) {
+            for (uint32_t i = 0; i < _benchmark.WarmupFrames; i++) {
+                _DrawFrame();
+            }
+            /* The measured frames start from an idle queue, with empty statistics */
+            _graphics_timeline.WaitIdle();
+            _gpu_profiler.ResolveAll();
+            _gpu_profiler.ResetScopes(_headless_frames);
+            _frame_stats.Reset(_headless_frames);
+            _pipeline_stats.Reset();
+            _latency.Reset();
+            _frame_heap_allocations = 0;
+        }
+
+        auto start = std::chrono::high_resolution_clock::now();
+        for (uint32_t i = 0; i < _headless_frames; i++) {
+            _DrawFrame();
+        }
+        _graphics_timeline.WaitIdle();
+        _gpu_profiler.ResolveAll();
+        double total_ms = std::chrono::duration<double, std::milli>(
+                              std::chrono::high_resolution_clock::now() - start)
+                              .count();
+
+        std::ostringstream report;
+        report << "Headless: " << _headless_frames << " frames in " << total_ms << "ms ("
+               << total_ms / std::max(1u, _headless_frames) << "ms/frame, "
+               << _command_recorder.LastRecordMs() << "ms recording)\n";
+        _PrintGpuScopes(report);
+        _pipeline_stats.Report(report);
+        Backend::HostAllocator::Get().Report(report);
+        _ReportFrameAllocations(report, _headless_frames);
+        _frame_stats.Report(report.str());
+        _frame_stats.ReportHistogram();
+
+        if (_benchmarking) {
+            VkPhysicalDeviceProperties properties;
+            vkGetPhysicalDeviceProperties(_physical_dev, &properties);
+            Backend::WriteBenchmarkJson(_benchmark, properties.deviceName, _frame_stats,
+                                        total_ms, _gpu_profiler.Scopes(),
+                                        Backend::QueryHostMemoryUsage(), _memory_tracker);
+        }
+    }
+
+    /*
+     * Scratch use of the frames, and the heap allocations made by _DrawFrame on the render
+     * thread since the last report (HEAP_COUNTER=1 builds). The jobs stolen by workers,
+     * the log writer and the readback worker aren't counted.
+     */
+    void _ReportFrameAllocations(std::ostream& out, uint32_t frame_count) {
+        out << "Frame scratch: " << _frames.ScratchPeak() / 1024 << "KiB peak, "
+            << _frames.ScratchOverflows() << " overflows";
+        if (Backend::HeapCounter::Enabled()) {
+            out << ", heap: " << _frame_heap_allocations << " allocations in "
+                << frame_count << " frames";
+        }
+        out << "\n";
+        _frame_heap_allocations = 0;
+    }
+
+    void _PrintGpuScopes(std::ostream& out) {
+        for (const auto& scope : _gpu_profiler.Scopes()) {
+            out << "GPU " << scope.first << ": " << scope.second.Average() << "ms avg, "
+                << scope.second.Percentile(50) << "ms p50, " << scope.second.Percentile(95)
+                << "ms p95, " << scope.second.Percentile(99) << "ms p99\n";
+        }
     }
 
     void _Cleanup() {
-        vkDestroyDescriptorPool(_device, _descriptor_pool, nullptr);
-        vkDestroyDescriptorSetLayout(_device, _descriptor_set_layout, nullptr);
-
-        vkDestroyImageView(_device, _depth_img_view, nullptr);
-        vkDestroyImage(_device, _depth_image, nullptr);
-        vkFreeMemory(_device, _depth_img_memory, nullptr);
-        vkDestroySampler(_device, _cubemap_sampler, nullptr);
-        vkDestroyImageView(_device, _cubemap_img_view, nullptr);
-        vkDestroyImage(_device, _cubemap_image, nullptr);
-        vkFreeMemory(_device, _cubemap_img_memory, nullptr);
-        vkDestroySampler(_device, _texture_sampler, nullptr);
-        vkDestroyImageView(_device, _texture_img_view, nullptr);
-        vkDestroyImage(_device, _texture_image, nullptr);
-        vkFreeMemory(_device, _texture_img_memory, nullptr);
+        _readback.Destroy();
+        _frame_stats.Destroy();
+        _deletion_queue.Flush();
+        _bindless_textures.Destroy();
+        _descriptor_template.Destroy();
+        _descriptor_allocator.Destroy();
+        _descriptor_layout_cache.Destroy();
+
+        vkDestroyImageView(_device, _depth_img_view, Backend::HostCallbacks());
+        vkDestroyImage(_device, _depth_image, Backend::HostCallbacks());
+        _memory_tracker.Free(_depth_img_memory);
+        vkDestroySampler(_device, _cubemap_sampler, Backend::HostCallbacks());
+        vkDestroyImageView(_device, _cubemap_img_view, Backend::HostCallbacks());
+        vkDestroyImage(_device, _cubemap_image, Backend::HostCallbacks());
+        _memory_tracker.Free(_cubemap_img_memory);
+        vkDestroySampler(_device, _texture_sampler, Backend::HostCallbacks());
+        vkDestroyImageView(_device, _texture_img_view, Backend::HostCallbacks());
+        vkDestroyImage(_device, _texture_image, Backend::HostCallbacks());
+        _memory_tracker.Free(_texture_img_memory);
 
         for (size_t i = 0; i < _swapchain_images.size(); i++) {
-            vkDestroyBuffer(_device, _uniform_buffers[i], nullptr);
-            vkFreeMemory(_device, _uniform_buffers_memory[i], nullptr);
-            vkDestroyBuffer(_device, _uniform_buffers_cubemap[i], nullptr);
-            vkFreeMemory(_device, _uniform_buffers_cubemap_memory[i], nullptr);
+            vkDestroyBuffer(_device, _uniform_buffers[i], Backend::HostCallbacks());
+            _memory_tracker.Free(_uniform_buffers_memory[i]);
+            vkDestroyBuffer(_device, _uniform_buffers_cubemap[i], Backend::HostCallbacks());
+            _memory_tracker.Free(_uniform_buffers_cubemap_memory[i]);
         }
 
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            vkDestroySemaphore(_device, _semaphores_render_finished[i], nullptr);
-            vkDestroySemaphore(_device, _semaphores_img_available[i], nullptr);
-            vkDestroyFence(_device, _fences_inflight[i], nullptr);
-        }
-        vkDestroyCommandPool(_device, _command_pool, nullptr);
+        _frames.Destroy();
+        _command_recorder.Destroy();
+        _jobs.Destroy();
+        vkDestroyCommandPool(_device, _command_pool, Backend::HostCallbacks());
         for (auto framebuffer : _swapchain_framebuffers) {
-            vkDestroyFramebuffer(_device, framebuffer, nullptr);
+            vkDestroyFramebuffer(_device, framebuffer, Backend::HostCallbacks());
         }
 
-        vkDestroyBuffer(_device, _index_buffer, nullptr);
-        vkFreeMemory(_device, _index_buffer_memory, nullptr);
-        vkDestroyBuffer(_device, _vertex_buffer, nullptr);
-        vkFreeMemory(_device, _vertex_buffer_memory, nullptr);
+        vkDestroyBuffer(_device, _index_buffer, Backend::HostCallbacks());
+        _memory_tracker.Free(_index_buffer_memory);
+        vkDestroyBuffer(_device, _vertex_buffer, Backend::HostCallbacks());
+        _memory_tracker.Free(_vertex_buffer_memory);
 
-        vkDestroyPipeline(_device, _graphics_pipeline, nullptr);
-        vkDestroyPipelineLayout(_device, _pipeline_layout, nullptr);
-        vkDestroyRenderPass(_device, _renderpass, nullptr);
+        _shader_variants.Destroy();
+        vkDestroyShaderModule(_device, _vertex_module, Backend::HostCallbacks());
+        vkDestroyShaderModule(_device, _fragment_module, Backend::HostCallbacks());
+        vkDestroyPipelineLayout(_device, _pipeline_layout, Backend::HostCallbacks());
+        vkDestroyRenderPass(_device, _renderpass, Backend::HostCallbacks());
         for (auto img_view : _swapchain_img_views) {
-            vkDestroyImageView(_device, img_view, nullptr);
+            vkDestroyImageView(_device, img_view, Backend::HostCallbacks());
+        }
+        if (_headless) {
+            for (size_t i = 0; i < _swapchain_images.size(); i++) {
+                vkDestroyImage(_device, _swapchain_images[i], Backend::HostCallbacks());
+                _memory_tracker.Free(_offscreen_memory[i]);
+            }
+        } else {
+            vkDestroySwapchainKHR(_device, _swapchain, Backend::HostCallbacks());
         }
-        vkDestroySwapchainKHR(_device, _swapchain, nullptr);
 
-        vkDestroyDevice(_device, nullptr);
-        if (glb_enable_validation_layers) {
-            DestroyDebugUtilsMessengerEXT(_instance, _debug_messenger, nullptr);
+        if (_memory_tracker.AllocationCount() > 0) {
+            std::cout << "Leaked device memory:" << std::endl;
+            _memory_tracker.DumpAllocations(std::cout);
+        }
+        _pipeline_stats.Destroy();
+        _gpu_profiler.Destroy();
+        _graphics_timeline.Destroy();
+        vkDestroyDevice(_device, Backend::HostCallbacks());
+        if (_validation) {
+            DestroyDebugUtilsMessengerEXT(_instance, _debug_messenger,
+                                          Backend::HostCallbacks());
+        }
+        if (!_headless) {
+            vkDestroySurfaceKHR(_instance, _surface, Backend::HostCallbacks());
         }
-        vkDestroySurfaceKHR(_instance, _surface, nullptr);
-        vkDestroyInstance(_instance, nullptr);
-        glfwDestroyWindow(_window);
-        glfwTerminate();
+        vkDestroyInstance(_instance, Backend::HostCallbacks());
+        if (!_headless) {
+            glfwDestroyWindow(_window);
+            glfwTerminate();
+        }
+        CPU_PROFILER_EXPORT();
     }
 
     void _InitVulkan() {
+        CPU_THREAD_NAME("Main");
+        CPU_FUNCTION();
+        _pacing = Backend::GetPacingConfigFromEnv(glb_pacing_profile, MAX_FRAMES_IN_FLIGHT);
+        std::cout << "Pacing:" << Backend::PacingProfileName(_pacing.Profile) << std::endl;
+        _ReadCaptureConfig();
+        /* Per frame CPU, wait and present interval timings are also written as CSV to
+         * VT_FRAME_STATS_CSV (path), by the log worker */
+        const char* stats_csv = std::getenv("VT_FRAME_STATS_CSV");
+        _frame_stats.Init(1024, 2.0, stats_csv ? stats_csv : "");
+        bool track_host_allocations = glb_track_host_allocations;
+        if (const char* host_allocator = std::getenv("VT_HOST_ALLOCATOR")) {
+            track_host_allocations = std::string(host_allocator) != "0";
+        }
+        Backend::HostAllocator::Get().Enable(track_host_allocations);
+        _InitJobs();
         _CreateInstance();
         _SetupDebugMessenger();
         _CreateSurface();
         _PickPhysicalDevice();
         _CreateLogicalDevice();
-        _CreateSwapChain();
+        if (_headless) {
+            _CreateOffscreenImages();
+        } else {
+            _CreateSwapChain();
+        }
         _CreateImageViews();
         _CreateCommandPool();
         _CreateDepthResources();
         _CreateRenderpPass();
         _CreateDescriptorSetLayout();
-        _CreateGraphisPipeline();
+        _CreatePipelineLayout();
+        _CreateShaderVariants();
         _CreateFrameBuffers();
+        /* The model is parsed on a worker while the textures load */
+        Backend::JobCounter model_loaded;
+        _jobs.Submit([this] { _LoadModel(); }, &model_loaded);
+        Backend::JobGuard model_guard(_jobs, model_loaded); /* If a texture throws */
         _texture_image =
-            _CreateTextureImage("./Textures/chalet.jpg", _texture_img_memory, 0);
+            _CreateTextureImage(_benchmark.TexturePath.c_str(), _texture_img_memory, 0);
         _cubemap_image =
             _CreateTextureImage("./Textures/cubemap_space.ktx", _cubemap_img_memory, 1);
         _texture_img_view = _CreateTextureImageView(_texture_image);
         _cubemap_img_view = _CreateTextureImageView(_cubemap_image,  VK_FORMAT_BC3_UNORM_BLOCK);
         _texture_sampler  = _CreateTextureSampler();
         _cubemap_sampler  = _CreateTextureSampler();
-        _LoadModel();
+        if (_bindless) {
+            _texture_index = _bindless_textures.Register(_texture_img_view, _texture_sampler);
+        }
+        _jobs.Wait(model_loaded);
         _CreateIndexBuffer();
         _CreateVertexBuffer();
 
         _CreateUniformBuffers();
-        _CreateDescriptorPool();
+        _CreateTransforms();
+        _CreateDescriptorAllocator();
         _CreateDescriptorSets();
 
+        _BuildDrawList();
         _CreateCommandBuffers();
         _CreateSyncObjects();
+        _CreateReadback();
+        _ReportMemory(std::getenv("VT_MEMORY_DUMP") != nullptr);
+    }
+
+    /*
+     * Categories and heaps, plus every live allocation when dump is set (M key)
+     */
+    void _ReportMemory(bool dump) {
+        _memory_tracker.ReportCategories(std::cout);
+        _memory_tracker.ReportHeaps(std::cout);
+        if (dump) {
+            _memory_tracker.DumpAllocations(std::cout);
+        }
     }
 
     void _CreateInstance() {
-        if (glb_enable_validation_layers && !_CheckValidationLayerSupport()) {
+        CPU_FUNCTION();
+        if (_validation && !_CheckValidationLayerSupport()) {
             throw std::runtime_error("Validation layers requested, but not available");
         }
 
@@ -315,7 +681,7 @@ class Application {
         app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
         app_info.pEngineName        = "Firefly";
         app_info.engineVersion      = VK_MAKE_VERSION(1, 0, 0);
-        app_info.apiVersion         = VK_API_VERSION_1_0;
+        app_info.apiVersion         = VK_API_VERSION_1_1; /* vkGetPhysicalDeviceFeatures2 */
 
         /* To get a list of all supported extensions */
         uint32_t ext_count = 0;
@@ -335,7 +701,7 @@ class Application {
         create_info.pApplicationInfo        = &app_info;
         create_info.enabledExtensionCount   = static_cast<uint32_t>(extensions.size());
         create_info.ppEnabledExtensionNames = extensions.data();
-        if (glb_enable_validation_layers) {
+        if (_validation) {
             create_info.enabledLayerCount =
                 static_cast<uint32_t>(glb_validation_layers.size());
             create_info.ppEnabledLayerNames = glb_validation_layers.data();
@@ -343,30 +709,37 @@ class Application {
             create_info.enabledLayerCount = 0;
         }
 
-        if (vkCreateInstance(&create_info, nullptr, &_instance) != VK_SUCCESS) {
+        if (vkCreateInstance(&create_info, Backend::HostCallbacks(), &_instance) !=
+            VK_SUCCESS) {
             throw std::runtime_error("Failed to create Vulkan Instance");
         }
     }
     void _CreateSurface() {
+        if (_headless) {
+            return;
+        }
         // VkXcbSurfaceCreateInfoKHR xcb_create_info = {};
         // xcb_create_info.sType  = VK_STRUCTURE_TYPE_XCB_SURFACE_CREATE_INFO_KHR;
         // xcb_create_info.window = glfwGetX11Window(_window);
         // if(vkCreateXcbSurfaceKHR(_instance,&xcb_create_info,nullptr,&_surface)!=VK_SUCCESS){
         //     throw std::runtime_error("Failed to create window surface");
         // }
-        if (glfwCreateWindowSurface(_instance, _window, nullptr, &_surface) !=
+        if (glfwCreateWindowSurface(_instance, _window,
+                                    Backend::HostCallbacks(), &_surface) !=
             VK_SUCCESS) {
             throw std::runtime_error("Failed to create window surface");
         }
     }
     std::vector<const char*> _GetRequiredExtensions() {
-        uint32_t     glfw_ext_count = 0;
-        const char** glfw_extensions;
-        glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_ext_count);
-
-        std::vector<const char*> extensions(glfw_extensions,
-                                            glfw_extensions + glfw_ext_count);
-        if (glb_enable_validation_layers) {
+        std::vector<const char*> extensions;
+        if (!_headless) {
+            /* VK_KHR_surface and the platform's surface extension */
+            uint32_t     glfw_ext_count = 0;
+            const char** glfw_extensions;
+            glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_ext_count);
+            extensions.assign(glfw_extensions, glfw_extensions + glfw_ext_count);
+        }
+        if (_validation) {
             extensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
         }
 
@@ -398,7 +771,7 @@ class Application {
     }
 
     void _SetupDebugMessenger() {
-        if (!glb_enable_validation_layers)
+        if (!_validation)
             return;
         VkDebugUtilsMessengerCreateInfoEXT create_info = {};
         create_info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
@@ -411,7 +784,7 @@ class Application {
         create_info.pfnUserCallback = _DebugCallback;
         create_info.pUserData       = nullptr;
 
-        if (CreateDebugUtilsMessengerEXT(_instance, &create_info, nullptr,
+        if (CreateDebugUtilsMessengerEXT(_instance, &create_info, Backend::HostCallbacks(),
                                          &_debug_messenger) != VK_SUCCESS) {
             throw std::runtime_error("Failed to set up debug messenger");
         }
@@ -428,6 +801,7 @@ class Application {
     }
 
     void _PickPhysicalDevice() {
+        CPU_FUNCTION();
         uint32_t dev_count = 0;
         vkEnumeratePhysicalDevices(_instance, &dev_count, nullptr);
         if (dev_count == 0) {
@@ -463,8 +837,8 @@ class Application {
 
         QueueFamilyIndices indices              = _FindQueueFamilies(dev);
         bool               extensions_supported = _CheckDeviceExtensionSupport(dev);
-        bool               swapchain_adequate   = false;
-        if (extensions_supported) {
+        bool               swapchain_adequate   = _headless;
+        if (extensions_supported && !_headless) {
             SwapChainSupportDetails swapchain_support = _QuerySwapChainSupport(dev);
             swapchain_adequate = !swapchain_support.formats.empty() &&
                                  !swapchain_support.present_modes.empty();
@@ -480,8 +854,9 @@ class Application {
         vkEnumerateDeviceExtensionProperties(dev, nullptr, &ext_count,
                                              dev_available_ext.data());
 
-        std::set<std::string> required_ext(glb_device_extensions.begin(),
-                                           glb_device_extensions.end());
+        std::vector<const char*> device_extensions = _GetRequiredDeviceExtensions();
+        std::set<std::string>    required_ext(device_extensions.begin(),
+                                           device_extensions.end());
         for (const auto& ext : dev_available_ext) {
             required_ext.erase(ext.extensionName);
         }
@@ -489,7 +864,21 @@ class Application {
         return required_ext.empty();
     }
 
+    /*
+     * glb_device_extensions, without the swapchain when headless
+     */
+    std::vector<const char*> _GetRequiredDeviceExtensions() {
+        std::vector<const char*> extensions;
+        for (const char* ext : glb_device_extensions) {
+            if (!_headless || strcmp(ext, VK_KHR_SWAPCHAIN_EXTENSION_NAME) != 0) {
+                extensions.push_back(ext);
+            }
+        }
+        return extensions;
+    }
+
     void _CreateLogicalDevice() {
+        CPU_FUNCTION();
         QueueFamilyIndices indices               = _FindQueueFamilies(_physical_dev);
         std::set<uint32_t> queue_family_indinces = {indices.graphics_family.value(),
                                                     indices.present_family.value()};
@@ -509,16 +898,64 @@ class Application {
         VkPhysicalDeviceFeatures dev_features = {};
         dev_features.samplerAnisotropy        = VK_TRUE;
 
+        bool pipeline_stats = glb_pipeline_statistics;
+        if (const char* stats = std::getenv("VT_PIPELINE_STATS")) {
+            pipeline_stats = std::string(stats) != "0";
+        }
+        pipeline_stats =
+            pipeline_stats && Backend::PipelineStatistics::IsSupported(_physical_dev);
+        dev_features.pipelineStatisticsQuery = pipeline_stats;
+        dev_features.inheritedQueries        = pipeline_stats; /* Secondaries in queries */
+        std::cout << "PipelineStatistics:" << pipeline_stats << std::endl;
+
+        std::vector<const char*> device_extensions = _GetRequiredDeviceExtensions();
+
+        /* Bindless needs the extension and the bindless variant of the fragment shader */
+        _bindless = glb_enable_bindless &&
+                    Backend::QueryBindlessSupport(_physical_dev,
+                                                  _descriptor_indexing_features) &&
+                    std::ifstream("./Shaders/frag_bindless.spv").good();
+        if (_bindless) {
+            device_extensions.push_back(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+        }
+        std::cout << "Bindless:" << _bindless << std::endl;
+
+        _timeline_sync = glb_enable_timeline_semaphores &&
+                         Backend::QueryTimelineSupport(_physical_dev,
+                                                       _timeline_semaphore_features);
+        if (_timeline_sync) {
+            device_extensions.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+        }
+        std::cout << "TimelineSemaphores:" << _timeline_sync << std::endl;
+
+        bool memory_budget = Backend::QueryMemoryBudgetSupport(_physical_dev);
+        if (memory_budget) {
+            device_extensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        }
+        std::cout << "MemoryBudget:" << memory_budget << std::endl;
+
+        /* Feature structs of the enabled extensions */
+        void* features_chain = nullptr;
+        if (_bindless) {
+            _descriptor_indexing_features.pNext = features_chain;
+            features_chain                      = &_descriptor_indexing_features;
+        }
+        if (_timeline_sync) {
+            _timeline_semaphore_features.pNext = features_chain;
+            features_chain                     = &_timeline_semaphore_features;
+        }
+
         VkDeviceCreateInfo create_info = {};
         create_info.sType              = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+        create_info.pNext              = features_chain;
         create_info.queueCreateInfoCount =
             static_cast<uint32_t>(queue_create_infos.size());
         create_info.pQueueCreateInfos = queue_create_infos.data();
         create_info.pEnabledFeatures  = &dev_features;
         create_info.enabledExtensionCount =
-            static_cast<uint32_t>(glb_device_extensions.size());
-        create_info.ppEnabledExtensionNames = glb_device_extensions.data();
-        if (glb_enable_validation_layers) {
+            static_cast<uint32_t>(device_extensions.size());
+        create_info.ppEnabledExtensionNames = device_extensions.data();
+        if (_validation) {
             create_info.enabledLayerCount =
                 static_cast<uint32_t>(glb_validation_layers.size());
             create_info.ppEnabledLayerNames = glb_validation_layers.data();
@@ -526,13 +963,23 @@ class Application {
             create_info.enabledLayerCount = 0;
         }
 
-        if (vkCreateDevice(_physical_dev, &create_info, nullptr, &_device) !=
+        if (vkCreateDevice(_physical_dev, &create_info,
+                           Backend::HostCallbacks(), &_device) !=
             VK_SUCCESS) {
             throw std::runtime_error("Failed to create logical device");
         }
 
         vkGetDeviceQueue(_device, indices.graphics_family.value(), 0, &_graphics_queue);
         vkGetDeviceQueue(_device, indices.present_family.value(), 0, &_present_queue);
+
+        _graphics_timeline.Init(_device, _graphics_queue, _timeline_sync);
+        _memory_tracker.Init(_physical_dev, _device, memory_budget);
+        _deletion_queue.Init(_graphics_timeline, &_memory_tracker);
+        _gpu_profiler.Init(_physical_dev, _device, indices.graphics_family.value(),
+                           MAX_FRAMES_IN_FLIGHT);
+        if (pipeline_stats) {
+            _pipeline_stats.Init(_device, MAX_FRAMES_IN_FLIGHT);
+        }
     }
 
     QueueFamilyIndices _FindQueueFamilies(VkPhysicalDevice dev) {
@@ -553,7 +1000,12 @@ class Application {
             }
 
             VkBool32 present_support = false;
-            vkGetPhysicalDeviceSurfaceSupportKHR(dev, i, _surface, &present_support);
+            if (_headless) {
+                /* Nothing is presented, the present queue is the graphics one */
+                present_support = indices.graphics_family == i;
+            } else {
+                vkGetPhysicalDeviceSurfaceSupportKHR(dev, i, _surface, &present_support);
+            }
             if (queue_family.queueCount > 0 && present_support) {
                 indices.present_family = i;
             }
@@ -595,7 +1047,12 @@ class Application {
         return details;
     }
 
-    void _CreateSwapChain() {
+    /*
+     * @param old_swapchain (Optional) : Swapchain being replaced, it is retired by the
+     *                                   driver but must still be destroyed by the caller
+     */
+    void _CreateSwapChain(VkSwapchainKHR old_swapchain = VK_NULL_HANDLE) {
+        CPU_FUNCTION();
         SwapChainSupportDetails swapchain_support = _QuerySwapChainSupport(_physical_dev);
 
         /* Color depth (RGB, SRGB, etc) */
@@ -603,12 +1060,13 @@ class Application {
             _ChooseSwapSurfaceFormat(swapchain_support.formats);
         /* Conditions for "swapping" images to screen (vsync, etc) */
         VkPresentModeKHR present_mode =
-            _ChooseSwapPresentModel(swapchain_support.present_modes);
+            Backend::ChoosePresentMode(_pacing, swapchain_support.present_modes);
         std::cout << "PresentMode:" << present_mode << std::endl;
         /* Resolution of images in swapchain */
         VkExtent2D extent = _ChooseSwapExtent(swapchain_support.capabilities);
 
-        uint32_t image_count = 3; /* Double Buffering */
+        uint32_t image_count =
+            std::max(_pacing.ImageCount, swapchain_support.capabilities.minImageCount);
         /* If maxImageCount ==0, there is no maximum */
         if (swapchain_support.capabilities.maxImageCount > 0 &&
             image_count > swapchain_support.capabilities.maxImageCount) {
@@ -625,6 +1083,13 @@ class Application {
         create_info.imageExtent      = extent;
         create_info.imageArrayLayers = 1;
         create_info.imageUsage       = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        if (_capture) {
+            if (!(swapchain_support.capabilities.supportedUsageFlags &
+                  VK_IMAGE_USAGE_TRANSFER_SRC_BIT)) {
+                throw std::runtime_error("Swapchain images can't be copied for the capture");
+            }
+            create_info.imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        }
 
         QueueFamilyIndices indices                 = _FindQueueFamilies(_physical_dev);
         uint32_t           queue_familiy_indices[] = {indices.graphics_family.value(),
@@ -647,9 +1112,10 @@ class Application {
         create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
         create_info.presentMode    = present_mode;
         create_info.clipped        = VK_TRUE;
-        create_info.oldSwapchain   = VK_NULL_HANDLE;
+        create_info.oldSwapchain   = old_swapchain; /* Lets the driver reuse its images */
 
-        if (vkCreateSwapchainKHR(_device, &create_info, nullptr, &_swapchain) !=
+        if (vkCreateSwapchainKHR(_device, &create_info,
+                                 Backend::HostCallbacks(), &_swapchain) !=
             VK_SUCCESS) {
             throw std::runtime_error("Failed to create Swapchain");
         }
@@ -663,6 +1129,122 @@ class Application {
         _swapchain_extent     = extent;
     }
 
+    /*
+     * Headless replacement of the swapchain : one image of the requested size per frame
+     * slot, so an image is free once its frame slot is. TRANSFER_SRC for readbacks.
+     */
+    void _CreateOffscreenImages() {
+        CPU_FUNCTION();
+        _swapchain_img_format = VK_FORMAT_B8G8R8A8_UNORM; /* What the surfaces usually get */
+        _swapchain_extent     = _headless_extent;
+        _swapchain_images.resize(MAX_FRAMES_IN_FLIGHT);
+        _offscreen_memory.resize(MAX_FRAMES_IN_FLIGHT);
+        for (size_t i = 0; i < _swapchain_images.size(); i++) {
+            _CreateImage(_swapchain_extent.width, _swapchain_extent.height,
+                         _swapchain_img_format, VK_IMAGE_TILING_OPTIMAL,
+                         VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                             VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+                         1, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _swapchain_images[i],
+                         _offscreen_memory[i], Backend::MemoryCategory::Attachment,
+                         "offscreen color " + std::to_string(i));
+        }
+        std::cout << "ImageCount:" << _swapchain_images.size() << " (offscreen)"
+                  << std::endl;
+    }
+
+    /*
+     * Rebuild the swapchain and what depends on its size (image views, depth,
+     * framebuffers). The old objects may still be used by the frames in flight, they go
+     * to the deletion queue with the last submitted value instead of waiting the device.
+     * The old swapchain waits MAX_FRAMES_IN_FLIGHT more submissions : a completed submit
+     * doesn't mean its present is done, a frame on the new swapchain does.
+     * The pipelines use a dynamic viewport and scissor, they are kept.
+     */
+    void _RecreateSwapChain() {
+        CPU_FUNCTION();
+        /* Minimized : nothing to present until the window is restored */
+        int width = 0, height = 0;
+        glfwGetFramebufferSize(_window, &width, &height);
+        while ((width == 0 || height == 0) && !glfwWindowShouldClose(_window)) {
+            glfwWaitEvents();
+            glfwGetFramebufferSize(_window, &width, &height);
+        }
+        if (width == 0 || height == 0) {
+            return;
+        }
+
+        VkSwapchainKHR             old_swapchain    = _swapchain;
+        std::vector<VkImageView>   old_img_views    = _swapchain_img_views;
+        std::vector<VkFramebuffer> old_framebuffers = _swapchain_framebuffers;
+        VkImage                    old_depth_image  = _depth_image;
+        VkImageView                old_depth_view   = _depth_img_view;
+        VkDeviceMemory             old_depth_memory = _depth_img_memory;
+        VkFormat                   old_format       = _swapchain_img_format;
+        size_t                     old_image_count  = _swapchain_images.size();
+
+        _CreateSwapChain(old_swapchain);
+        if (_swapchain_img_format != old_format) {
+            /* The renderpass and the pipelines would have to be rebuilt */
+            throw std::runtime_error("Swapchain format changed on recreation");
+        }
+
+        VkDevice device = _device;
+        _deletion_queue.Push([=] {
+            for (auto framebuffer : old_framebuffers) {
+                vkDestroyFramebuffer(device, framebuffer, Backend::HostCallbacks());
+            }
+            for (auto img_view : old_img_views) {
+                vkDestroyImageView(device, img_view, Backend::HostCallbacks());
+            }
+        });
+        /* Presents queued on the old swapchain are done once the frames in flight have
+         * cycled on the new one. Uploads only happen at init, so the next submissions
+         * are frames (the device is idle when the queue is flushed at shutdown) */
+        _deletion_queue.Push(
+            [=] { vkDestroySwapchainKHR(device, old_swapchain, Backend::HostCallbacks()); },
+            _graphics_timeline.LastSubmitted() + MAX_FRAMES_IN_FLIGHT);
+        _deletion_queue.PushImage(_device, old_depth_image, old_depth_view,
+                                  old_depth_memory);
+
+        _CreateImageViews();
+        _CreateDepthResources();
+        _CreateFrameBuffers();
+
+        /* The uniforms are per swapchain image */
+        if (_swapchain_images.size() != old_image_count) {
+            for (size_t i = 0; i < old_image_count; i++) {
+                _deletion_queue.PushBuffer(_device, _uniform_buffers[i],
+                                           _uniform_buffers_memory[i]);
+                _deletion_queue.PushBuffer(_device, _uniform_buffers_cubemap[i],
+                                           _uniform_buffers_cubemap_memory[i]);
+            }
+            _CreateUniformBuffers();
+            /* The old sets stay in the allocator's pools until it is destroyed */
+            _AllocateDescriptorSets();
+        }
+
+        /* The buckets set the viewport and may see a recycled framebuffer handle */
+        _command_recorder.Invalidate();
+        if (_capture) {
+            /* Waits for the copies in flight only, the buffers are sized for the extent */
+            _readback.Destroy();
+            _CreateReadback();
+        }
+        std::cout << "Swapchain recreated: " << _swapchain_extent.width << "x"
+                  << _swapchain_extent.height << std::endl;
+    }
+
+    /*
+     * Switch the pacing at runtime : the present mode goes through a swapchain
+     * recreation, the frames in flight apply from the next frame
+     */
+    void _ApplyPacingProfile(Backend::PacingProfile profile) {
+        _pacing = Backend::GetPacingConfig(profile, MAX_FRAMES_IN_FLIGHT);
+        _frames.SetFramesInFlight(_pacing.FramesInFlight);
+        std::cout << "Pacing:" << Backend::PacingProfileName(_pacing.Profile) << std::endl;
+        _RecreateSwapChain();
+    }
+
     VkSurfaceFormatKHR
     _ChooseSwapSurfaceFormat(const std::vector<VkSurfaceFormatKHR>& available_formats) {
         if (available_formats.size() == 1 &&
@@ -680,23 +1262,16 @@ class Application {
         return available_formats[0];
     }
 
-    VkPresentModeKHR
-    _ChooseSwapPresentModel(const std::vector<VkPresentModeKHR> available_present_modes) {
-        for (const auto& available_present_mode : available_present_modes) {
-            if (available_present_mode == VK_PRESENT_MODE_MAILBOX_KHR) {
-                return VK_PRESENT_MODE_MAILBOX_KHR;
-            }
-        }
-        return VK_PRESENT_MODE_FIFO_KHR;
-    }
-
     VkExtent2D _ChooseSwapExtent(const VkSurfaceCapabilitiesKHR& capabilities) {
         /* If currentExtent.width = max of uint32_t, the resolution of the swap
          * chain has no limit */
         if (capabilities.currentExtent.width != std::numeric_limits<uint32_t>::max()) {
             return capabilities.currentExtent;
         } else {
-            VkExtent2D actual_extent = {WIDTH, HEIGHT};
+            int width, height;
+            glfwGetFramebufferSize(_window, &width, &height);
+            VkExtent2D actual_extent = {static_cast<uint32_t>(width),
+                                        static_cast<uint32_t>(height)};
 
             actual_extent.width = std::max(
                 capabilities.minImageExtent.width,
@@ -726,7 +1301,9 @@ class Application {
         color_attachment.stencilLoadOp           = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
         color_attachment.stencilStoreOp          = VK_ATTACHMENT_STORE_OP_DONT_CARE;
         color_attachment.initialLayout           = VK_IMAGE_LAYOUT_UNDEFINED;
-        color_attachment.finalLayout             = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+        /* Headless : left ready to be copied out */
+        color_attachment.finalLayout = _headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                                                 : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
         VkAttachmentReference color_attachment_ref = {};
         color_attachment_ref.attachment            = 0; /* Index of the attachment. */
@@ -773,33 +1350,79 @@ class Application {
         renderpass_info.dependencyCount = 1;
         renderpass_info.pDependencies   = &dependency;
 
-        if (vkCreateRenderPass(_device, &renderpass_info, nullptr, &_renderpass) !=
+        if (vkCreateRenderPass(_device, &renderpass_info,
+                               Backend::HostCallbacks(), &_renderpass) !=
             VK_SUCCESS) {
             throw std::runtime_error("Failed to create RenderPass");
         }
     }
 
-    void _CreateGraphisPipeline() {
-        auto bl           = ReadFile("./Shaders/shader.vert");
+    void _CreatePipelineLayout() {
+        /* set = 0 : per image uniforms, set = 1 : bindless textures */
+        std::array<VkDescriptorSetLayout, 2> set_layouts = {_descriptor_set_layout,
+                                                            _bindless_textures.Layout};
+
+        VkPushConstantRange material_range = {};
+        material_range.stageFlags          = VK_SHADER_STAGE_FRAGMENT_BIT;
+        material_range.offset              = 0;
+        material_range.size                = sizeof(Backend::MaterialPushConstants);
+
+        VkPipelineLayoutCreateInfo pipeline_layout_info = {};
+        pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+        pipeline_layout_info.setLayoutCount         = _bindless ? 2 : 1;
+        pipeline_layout_info.pSetLayouts            = set_layouts.data();
+        pipeline_layout_info.pushConstantRangeCount = _bindless ? 1 : 0;
+        pipeline_layout_info.pPushConstantRanges    = _bindless ? &material_range : nullptr;
+
+        if (vkCreatePipelineLayout(_device, &pipeline_layout_info, Backend::HostCallbacks(),
+                                   &_pipeline_layout) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create pipeline layout");
+        }
+    }
+
+    /*
+     * Load the shader modules once, the pipelines of the variants are only compiled
+     * when a material needs them.
+     */
+    void _CreateShaderVariants() {
+        CPU_FUNCTION();
         auto vert_shdcode = ReadFile("./Shaders/vert.spv");
-        auto frag_shdcode = ReadFile("./Shaders/frag.spv");
+        auto frag_shdcode =
+            ReadFile(_bindless ? "./Shaders/frag_bindless.spv" : "./Shaders/frag.spv");
 
-        VkShaderModule vertex_module   = _CreateShaderModule(vert_shdcode);
-        VkShaderModule fragment_module = _CreateShaderModule(frag_shdcode);
+        uint32_t spirv_passes =
+            Backend::GetSpirvPasses(glb_shader_optimization, glb_strip_shader_debug_info);
+        Backend::OptimizeSpirv("vert.spv", vert_shdcode, spirv_passes);
+        Backend::OptimizeSpirv("frag.spv", frag_shdcode, spirv_passes);
+
+        _vertex_module   = _CreateShaderModule(vert_shdcode);
+        _fragment_module = _CreateShaderModule(frag_shdcode);
 
         std::cout << vert_shdcode.size() << std::endl << frag_shdcode.size() << std::endl;
 
+        _shader_variants.Init(_device,
+                              [this](const VkSpecializationInfo& frag_specialization) {
+                                  return _CreateGraphisPipeline(frag_specialization);
+                              });
+
+        /* The chalet : default toon material */
+        _graphics_pipeline = _shader_variants.Get(Backend::SelectVariant(_material));
+        std::cout << "ShaderVariants:" << _shader_variants.VariantCount() << std::endl;
+    }
+
+    VkPipeline _CreateGraphisPipeline(const VkSpecializationInfo& frag_specialization) {
         VkPipelineShaderStageCreateInfo vertex_stage_info = {};
         vertex_stage_info.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
         vertex_stage_info.stage  = VK_SHADER_STAGE_VERTEX_BIT;
-        vertex_stage_info.module = vertex_module;
+        vertex_stage_info.module = _vertex_module;
         vertex_stage_info.pName  = "main";
 
         VkPipelineShaderStageCreateInfo fragment_stage_info = {};
         fragment_stage_info.sType  = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
         fragment_stage_info.stage  = VK_SHADER_STAGE_FRAGMENT_BIT;
-        fragment_stage_info.module = fragment_module;
+        fragment_stage_info.module = _fragment_module;
         fragment_stage_info.pName  = "main";
+        fragment_stage_info.pSpecializationInfo = &frag_specialization;
 
         VkPipelineShaderStageCreateInfo shader_stages_info[] = {vertex_stage_info,
                                                                 fragment_stage_info};
@@ -900,17 +1523,14 @@ class Application {
         color_blending_info.blendConstants[2] = 0.0f; /* Optional */
         color_blending_info.blendConstants[3] = 0.0f; /* Optional */
 
-        VkPipelineLayoutCreateInfo pipeline_layout_info = {};
-        pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-        pipeline_layout_info.setLayoutCount         = 1;
-        pipeline_layout_info.pSetLayouts            = &_descriptor_set_layout;
-        pipeline_layout_info.pushConstantRangeCount = 0;
-        pipeline_layout_info.pPushConstantRanges    = nullptr;
+        /* Set by the command buffers, the pipelines survive a swapchain recreation */
+        VkDynamicState dynamic_states[] = {VK_DYNAMIC_STATE_VIEWPORT,
+                                           VK_DYNAMIC_STATE_SCISSOR};
 
-        if (vkCreatePipelineLayout(_device, &pipeline_layout_info, nullptr,
-                                   &_pipeline_layout) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to create pipeline layout");
-        }
+        VkPipelineDynamicStateCreateInfo dynamic_state_info = {};
+        dynamic_state_info.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+        dynamic_state_info.dynamicStateCount = 2;
+        dynamic_state_info.pDynamicStates    = dynamic_states;
 
         VkGraphicsPipelineCreateInfo pipeline_info = {};
         pipeline_info.sType             = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
@@ -923,20 +1543,20 @@ class Application {
         pipeline_info.pMultisampleState   = &multisampling_info;
         pipeline_info.pDepthStencilState  = &depth_stencil_info;
         pipeline_info.pColorBlendState    = &color_blending_info;
-        pipeline_info.pDynamicState       = nullptr;
+        pipeline_info.pDynamicState       = &dynamic_state_info;
         pipeline_info.layout              = _pipeline_layout;
         pipeline_info.renderPass          = _renderpass;
         pipeline_info.subpass             = 0;
         pipeline_info.basePipelineHandle  = VK_NULL_HANDLE; /* Optional */
         pipeline_info.basePipelineIndex   = -1;             /* Optional */
 
-        if (vkCreateGraphicsPipelines(_device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr,
-                                      &_graphics_pipeline) != VK_SUCCESS) {
+        VkPipeline pipeline;
+        if (vkCreateGraphicsPipelines(_device, VK_NULL_HANDLE, 1, &pipeline_info,
+                                      Backend::HostCallbacks(),
+                                      &pipeline) != VK_SUCCESS) {
             throw std::runtime_error("Failed to create GraphicsPipeline");
         }
-
-        vkDestroyShaderModule(_device, vertex_module, nullptr);
-        vkDestroyShaderModule(_device, fragment_module, nullptr);
+        return pipeline;
     }
 
     VkShaderModule _CreateShaderModule(const std::vector<char>& code) {
@@ -946,7 +1566,8 @@ class Application {
         create_info.pCode    = reinterpret_cast<const uint32_t*>(code.data());
 
         VkShaderModule shader_module;
-        if (vkCreateShaderModule(_device, &create_info, nullptr, &shader_module) !=
+        if (vkCreateShaderModule(_device, &create_info,
+                                 Backend::HostCallbacks(), &shader_module) !=
             VK_SUCCESS) {
             throw std::runtime_error("Failed to create shader module");
         }
@@ -954,6 +1575,7 @@ class Application {
     }
 
     void _CreateFrameBuffers() {
+        CPU_FUNCTION();
         _swapchain_framebuffers.resize(_swapchain_img_views.size());
 
         for (size_t i = 0; i < _swapchain_img_views.size(); i++) {
@@ -969,7 +1591,7 @@ class Application {
             framebuffer_info.height          = _swapchain_extent.height;
             framebuffer_info.layers          = 1;
 
-            if (vkCreateFramebuffer(_device, &framebuffer_info, nullptr,
+            if (vkCreateFramebuffer(_device, &framebuffer_info, Backend::HostCallbacks(),
                                     &_swapchain_framebuffers[i]) != VK_SUCCESS) {
                 throw std::runtime_error("Failed to create Framebuffer");
             }
@@ -981,104 +1603,203 @@ class Application {
         VkCommandPoolCreateInfo pool_info        = {};
         pool_info.sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
         pool_info.queueFamilyIndex = qufamily_indices.graphics_family.value();
-        pool_info.flags            = 0; /* Optional */
+        pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT; /* Single time commands */
 
-        if (vkCreateCommandPool(_device, &pool_info, nullptr, &_command_pool) !=
+        if (vkCreateCommandPool(_device, &pool_info,
+                                Backend::HostCallbacks(), &_command_pool) !=
             VK_SUCCESS) {
             throw std::runtime_error("Failed to create CommandPool");
         }
     }
 
+    /*
+     * Per thread, per frame command pools. The draw list is recorded in secondary
+     * command buffers by buckets, a bucket is re-recorded only when it changed.
+     */
     void _CreateCommandBuffers() {
-        _command_buffers.resize(_swapchain_framebuffers.size());
-        for (size_t i = 0; i < _swapchain_framebuffers.size(); i++) {
-            VkCommandBufferAllocateInfo alloc_info = {};
-            alloc_info.sType       = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-            alloc_info.commandPool = _command_pool;
-            alloc_info.level       = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-            alloc_info.commandBufferCount = (uint32_t)_command_buffers.size();
-
-            if (vkAllocateCommandBuffers(_device, &alloc_info, _command_buffers.data()) !=
-                VK_SUCCESS) {
-                throw std::runtime_error("Failed to allocate CommandBuffers");
-            }
+        CPU_FUNCTION();
+        QueueFamilyIndices qufamily_indices = _FindQueueFamilies(_physical_dev);
+        _command_recorder.Init(_device, qufamily_indices.graphics_family.value(),
+                               MAX_FRAMES_IN_FLIGHT, _jobs);
+        if (_pipeline_stats.Enabled()) {
+            _command_recorder.SetInheritedStatistics(Backend::PipelineStatistics::Flags());
         }
+    }
 
-        for (size_t i = 0; i < _command_buffers.size(); i++) {
-            VkCommandBufferBeginInfo begin_info = {};
-            begin_info.sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-            begin_info.flags            = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
-            begin_info.pInheritanceInfo = nullptr; /* Optional */
+    void _BuildDrawList() {
+        uint32_t triangle_count = static_cast<uint32_t>(_indices.size() / 3);
+        uint32_t draw_count = std::max(1u, std::min(_benchmark.DrawCount, triangle_count));
 
-            if (vkBeginCommandBuffer(_command_buffers[i], &begin_info) != VK_SUCCESS) {
-                throw std::runtime_error("Failed to begin recording CommandBuffer");
-            }
+        _draws.clear();
+        for (uint32_t i = 0; i < draw_count; i++) {
+            uint32_t first_triangle = triangle_count * i / draw_count;
+            uint32_t last_triangle  = triangle_count * (i + 1) / draw_count;
 
-            VkRenderPassBeginInfo renderpass_info = {};
-            renderpass_info.sType             = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-            renderpass_info.renderPass        = _renderpass;
-            renderpass_info.framebuffer       = _swapchain_framebuffers[i];
-            renderpass_info.renderArea.offset = {0, 0};
-            renderpass_info.renderArea.extent = _swapchain_extent;
-            std::array<VkClearValue, 2> clear_values = {};
-            clear_values[0].color                    = {0.26f, 0.23f, 0.31f, 1.0f};
-            clear_values[1].depthStencil             = {1, 0};
-            renderpass_info.clearValueCount = static_cast<uint32_t>(clear_values.size());
-            renderpass_info.pClearValues    = clear_values.data();
-
-            vkCmdBeginRenderPass(_command_buffers[i], &renderpass_info,
-                                 VK_SUBPASS_CONTENTS_INLINE);
-            vkCmdBindPipeline(_command_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-                              _graphics_pipeline);
+            DrawItem draw     = {};
+            draw.FirstIndex   = first_triangle * 3;
+            draw.IndexCount   = (last_triangle - first_triangle) * 3;
+            draw.TextureIndex = _texture_index;
+            _draws.push_back(draw);
+        }
+    }
+
+    /*
+     * Record the scene for a swapchain image, the frame's fence must be signaled
+     * @param command_buffer : Primary of the frame, in the recording state
+     */
+    void _RecordCommandBuffer(VkCommandBuffer command_buffer, uint32_t img_index) {
+        CPU_FUNCTION();
+        VkRenderPassBeginInfo renderpass_info = {};
+        renderpass_info.sType                 = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+        renderpass_info.renderPass            = _renderpass;
+        renderpass_info.framebuffer           = _swapchain_framebuffers[img_index];
+        renderpass_info.renderArea.offset     = {0, 0};
+        renderpass_info.renderArea.extent     = _swapchain_extent;
+        std::array<VkClearValue, 2> clear_values = {};
+        clear_values[0].color                    = {0.26f, 0.23f, 0.31f, 1.0f};
+        clear_values[1].depthStencil             = {1, 0};
+        renderpass_info.clearValueCount = static_cast<uint32_t>(clear_values.size());
+        renderpass_info.pClearValues    = clear_values.data();
+
+        VkViewport viewport = {};
+        viewport.width      = (float)_swapchain_extent.width;
+        viewport.height     = (float)_swapchain_extent.height;
+        viewport.maxDepth   = 1.f;
+        VkRect2D scissor    = {{0, 0}, _swapchain_extent};
+
+        auto record_slice = [&](VkCommandBuffer secondary, size_t first, size_t last) {
+            vkCmdBindPipeline(secondary, VK_PIPELINE_BIND_POINT_GRAPHICS, _graphics_pipeline);
+            vkCmdSetViewport(secondary, 0, 1, &viewport);
+            vkCmdSetScissor(secondary, 0, 1, &scissor);
 
             VkBuffer     vertex_buffers[] = {_vertex_buffer};
             VkDeviceSize offsets[]        = {0};
-            vkCmdBindVertexBuffers(_command_buffers[i], 0, 1, vertex_buffers, offsets);
-            vkCmdBindIndexBuffer(_command_buffers[i], _index_buffer, 0,
-                                 VK_INDEX_TYPE_UINT32);
-            vkCmdBindDescriptorSets(_command_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-                                    _pipeline_layout, 0, 1, &_descriptor_sets[i], 0,
+            vkCmdBindVertexBuffers(secondary, 0, 1, vertex_buffers, offsets);
+            vkCmdBindIndexBuffer(secondary, _index_buffer, 0, VK_INDEX_TYPE_UINT32);
+            vkCmdBindDescriptorSets(secondary, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                    _pipeline_layout, 0, 1, &_descriptor_sets[img_index], 0,
                                     nullptr);
-            vkCmdDrawIndexed(_command_buffers[i], static_cast<uint32_t>(_indices.size()),
-                             1, 0, 0, 0);
+            if (_bindless) {
+                /* Bound once per slice, the draws only push the index of their texture */
+                vkCmdBindDescriptorSets(secondary, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                        _pipeline_layout, 1, 1, &_bindless_textures.Set, 0,
+                                        nullptr);
+            }
 
-            vkCmdEndRenderPass(_command_buffers[i]);
-            if (vkEndCommandBuffer(_command_buffers[i]) != VK_SUCCESS) {
-                throw std::runtime_error("Failed to record CommandBuffer");
+            for (size_t i = first; i < last; i++) {
+                const DrawItem& draw = _draws[i];
+                if (_bindless) {
+                    Backend::MaterialPushConstants material = {draw.TextureIndex};
+                    vkCmdPushConstants(secondary, _pipeline_layout,
+                                       VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(material),
+                                       &material);
+                }
+                vkCmdDrawIndexed(secondary, draw.IndexCount, 1, draw.FirstIndex, 0, 0);
             }
-        }
+        };
+
+        /* What the buckets bind besides the draws */
+        uint64_t context_key = Backend::HashCombine((uint64_t)_graphics_pipeline,
+                                                    (uint64_t)_descriptor_sets[img_index]);
+        context_key = Backend::HashCombine(context_key, (uint64_t)_bindless_textures.Set);
+        context_key = Backend::HashCombine(context_key, (uint64_t)_vertex_buffer);
+        context_key = Backend::HashCombine(context_key, (uint64_t)_index_buffer);
+        /* Viewport and scissor : a recreated framebuffer can reuse the old handle */
+        uint64_t extent = ((uint64_t)_swapchain_extent.width << 32) | _swapchain_extent.height;
+        context_key     = Backend::HashCombine(context_key, extent);
+
+        _command_recorder.RecordRenderPass(command_buffer, _frames.CurrentIndex(),
+                                           _frames.Current().Scratch, renderpass_info,
+                                           _draws, context_key, record_slice);
     }
 
     void _DrawFrame() {
-        vkWaitForFences(_device, 1, &_fences_inflight[_current_frame], VK_TRUE,
-                        std::numeric_limits<uint64_t>::max());
-        vkResetFences(_device, 1, &_fences_inflight[_current_frame]);
+        CPU_FUNCTION();
+        /* Counted until EndFrame(), a swapchain recreation isn't */
+        uint64_t heap_allocations = Backend::HeapCounter::ThreadAllocations();
+        _frame_stats.BeginFrame();
+        _jobs.RunMainThreadJobs();
+        /* Waits the frame's last submit and recycles its command buffers */
+        _frame_stats.BeginWait();
+        Backend::FrameContext& frame = _frames.BeginFrame();
+        _frame_stats.EndWait();
+        _deletion_queue.Drain();
+        _latency.Update(_graphics_timeline);
+        if (_capture) {
+            _readback.Poll();
+        }
 
         uint32_t img_index;
-        vkAcquireNextImageKHR(_device, _swapchain, std::numeric_limits<uint64_t>::max(),
-                              _semaphores_img_available[_current_frame], VK_NULL_HANDLE,
-                              &img_index);
-
-        VkSemaphore wait_semaphores[]      = {_semaphores_img_available[_current_frame]};
-        VkPipelineStageFlags wait_stages[] = {
-            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-        VkSemaphore signal_semaphores[] = {_semaphores_render_finished[_current_frame]};
+        VkResult result = VK_SUCCESS;
+        if (_headless) {
+            /* The offscreen image of the frame slot is free once BeginFrame() returned */
+            img_index = _frames.CurrentIndex();
+        } else {
+            {
+                CPU_SCOPE("vkAcquireNextImageKHR");
+                result = vkAcquireNextImageKHR(_device, _swapchain,
+                                               std::numeric_limits<uint64_t>::max(),
+                                               frame.ImageAvailable, VK_NULL_HANDLE,
+                                               &img_index);
+            }
+            if (result == VK_ERROR_OUT_OF_DATE_KHR) {
+                /* ImageAvailable wasn't signaled, the frame slot is reused as is */
+                _RecreateSwapChain();
+                return;
+            } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+                throw std::runtime_error("Failed to acquire swapchain image");
+            }
 
-        _UpdateUniformBuffers(img_index);
+            if (_pacing.LateInput) {
+                /* The waits are behind us, the frame is recorded from the freshest input */
+                glfwPollEvents();
+                _latency.OnInputSampled();
+            }
+        }
 
-        VkSubmitInfo submit_info         = {};
-        submit_info.sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submit_info.waitSemaphoreCount   = 1;
-        submit_info.pWaitSemaphores      = wait_semaphores;
-        submit_info.pWaitDstStageMask    = wait_stages;
-        submit_info.commandBufferCount   = 1;
-        submit_info.pCommandBuffers      = &_command_buffers[img_index];
-        submit_info.signalSemaphoreCount = 1;
-        submit_info.pSignalSemaphores    = signal_semaphores;
+        VkSemaphore signal_semaphores[] = {frame.RenderFinished};
 
-        if (vkQueueSubmit(_graphics_queue, 1, &submit_info,
-                          _fences_inflight[_current_frame]) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to submit DrawCommandBuffer");
+        _UpdateUniformBuffers(img_index);
+        VkCommandBuffer command_buffer = _frames.BeginCommandBuffer();
+        _gpu_profiler.BeginFrame(command_buffer, _frames.CurrentIndex());
+        _pipeline_stats.BeginFrame(command_buffer, _frames.CurrentIndex());
+        {
+            Backend::GpuScope scope(_gpu_profiler, command_buffer, "scene");
+            uint32_t          pass = _pipeline_stats.BeginPass(command_buffer, "scene");
+            _RecordCommandBuffer(command_buffer, img_index);
+            _pipeline_stats.EndPass(command_buffer, pass);
+        }
+        if (_capture) {
+            Backend::GpuScope scope(_gpu_profiler, command_buffer, "readback");
+            _readback.RecordCopy(command_buffer, _swapchain_images[img_index],
+                                 _headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL
+                                           : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+                                 _frame_number);
+        }
+        if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to record CommandBuffer");
+        }
+
+        /* Frame N is done when the graphics timeline reaches SubmitValue */
+        if (_headless) {
+            /* No acquire to wait for, no present to signal */
+            frame.SubmitValue = _graphics_timeline.Submit(1, &command_buffer);
+        } else {
+            frame.SubmitValue = _graphics_timeline.Submit(
+                1, &command_buffer, frame.ImageAvailable,
+                VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, frame.RenderFinished);
+        }
+        if (_capture) {
+            _readback.OnSubmitted(frame.SubmitValue);
+        }
+        if (_headless) {
+            _frame_stats.OnPresented();
+            _frame_heap_allocations +=
+                Backend::HeapCounter::ThreadAllocations() - heap_allocations;
+            _frames.EndFrame();
+            _frame_stats.EndFrame();
+            _frame_number++;
+            return;
         }
 
         VkPresentInfoKHR present_info   = {};
@@ -1092,46 +1813,81 @@ class Application {
         present_info.pImageIndices  = &img_index;
         present_info.pResults       = nullptr; /* Optional */
 
-        vkQueuePresentKHR(_present_queue, &present_info);
-
-        _current_frame = (_current_frame + 1) % MAX_FRAMES_IN_FLIGHT;
-    }
+        {
+            CPU_SCOPE("vkQueuePresentKHR");
+            result = vkQueuePresentKHR(_present_queue, &present_info);
+        }
+        _latency.OnPresented(_frames.CurrentIndex(), frame.SubmitValue);
+        _frame_stats.OnPresented();
+        _frame_heap_allocations +=
+            Backend::HeapCounter::ThreadAllocations() - heap_allocations;
 
-    void _CreateSyncObjects() {
-        _semaphores_img_available.resize(MAX_FRAMES_IN_FLIGHT);
-        _semaphores_render_finished.resize(MAX_FRAMES_IN_FLIGHT);
-        _fences_inflight.resize(MAX_FRAMES_IN_FLIGHT);
+        _frames.EndFrame();
+        _frame_stats.EndFrame();
+        _frame_number++;
 
-        VkSemaphoreCreateInfo semaphore_info = {};
-        semaphore_info.sType                 = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR ||
+            _framebuffer_resized) {
+            _framebuffer_resized = false;
+            _RecreateSwapChain();
+        } else if (result != VK_SUCCESS) {
+            throw std::runtime_error("Failed to present swapchain image");
+        }
+    }
 
-        VkFenceCreateInfo fence_info = {};
-        fence_info.sType             = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-        fence_info.flags             = VK_FENCE_CREATE_SIGNALED_BIT;
+    /*
+     * Ring of readback buffers, two more than the frames in flight so the writes can
+     * lag behind without dropping frames
+     */
+    void _CreateReadback() {
+        if (_capture) {
+            _readback.Init(_physical_dev, _device, _graphics_timeline, _swapchain_img_format,
+                           _swapchain_extent, MAX_FRAMES_IN_FLIGHT + 2, _capture_prefix,
+                           _capture_format, &_memory_tracker);
+        }
+    }
 
-        for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-            if (vkCreateSemaphore(_device, &semaphore_info, nullptr,
-                                  &_semaphores_img_available[i]) != VK_SUCCESS ||
-                vkCreateSemaphore(_device, &semaphore_info, nullptr,
-                                  &_semaphores_render_finished[i]) != VK_SUCCESS) {
+    /*
+     * Semaphores and transient command pool of every frame in flight
+     */
+    void _CreateSyncObjects() {
+        CPU_FUNCTION();
+        QueueFamilyIndices qufamily_indices = _FindQueueFamilies(_physical_dev);
+        _frames.Init(_device, qufamily_indices.graphics_family.value(), _graphics_timeline,
+                     MAX_FRAMES_IN_FLIGHT);
+        _frames.SetFramesInFlight(_pacing.FramesInFlight);
+        _latency.Init(MAX_FRAMES_IN_FLIGHT);
+    }
 
-                throw std::runtime_error("Failed to create Semaphores");
-            }
-            if (vkCreateFence(_device, &fence_info, nullptr, &_fences_inflight[i]) !=
-                VK_SUCCESS) {
-                throw std::runtime_error("Failed to create Fences");
-            }
-        }
+    /*
+     * Main thread jobs run at the start of every frame (GLFW calls from the workers go
+     * through SubmitMain())
+     */
+    void _InitJobs() {
+        uint32_t thread_count = glb_job_threads;
+        if (const char* job_threads = std::getenv("VT_JOB_THREADS")) {
+            thread_count = static_cast<uint32_t>(std::strtoul(job_threads, nullptr, 10));
+        }
+        if (const char* bench_jobs = std::getenv("VT_BENCH_JOBS")) {
+            Backend::BenchmarkJobSystem(
+                static_cast<uint32_t>(std::strtoul(bench_jobs, nullptr, 10)));
+        } else if (glb_benchmark_jobs) {
+            Backend::BenchmarkJobSystem(thread_count);
+        }
+        _jobs.Init(thread_count);
+        std::cout << "Job threads:" << _jobs.ThreadCount() << std::endl;
     }
 
+    /* Runs on a job thread : touches _vertices and _indices only */
     void _LoadModel() {
+        CPU_FUNCTION();
         tinyobj::attrib_t                attrib;
         std::vector<tinyobj::shape_t>    shapes;
         std::vector<tinyobj::material_t> materials;
         std::string                      warn, err;
 
         if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err,
-                              "./Models/chalet.obj")) {
+                              _benchmark.ModelPath.c_str())) {
             throw std::runtime_error(warn + err);
         }
 
@@ -1154,6 +1910,7 @@ class Application {
     }
 
     void _CreateVertexBuffer() {
+        CPU_FUNCTION();
         VkDeviceSize buffer_size = sizeof(_vertices[0]) * _vertices.size();
 
         VkBuffer       staging_buffer;
@@ -1161,7 +1918,8 @@ class Application {
         _CreateBuffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
                           VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                      staging_buffer, staging_buffer_memory);
+                      staging_buffer, staging_buffer_memory,
+                      Backend::MemoryCategory::Staging, "vertex staging");
 
         void* data;
         vkMapMemory(_device, staging_buffer_memory, 0, buffer_size, 0, &data);
@@ -1171,15 +1929,16 @@ class Application {
         _CreateBuffer(
             buffer_size,
             VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _vertex_buffer, _vertex_buffer_memory);
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _vertex_buffer, _vertex_buffer_memory,
+            Backend::MemoryCategory::Vertex, _benchmark.ModelPath + " vertices");
 
         _CopyBuffer(staging_buffer, _vertex_buffer, buffer_size);
 
-        vkDestroyBuffer(_device, staging_buffer, nullptr);
-        vkFreeMemory(_device, staging_buffer_memory, nullptr);
+        _deletion_queue.PushBuffer(_device, staging_buffer, staging_buffer_memory);
     }
 
     void _CreateIndexBuffer() {
+        CPU_FUNCTION();
         VkDeviceSize buffer_size = sizeof(_indices[0]) * _indices.size();
 
         VkBuffer       staging_buffer;
@@ -1187,7 +1946,8 @@ class Application {
         _CreateBuffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
                           VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                      staging_buffer, staging_buffer_memory);
+                      staging_buffer, staging_buffer_memory,
+                      Backend::MemoryCategory::Staging, "index staging");
 
         void* data;
         vkMapMemory(_device, staging_buffer_memory, 0, buffer_size, 0, &data);
@@ -1197,16 +1957,20 @@ class Application {
         _CreateBuffer(buffer_size,
                       VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
                       VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _index_buffer,
-                      _index_buffer_memory);
+                      _index_buffer_memory, Backend::MemoryCategory::Index,
+                      _benchmark.ModelPath + " indices");
         _CopyBuffer(staging_buffer, _index_buffer, buffer_size);
 
-        vkDestroyBuffer(_device, staging_buffer, nullptr);
-        vkFreeMemory(_device, staging_buffer_memory, nullptr);
+        _deletion_queue.PushBuffer(_device, staging_buffer, staging_buffer_memory);
     }
 
+    /*
+     * @param category, name : Accounting of the memory (MemoryTracker)
+     */
     void _CreateBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
                        VkMemoryPropertyFlags properties, VkBuffer& buffer,
-                       VkDeviceMemory& buffer_mem) {
+                       VkDeviceMemory& buffer_mem, Backend::MemoryCategory category,
+                       const std::string& name) {
 
         VkBufferCreateInfo buffer_info = {};
         buffer_info.sType              = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
@@ -1214,7 +1978,8 @@ class Application {
         buffer_info.usage              = usage;
         buffer_info.sharingMode        = VK_SHARING_MODE_EXCLUSIVE;
 
-        if (vkCreateBuffer(_device, &buffer_info, nullptr, &buffer) != VK_SUCCESS) {
+        if (vkCreateBuffer(_device, &buffer_info, Backend::HostCallbacks(), &buffer) !=
+            VK_SUCCESS) {
             throw std::runtime_error("Failed to create Buffer");
         }
 
@@ -1227,7 +1992,8 @@ class Application {
         alloc_info.memoryTypeIndex =
             _FindMemoryType(mem_requirement.memoryTypeBits, properties);
 
-        if (vkAllocateMemory(_device, &alloc_info, nullptr, &buffer_mem) != VK_SUCCESS) {
+        if (_memory_tracker.Allocate(alloc_info, buffer_mem, category, name) !=
+            VK_SUCCESS) {
             throw std::runtime_error("Failed to allocate Buffer memory");
         }
 
@@ -1294,40 +2060,70 @@ class Application {
     }
 
     void _CreateUniformBuffers() {
+        CPU_FUNCTION();
         VkDeviceSize buffer_size = sizeof(UniformBufferObject);
 
         _uniform_buffers.resize(_swapchain_images.size());
         _uniform_buffers_memory.resize(_swapchain_images.size());
         _uniform_buffers_cubemap.resize(_swapchain_images.size());
         _uniform_buffers_cubemap_memory.resize(_swapchain_images.size());
+        _uniform_transform_updates.assign(_swapchain_images.size(), 0);
 
         for (size_t i = 0; i < _swapchain_images.size(); i++) {
             _CreateBuffer(buffer_size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
                           VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
                               VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                          _uniform_buffers[i], _uniform_buffers_memory[i]);
+                          _uniform_buffers[i], _uniform_buffers_memory[i],
+                          Backend::MemoryCategory::Uniform,
+                          "uniforms " + std::to_string(i));
 
             _CreateBuffer(
                 buffer_size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
-                _uniform_buffers_cubemap[i], _uniform_buffers_cubemap_memory[i]);
+                _uniform_buffers_cubemap[i], _uniform_buffers_cubemap_memory[i],
+                Backend::MemoryCategory::Uniform, "cubemap uniforms " + std::to_string(i));
         }
     }
 
+    /*
+     * Scene hierarchy : the model is its only object for now
+     */
+    void _CreateTransforms() {
+        _model_transform = _transforms.Add();
+        if (glb_benchmark_transforms) {
+            Backend::BenchmarkTransforms();
+        }
+    }
+
+    /*
+     * Seconds since the first frame. Headless frames advance a fixed step (1/60s unless
+     * benchmarking), so a frame number always renders the same image (regression tests).
+     */
+    double _AnimationTime() {
+        if (_headless) {
+            return _frame_number * _benchmark.TimeStep;
+        }
+        static double start_time = glfwGetTime();
+        return glfwGetTime() - start_time;
+    }
+
     void _UpdateUniformBuffers(uint32_t current_img) {
-        static auto start_time   = glfwGetTime();
-        auto        current_time = glfwGetTime();
-        float       dtime        = current_time - start_time;
+        CPU_FUNCTION();
+        float dtime = _AnimationTime();
 
         UniformBufferObject ubo = {};
 
-        ubo.model = glm::rotate(glm::mat4(1.f), dtime * glm::radians(45.f),
-                                glm::vec3(0.f, 0.f, 1.f));
+        /* 45 degrees per second around Z */
+        float angle = dtime * glm::radians(45.f);
+        _transforms.SetRotation(_model_transform, 0.f, 0.f, std::sin(angle * 0.5f),
+                                std::cos(angle * 0.5f));
+        _transforms.Update();
 
         // ubo.model =
         //     glm::rotate(glm::mat4(1.f), glm::radians(230.f), glm::vec3(0.f, 0.f, 1.f));
-        ubo.view = glm::lookAt(glm::vec3(2.0f, 2.5f, 2.2f), glm::vec3(0.0f, 0.0f, 0.0f),
-                               glm::vec3(0.0f, 0.0f, 1.0f));
+        /* Static unless benchmarking a camera path */
+        Backend::CameraPose camera = Backend::EvaluateCameraPath(_benchmark.Camera, dtime);
+        ubo.view                   = glm::lookAt(camera.Eye, camera.Target, camera.Up);
         ubo.proj = glm::perspective(
             glm::radians(45.0f),
             _swapchain_extent.width / (float)_swapchain_extent.height, 0.1f, 10.0f);
@@ -1336,7 +2132,12 @@ class Application {
         void* data;
         vkMapMemory(_device, _uniform_buffers_memory[current_img], 0, sizeof(ubo), 0,
                     &data);
-        memcpy(data, &ubo, sizeof(ubo));
+        UniformBufferObject* mapped = static_cast<UniformBufferObject*>(data);
+        mapped->view                = ubo.view;
+        mapped->proj                = ubo.proj;
+        /* Only the model matrices that moved since this buffer was last written */
+        _transforms.WriteChanged(&mapped->model, sizeof(UniformBufferObject),
+                                 _uniform_transform_updates[current_img]);
         vkUnmapMemory(_device, _uniform_buffers_memory[current_img]);
 
         /* CUBEMAP */
@@ -1344,6 +2145,8 @@ class Application {
     }
 
     void _CreateDescriptorSetLayout() {
+        _descriptor_layout_cache.Init(_device);
+
         VkDescriptorSetLayoutBinding ubo_layout_binding = {};
         ubo_layout_binding.binding                      = 0;
         ubo_layout_binding.descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
@@ -1356,61 +2159,68 @@ class Application {
         sampler_layout_binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
         sampler_layout_binding.stageFlags     = VK_SHADER_STAGE_FRAGMENT_BIT;
 
-        std::array<VkDescriptorSetLayoutBinding, 2> bindings = {ubo_layout_binding,
-                                                                sampler_layout_binding};
-
-        VkDescriptorSetLayoutCreateInfo layout_info = {};
-        layout_info.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
-        layout_info.pBindings    = bindings.data();
-
-        if (vkCreateDescriptorSetLayout(_device, &layout_info, nullptr,
-                                        &_descriptor_set_layout) != VK_SUCCESS) {
-            throw std::runtime_error("Failed to create descriptor set layout");
-        }
-    }
-
-    void _CreateDescriptorPool() {
-        std::array<VkDescriptorPoolSize, 2> pool_size = {};
-        /* MVC matrix */
-        pool_size[0].type            = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        pool_size[0].descriptorCount = static_cast<uint32_t>(_swapchain_images.size());
-        /* Obj Texture */
-        pool_size[1].type            = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        pool_size[1].descriptorCount = static_cast<uint32_t>(_swapchain_images.size());
-        /* Cubemap */
-        // pool_size[2].type            = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        // pool_size[2].descriptorCount = static_cast<uint32_t>(_swapchain_images.size());
-        // pool_size[3].type            = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        // pool_size[3].descriptorCount = static_cast<uint32_t>(_swapchain_images.size());
-
-        VkDescriptorPoolCreateInfo pool_info = {};
-        pool_info.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-        pool_info.poolSizeCount = static_cast<uint32_t>(pool_size.size());
-        pool_info.pPoolSizes    = pool_size.data();
-        pool_info.maxSets       = static_cast<uint32_t>(_swapchain_images.size());
-
-        if (vkCreateDescriptorPool(_device, &pool_info, nullptr, &_descriptor_pool) !=
-            VK_SUCCESS) {
-            throw std::runtime_error("Failed to create descriptor pool");
+        _descriptor_set_layout =
+            _descriptor_layout_cache.CreateLayout({ubo_layout_binding, sampler_layout_binding});
+
+        if (_bindless) {
+            _bindless_textures.Init(_device, _physical_dev, _descriptor_layout_cache);
         }
+
+        /* Cubemap : same bindings, the cache returns the same layout */
+        _skybox_set_layout =
+            _descriptor_layout_cache.CreateLayout({ubo_layout_binding, sampler_layout_binding});
+    }
+
+    /*
+     * The pools are chained on demand, no need to size them for the scene
+     */
+    void _CreateDescriptorAllocator() {
+        _descriptor_allocator.Init(_device, 256, &_descriptor_layout_cache);
     }
 
     void _CreateDescriptorSets() {
-        std::vector<VkDescriptorSetLayout> layouts(_swapchain_images.size(),
-                                                   _descriptor_set_layout);
+        CPU_FUNCTION();
+        /* Both layouts are the same cached layout, one template covers them */
+        _descriptor_template.Init(_device, _physical_dev, _descriptor_set_layout,
+                                  _descriptor_layout_cache.GetBindings(_descriptor_set_layout));
+        _descriptor_writer.Init(_device);
 
-        VkDescriptorSetAllocateInfo alloc_info = {};
-        alloc_info.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-        alloc_info.descriptorPool     = _descriptor_pool;
-        alloc_info.descriptorSetCount = static_cast<uint32_t>(_swapchain_images.size());
-        alloc_info.pSetLayouts        = layouts.data();
+        _AllocateDescriptorSets();
 
-        _descriptor_sets.resize(_swapchain_images.size());
-        if (vkAllocateDescriptorSets(_device, &alloc_info, _descriptor_sets.data()) !=
-            VK_SUCCESS) {
-            throw std::runtime_error("Failed to allocate descriptor sets");
+        if (glb_benchmark_descriptor_writes) {
+            VkDescriptorImageInfo image_info = {};
+            image_info.imageLayout           = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            image_info.imageView             = _texture_img_view;
+            image_info.sampler               = _texture_sampler;
+
+            VkDescriptorBufferInfo buffer_info = {};
+            buffer_info.buffer                 = _uniform_buffers[0];
+            buffer_info.range                  = sizeof(UniformBufferObject);
+            Backend::BenchmarkDescriptorWrites(_device, _physical_dev,
+                                               _descriptor_layout_cache,
+                                               _descriptor_set_layout, buffer_info,
+                                               image_info);
         }
+    }
+
+    /*
+     * One set of each layout per swapchain image, pointing to its uniform buffers
+     */
+    void _AllocateDescriptorSets() {
+        _descriptor_allocator.Allocate(_descriptor_set_layout, _swapchain_images.size(),
+                                       _descriptor_sets);
+        _descriptor_allocator.Allocate(_skybox_set_layout, _swapchain_images.size(),
+                                       _descriptor_sets_skybox);
+
+        VkDescriptorImageInfo image_info = {};
+        image_info.imageLayout           = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        image_info.imageView             = _texture_img_view;
+        image_info.sampler               = _texture_sampler;
+
+        VkDescriptorImageInfo cubemap_image = {};
+        cubemap_image.imageLayout           = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        cubemap_image.imageView             = _cubemap_img_view;
+        cubemap_image.sampler               = _cubemap_sampler;
 
         for (size_t i = 0; i < _swapchain_images.size(); i++) {
             VkDescriptorBufferInfo buffer_info = {};
@@ -1418,69 +2228,30 @@ class Application {
             buffer_info.offset                 = 0;
             buffer_info.range                  = sizeof(UniformBufferObject);
 
-            VkDescriptorImageInfo image_info = {};
-            image_info.imageLayout           = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-            image_info.imageView             = _texture_img_view;
-            image_info.sampler               = _texture_sampler;
-
-            std::array<VkWriteDescriptorSet, 2> descriptor_write = {};
-            descriptor_write[0].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptor_write[0].dstSet          = _descriptor_sets[i];
-            descriptor_write[0].dstBinding      = 0;
-            descriptor_write[0].dstArrayElement = 0;
-            descriptor_write[0].descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            descriptor_write[0].descriptorCount = 1;
-            descriptor_write[0].pBufferInfo     = &buffer_info;
-
-            descriptor_write[1].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            descriptor_write[1].dstSet          = _descriptor_sets[i];
-            descriptor_write[1].dstBinding      = 1;
-            descriptor_write[1].dstArrayElement = 0;
-            descriptor_write[1].descriptorType =
-                VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            descriptor_write[1].descriptorCount = 1;
-            descriptor_write[1].pImageInfo      = &image_info;
+            _descriptor_writer.Begin(_descriptor_sets[i], _descriptor_template)
+                .WriteBuffer(0, buffer_info)
+                .WriteImage(1, image_info);
 
             /* ======== Cubemap ======== */
-            // VkDescriptorBufferInfo cubemap_buffer = {};
-            // buffer_info.buffer                    = _uniform_buffers_cubemap[i];
-            // buffer_info.offset                    = 0;
-            // buffer_info.range                     = sizeof(UniformBufferObject);
-
-            // VkDescriptorImageInfo cubemap_image = {};
-            // image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-            // image_info.imageView   = _cubemap_img_view;
-            // image_info.sampler     = _cubemap_sampler;
-
-            // descriptor_write[2].sType           =
-            // VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET; descriptor_write[2].dstSet =
-            // _descriptor_sets[i]; descriptor_write[2].dstBinding      = 2;
-            // descriptor_write[2].dstArrayElement = 0;
-            // descriptor_write[2].descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            // descriptor_write[2].descriptorCount = 1;
-            // descriptor_write[2].pBufferInfo     = &cubemap_buffer;
-
-            // descriptor_write[3].sType           =
-            // VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET; descriptor_write[3].dstSet =
-            // _descriptor_sets[i]; descriptor_write[3].dstBinding      = 3;
-            // descriptor_write[3].dstArrayElement = 0;
-            // descriptor_write[3].descriptorType =
-            //     VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            // descriptor_write[3].descriptorCount = 1;
-            // descriptor_write[3].pImageInfo      = &cubemap_image;
-
-            vkUpdateDescriptorSets(_device,
-                                   static_cast<uint32_t>(descriptor_write.size()),
-                                   descriptor_write.data(), 0, nullptr);
+            VkDescriptorBufferInfo cubemap_buffer = {};
+            cubemap_buffer.buffer                 = _uniform_buffers_cubemap[i];
+            cubemap_buffer.offset                 = 0;
+            cubemap_buffer.range                  = sizeof(UniformBufferObject);
+
+            _descriptor_writer.Begin(_descriptor_sets_skybox[i], _descriptor_template)
+                .WriteBuffer(0, cubemap_buffer)
+                .WriteImage(1, cubemap_image);
         }
+        _descriptor_writer.Flush();
     }
 
     void _CreateDepthResources() {
+        CPU_FUNCTION();
         VkFormat depth_format = VK_FORMAT_D32_SFLOAT;
         _CreateImage(_swapchain_extent.width, _swapchain_extent.height, depth_format,
                      VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
                      1, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, _depth_image,
-                     _depth_img_memory);
+                     _depth_img_memory, Backend::MemoryCategory::Attachment, "depth");
         _depth_img_view =
             _CreateImageView(_depth_image, depth_format, VK_IMAGE_ASPECT_DEPTH_BIT);
     }
@@ -1498,6 +2269,7 @@ class Application {
                       VkImageTiling tiling, VkImageUsageFlags usage, uint32_t layer_count,
                       VkImageCreateFlags flags, VkMemoryPropertyFlags properties,
                       VkImage& image, VkDeviceMemory& image_memory,
+                      Backend::MemoryCategory category, const std::string& name,
                       VkImageLayout initial_layout = VK_IMAGE_LAYOUT_UNDEFINED) {
         VkImageCreateInfo image_info = {};
         image_info.sType             = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -1515,7 +2287,8 @@ class Application {
         image_info.arrayLayers       = layer_count; /* For cubemaps */
         image_info.flags             = flags;       /* For cubemaps */
 
-        if (vkCreateImage(_device, &image_info, nullptr, &image) != VK_SUCCESS) {
+        if (vkCreateImage(_device, &image_info, Backend::HostCallbacks(), &image) !=
+            VK_SUCCESS) {
             throw std::runtime_error("Failed to create Image");
         }
 
@@ -1528,7 +2301,7 @@ class Application {
         alloc_info.memoryTypeIndex =
             _FindMemoryType(mem_requirements.memoryTypeBits, properties);
 
-        if (vkAllocateMemory(_device, &alloc_info, nullptr, &image_memory) !=
+        if (_memory_tracker.Allocate(alloc_info, image_memory, category, name) !=
             VK_SUCCESS) {
             throw std::runtime_error("Failed to allocate ImageMemory");
         }
@@ -1550,7 +2323,8 @@ class Application {
         view_info.subresourceRange.layerCount     = 1;
 
         VkImageView image_view;
-        if (vkCreateImageView(_device, &view_info, nullptr, &image_view) != VK_SUCCESS) {
+        if (vkCreateImageView(_device, &view_info,
+                              Backend::HostCallbacks(), &image_view) != VK_SUCCESS) {
             throw std::runtime_error("Failed to create image view!");
         }
 
@@ -1559,6 +2333,7 @@ class Application {
 
     stbi_uc* _LoadImage(const char* path, int& tex_width, int& tex_height,
                         VkDeviceSize& img_size) {
+        CPU_FUNCTION();
         int tex_channels;
 
         stbi_uc* pixel_buffer =
@@ -1574,6 +2349,7 @@ class Application {
     }
     gli::texture_cube _LoadCubemap(const char* path, int& tex_width, int& tex_height,
                                    VkDeviceSize& img_size) {
+        CPU_FUNCTION();
         gli::texture_cube tex_cube(gli::load(path));
 
         img_size   = tex_cube.size();
@@ -1587,7 +2363,8 @@ class Application {
         return tex_cube;
     }
 
-    VkImage _CreateTextureImage(const char* path, VkDeviceMemory memory, int type) {
+    VkImage _CreateTextureImage(const char* path, VkDeviceMemory& memory, int type) {
+        CPU_FUNCTION();
         VkImage texture;
 
         void*        img_data_buffer;
@@ -1609,7 +2386,8 @@ class Application {
         _CreateBuffer(img_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
                       VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
                           VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
-                      staging_buffer, staging_buffer_mem);
+                      staging_buffer, staging_buffer_mem, Backend::MemoryCategory::Staging,
+                      std::string(path) + " staging");
 
         void* data;
         vkMapMemory(_device, staging_buffer_mem, 0, img_size, 0, &data);
@@ -1621,7 +2399,8 @@ class Application {
             _CreateImage(tex_width, tex_height, VK_FORMAT_R8G8B8A8_UNORM,
                          VK_IMAGE_TILING_OPTIMAL,
                          VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, 1,
-                         0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, texture, memory);
+                         0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, texture, memory,
+                         Backend::MemoryCategory::Texture, path);
 
             _TransitionImageLayout(texture, VK_FORMAT_R8G8B8A8_UNORM,
                                    VK_IMAGE_LAYOUT_UNDEFINED,
@@ -1639,7 +2418,8 @@ class Application {
                          VK_IMAGE_TILING_OPTIMAL,
                          VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, 6,
                          VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT,
-                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, texture, memory);
+                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, texture, memory,
+                         Backend::MemoryCategory::Texture, path);
 
             _TransitionImageLayout(texture, VK_FORMAT_BC3_UNORM_BLOCK,
                                    VK_IMAGE_LAYOUT_UNDEFINED,
@@ -1653,8 +2433,7 @@ class Application {
                                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 6);
         }
 
-        vkDestroyBuffer(_device, staging_buffer, nullptr);
-        vkFreeMemory(_device, staging_buffer_mem, nullptr);
+        _deletion_queue.PushBuffer(_device, staging_buffer, staging_buffer_mem);
 
         return texture;
     }
@@ -1685,43 +2464,52 @@ class Application {
         sampler_info.minLod                  = 0.f;
         sampler_info.maxLod                  = 0.f;
 
-        if (vkCreateSampler(_device, &sampler_info, nullptr, &sampler) != VK_SUCCESS) {
+        if (vkCreateSampler(_device, &sampler_info, Backend::HostCallbacks(), &sampler) !=
+            VK_SUCCESS) {
             throw std::runtime_error("Failed to create texture sampler");
         }
         return sampler;
     }
 
+    /*
+     * The command buffer is allocated once and reused, single time commands can't be
+     * nested
+     */
     VkCommandBuffer _BeginSingleTimeCommands() {
-        VkCommandBufferAllocateInfo alloc_info = {};
-        alloc_info.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-        alloc_info.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-        alloc_info.commandPool        = _command_pool;
-        alloc_info.commandBufferCount = 1;
+        if (_single_time_cmd_buffer == VK_NULL_HANDLE) {
+            VkCommandBufferAllocateInfo alloc_info = {};
+            alloc_info.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            alloc_info.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            alloc_info.commandPool        = _command_pool;
+            alloc_info.commandBufferCount = 1;
 
-        VkCommandBuffer command_buffer;
-        vkAllocateCommandBuffers(_device, &alloc_info, &command_buffer);
+            vkAllocateCommandBuffers(_device, &alloc_info, &_single_time_cmd_buffer);
+        }
+        VkCommandBuffer command_buffer = _single_time_cmd_buffer;
 
         VkCommandBufferBeginInfo begin_info = {};
         begin_info.sType                    = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
         begin_info.flags                    = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
         vkBeginCommandBuffer(command_buffer, &begin_info);
+        _gpu_profiler.BeginUploads(command_buffer);
+        _upload_scope = _gpu_profiler.BeginScope(command_buffer, "uploads");
 
         return command_buffer;
     }
 
     void _EndSingleTimeCommands(VkCommandBuffer command_buffer) {
+        CPU_FUNCTION();
+        _gpu_profiler.EndScope(command_buffer, _upload_scope);
         vkEndCommandBuffer(command_buffer);
 
-        VkSubmitInfo submit_info       = {};
-        submit_info.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submit_info.commandBufferCount = 1;
-        submit_info.pCommandBuffers    = &command_buffer;
-
-        vkQueueSubmit(_graphics_queue, 1, &submit_info, VK_NULL_HANDLE);
-        vkQueueWaitIdle(_graphics_queue);
+        /* Timeline values are ordered on the queue : waiting for the upload also waits
+         * for every frame submitted before it */
+        uint64_t upload_value = _graphics_timeline.Submit(1, &command_buffer);
+        _graphics_timeline.Wait(upload_value);
+        _gpu_profiler.ResolveUploads();
 
-        vkFreeCommandBuffers(_device, _command_pool, 1, &command_buffer);
+        vkResetCommandPool(_device, _command_pool, 0);
     }
 
     void _TransitionImageLayout(VkImage image, VkFormat format, VkImageLayout old_layout,
@@ -1773,7 +2561,7 @@ class Application {
     GLFWwindow*                  _window;
     VkInstance                   _instance;
     VkDebugUtilsMessengerEXT     _debug_messenger;
-    VkSurfaceKHR                 _surface;
+    VkSurfaceKHR                 _surface = VK_NULL_HANDLE;
     VkPhysicalDevice             _physical_dev = VK_NULL_HANDLE;
     VkDevice                     _device;
     VkQueue                      _graphics_queue;
@@ -1796,14 +2584,40 @@ class Application {
     VkSampler                    _cubemap_sampler;
     VkRenderPass                 _renderpass;
     VkPipelineLayout             _pipeline_layout;
-    VkPipeline                   _graphics_pipeline;
+    VkPipeline                   _graphics_pipeline; /* Variant used by _material */
+    VkShaderModule               _vertex_module;
+    VkShaderModule               _fragment_module;
+    Backend::ShaderVariantCache  _shader_variants;
+    Backend::MaterialShading     _material;
     std::vector<VkFramebuffer>   _swapchain_framebuffers;
+    bool                         _framebuffer_resized = false;
+    bool                         _headless            = false;
+    VkExtent2D                   _headless_extent;
+    uint32_t                     _headless_frames = 0;
+    bool                         _benchmarking    = false;
+    bool                         _validation      = false;
+    Backend::BenchmarkConfig     _benchmark; /* Scene and time step, always set */
+    std::vector<VkDeviceMemory>  _offscreen_memory; /* Headless "swapchain" images */
+    uint64_t                     _frame_number           = 0;
+    uint64_t                     _frame_heap_allocations = 0; /* Since the last report */
+    bool                         _capture      = false;
+    std::string                  _capture_prefix;
+    Backend::CaptureFormat       _capture_format;
+    Backend::FrameReadback       _readback;
+    Backend::FrameStatistics     _frame_stats;
+    Backend::GpuProfiler         _gpu_profiler;
+    Backend::MemoryTracker       _memory_tracker;
+    uint32_t                     _upload_scope = UINT32_MAX;
+    Backend::PipelineStatistics  _pipeline_stats;
+    Backend::PacingConfig        _pacing;
+    Backend::LatencyTracker      _latency;
+    bool                         _pacing_switch_requested = false;
     VkCommandPool                _command_pool;
-    std::vector<VkCommandBuffer> _command_buffers;
-    std::vector<VkSemaphore>     _semaphores_img_available;
-    std::vector<VkSemaphore>     _semaphores_render_finished;
-    std::vector<VkFence>         _fences_inflight;
-    size_t                       _current_frame = 0;
+    VkCommandBuffer              _single_time_cmd_buffer = VK_NULL_HANDLE;
+    Backend::JobSystem               _jobs;
+    Backend::ParallelCommandRecorder _command_recorder;
+    std::vector<DrawItem>            _draws;
+    Backend::FrameContextRing    _frames;
     std::vector<Vertex>          _vertices;
     std::vector<uint32_t>        _indices;
     VkBuffer                     _vertex_buffer;
@@ -1814,8 +2628,23 @@ class Application {
     std::vector<VkDeviceMemory>  _uniform_buffers_memory;
     std::vector<VkBuffer>        _uniform_buffers_cubemap;
     std::vector<VkDeviceMemory>  _uniform_buffers_cubemap_memory;
-    VkDescriptorSetLayout        _descriptor_set_layout;
-    VkDescriptorPool             _descriptor_pool;
-    std::vector<VkDescriptorSet> _descriptor_sets;
-    VkDescriptorSet              _descriptor_skybox;
+    std::vector<uint64_t>        _uniform_transform_updates; /* Per buffer, WriteChanged */
+    Backend::TransformSystem     _transforms;
+    uint32_t                     _model_transform;
+    Backend::DescriptorLayoutCache _descriptor_layout_cache;
+    Backend::DescriptorAllocator   _descriptor_allocator;
+    VkDescriptorSetLayout          _descriptor_set_layout;
+    VkDescriptorSetLayout          _skybox_set_layout;
+    std::vector<VkDescriptorSet>   _descriptor_sets;
+    std::vector<VkDescriptorSet>   _descriptor_sets_skybox;
+    Backend::DescriptorUpdateTemplate _descriptor_template;
+    Backend::DescriptorWriter         _descriptor_writer;
+    bool                           _bindless = false;
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT _descriptor_indexing_features;
+    bool                           _timeline_sync = false;
+    VkPhysicalDeviceTimelineSemaphoreFeaturesKHR _timeline_semaphore_features;
+    Backend::QueueTimeline         _graphics_timeline;
+    Backend::DeletionQueue         _deletion_queue;
+    Backend::BindlessTextureTable  _bindless_textures;
+    uint32_t                       _texture_index = 0; /* Chalet texture in the table */
 };
\ No newline at end of file
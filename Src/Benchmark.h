@@ -0,0 +1,305 @@
+#pragma once
+#include "FrameStatistics.h"
+#include "GpuProfiler.h"
+#include "MemoryTracker.h"
+#include "RollingStats.h"
+
+#include <glm/glm.hpp>
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+namespace Backend {
+
+/*
+ * Orbit : Full turn around the model at a constant distance and height
+ * Flyby : Dolly from far to close and back, the projected size (fragment load) varies
+ * Static : Fixed camera, only the model animates
+ */
+enum class CameraPath { Orbit, Flyby, Static };
+
+inline const char* CameraPathName(CameraPath path) {
+    switch (path) {
+    case CameraPath::Orbit: return "orbit";
+    case CameraPath::Flyby: return "flyby";
+    case CameraPath::Static: return "static";
+    }
+    return "unknown";
+}
+
+struct CameraPose {
+    glm::vec3 Eye;
+    glm::vec3 Target;
+    glm::vec3 Up;
+};
+
+/*
+ * Pose of the camera a time into the path, a pure function of the time so that a frame
+ * number always renders the same image
+ * @param time : Virtual seconds, the paths loop every 10s
+ */
+inline CameraPose EvaluateCameraPath(CameraPath path, double time) {
+    const double pi    = 3.14159265358979323846;
+    double       phase = std::fmod(time, 10.0) / 10.0;
+    CameraPose   pose  = {glm::vec3(2.0f, 2.5f, 2.2f), glm::vec3(0.0f, 0.0f, 0.0f),
+                        glm::vec3(0.0f, 0.0f, 1.0f)};
+    switch (path) {
+    case CameraPath::Orbit: {
+        float angle = static_cast<float>(phase * 2.0 * pi);
+        pose.Eye    = glm::vec3(3.2f * std::cos(angle), 3.2f * std::sin(angle), 2.2f);
+        break;
+    }
+    case CameraPath::Flyby: {
+        /* 1 at both ends, 0.35 halfway */
+        double distance = 0.35 + 0.65 * (0.5 + 0.5 * std::cos(phase * 2.0 * pi));
+        pose.Eye        = glm::vec3(2.0f, 2.5f, 2.2f) * static_cast<float>(distance);
+        break;
+    }
+    case CameraPath::Static: break;
+    }
+    return pose;
+}
+
+/*
+ * A benchmark run : fixed virtual time step, scripted camera, warmup frames then
+ * measured frames, rendered headless
+ */
+struct BenchmarkConfig {
+    std::string Name;           /* Camera path name, in the summary */
+    CameraPath  Camera;
+    VkExtent2D  Extent;
+    uint32_t    WarmupFrames;   /* Pipelines, caches and clocks settle, not measured */
+    uint32_t    MeasuredFrames;
+    double      TimeStep;       /* Virtual seconds per frame */
+    std::string ModelPath;
+    std::string TexturePath;
+    uint32_t    DrawCount;      /* The model is split in that many draws */
+    std::string OutputPath;     /* JSON summary */
+    std::string Commit;         /* Revision benchmarked, copied to the summary */
+};
+
+/*
+ * Integer setting of the benchmark, throws when it isn't a number in the range
+ * (a negative count is rejected instead of wrapping around)
+ * @param name : Variable name, for the error
+ * @param value : Text to parse, the whole of it must be the number
+ * @param min_value : Smallest accepted value
+ */
+inline uint32_t ParseBenchmarkCount(const char* name, const std::string& value,
+                                    uint32_t min_value) {
+    errno           = 0;
+    char*     end   = nullptr;
+    long long count = std::strtoll(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0' || errno == ERANGE || count < min_value ||
+        count > UINT32_MAX) {
+        throw std::runtime_error(std::string(name) + " must be an integer between " +
+                                 std::to_string(min_value) + " and " +
+                                 std::to_string(UINT32_MAX) + ", got \"" + value + "\"");
+    }
+    return static_cast<uint32_t>(count);
+}
+
+/*
+ * Benchmark mode from VT_BENCHMARK (camera path : orbit, flyby, static), with
+ * VT_BENCH_RESOLUTION (WIDTHxHEIGHT), VT_BENCH_WARMUP, VT_BENCH_FRAMES,
+ * VT_BENCH_TIME_STEP, VT_BENCH_MODEL, VT_BENCH_TEXTURE, VT_BENCH_DRAWS, VT_BENCH_OUTPUT
+ * and VT_BENCH_COMMIT
+ * @param config : Defaults, also the result when VT_BENCHMARK isn't set
+ * @return : Whether the benchmark mode is requested, throws on an unknown camera path
+ *           or a value out of range
+ */
+inline bool GetBenchmarkConfigFromEnv(BenchmarkConfig& config) {
+    const char* path = std::getenv("VT_BENCHMARK");
+    if (!path) {
+        return false;
+    }
+    bool found = false;
+    for (CameraPath candidate : {CameraPath::Orbit, CameraPath::Flyby, CameraPath::Static}) {
+        if (std::string(path) == CameraPathName(candidate)) {
+            config.Camera = candidate;
+            found         = true;
+        }
+    }
+    if (!found) {
+        throw std::runtime_error("Unknown VT_BENCHMARK camera path: " + std::string(path) +
+                                 " (orbit, flyby, static)");
+    }
+    config.Name = path;
+
+    if (const char* resolution = std::getenv("VT_BENCH_RESOLUTION")) {
+        std::string text(resolution);
+        size_t      separator = text.find('x');
+        if (separator == std::string::npos) {
+            throw std::runtime_error("VT_BENCH_RESOLUTION must be WIDTHxHEIGHT, got \"" +
+                                     text + "\"");
+        }
+        config.Extent = {
+            ParseBenchmarkCount("VT_BENCH_RESOLUTION", text.substr(0, separator), 1),
+            ParseBenchmarkCount("VT_BENCH_RESOLUTION", text.substr(separator + 1), 1)};
+    }
+    if (const char* warmup = std::getenv("VT_BENCH_WARMUP")) {
+        config.WarmupFrames = ParseBenchmarkCount("VT_BENCH_WARMUP", warmup, 0);
+    }
+    if (const char* frames = std::getenv("VT_BENCH_FRAMES")) {
+        config.MeasuredFrames = ParseBenchmarkCount("VT_BENCH_FRAMES", frames, 1);
+    }
+    if (const char* step = std::getenv("VT_BENCH_TIME_STEP")) {
+        char*  end       = nullptr;
+        double time_step = std::strtod(step, &end);
+        if (end == step || *end != '\0' || !std::isfinite(time_step) ||
+            time_step <= 0.0) {
+            throw std::runtime_error("VT_BENCH_TIME_STEP must be positive, got \"" +
+                                     std::string(step) + "\"");
+        }
+        config.TimeStep = time_step;
+    }
+    if (const char* model = std::getenv("VT_BENCH_MODEL")) {
+        config.ModelPath = model;
+    }
+    if (const char* texture = std::getenv("VT_BENCH_TEXTURE")) {
+        config.TexturePath = texture;
+    }
+    if (const char* draws = std::getenv("VT_BENCH_DRAWS")) {
+        config.DrawCount = ParseBenchmarkCount("VT_BENCH_DRAWS", draws, 1);
+    }
+    if (const char* output = std::getenv("VT_BENCH_OUTPUT")) {
+        config.OutputPath = output;
+    }
+    if (const char* commit = std::getenv("VT_BENCH_COMMIT")) {
+        config.Commit = commit;
+    }
+    return true;
+}
+
+/*
+ * Resident and peak resident memory of the process, in KiB (Linux, 0 elsewhere)
+ */
+struct HostMemoryUsage {
+    uint64_t ResidentKiB     = 0;
+    uint64_t PeakResidentKiB = 0;
+};
+
+inline HostMemoryUsage QueryHostMemoryUsage() {
+    HostMemoryUsage usage;
+    std::ifstream   status("/proc/self/status");
+    std::string     line;
+    while (std::getline(status, line)) {
+        unsigned long long kib = 0;
+        if (std::sscanf(line.c_str(), "VmRSS: %llu kB", &kib) == 1) {
+            usage.ResidentKiB = kib;
+        } else if (std::sscanf(line.c_str(), "VmHWM: %llu kB", &kib) == 1) {
+            usage.PeakResidentKiB = kib;
+        }
+    }
+    return usage;
+}
+
+/* JSON string literal of a value (scope names, paths, device name) */
+inline std::string JsonString(const std::string& value) {
+    std::string result = "\"";
+    for (char c : value) {
+        switch (c) {
+        case '"': result += "\\\""; break;
+        case '\\': result += "\\\\"; break;
+        case '\n': result += "\\n"; break;
+        case '\r': result += "\\r"; break;
+        case '\t': result += "\\t"; break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char     escaped[8];
+                unsigned code = static_cast<unsigned char>(c);
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", code);
+                result += escaped;
+            } else {
+                result += c;
+            }
+        }
+    }
+    return result + "\"";
+}
+
+/*
+ * Summary of the measured frames, one JSON object so a CI job can compare runs
+ * @param gpu_scopes : GpuProfiler scopes, reset after the warmup
+ * @param device_memory : Live device allocations by category, heap usage and budget
+ */
+inline void WriteBenchmarkJson(const BenchmarkConfig& config, const char* device_name,
+                               const FrameStatistics& frame_stats, double total_ms,
+                               const GpuScopeStats& gpu_scopes,
+                               const HostMemoryUsage& memory,
+                               const MemoryTracker& device_memory) {
+    std::ofstream file(config.OutputPath);
+    if (!file) {
+        std::cerr << "Benchmark: Failed to open " << config.OutputPath << std::endl;
+        return;
+    }
+
+    auto write_summary = [&file](const FrameTimeSummary& summary) {
+        file << "{\"avg\": " << summary.Average << ", \"p50\": " << summary.P50
+             << ", \"p95\": " << summary.P95 << ", \"p99\": " << summary.P99
+             << ", \"max\": " << summary.Max << "}";
+    };
+
+    file << "{\n";
+    file << "  \"benchmark\": " << JsonString(config.Name) << ",\n";
+    file << "  \"commit\": " << JsonString(config.Commit) << ",\n";
+    file << "  \"device\": " << JsonString(device_name) << ",\n";
+    file << "  \"resolution\": [" << config.Extent.width << ", " << config.Extent.height
+         << "],\n";
+    file << "  \"model\": " << JsonString(config.ModelPath) << ",\n";
+    file << "  \"draws\": " << config.DrawCount << ",\n";
+    file << "  \"time_step\": " << config.TimeStep << ",\n";
+    file << "  \"warmup_frames\": " << config.WarmupFrames << ",\n";
+    file << "  \"measured_frames\": " << frame_stats.FrameCount() << ",\n";
+    file << "  \"total_ms\": " << total_ms << ",\n";
+    file << "  \"cpu_frame_ms\": ";
+    write_summary(frame_stats.CpuSummary());
+    file << ",\n  \"wait_ms\": ";
+    write_summary(frame_stats.WaitSummary());
+    file << ",\n  \"frame_interval_ms\": ";
+    write_summary(frame_stats.PresentSummary());
+    file << ",\n  \"stutters\": " << frame_stats.StutterCount() << ",\n";
+
+    file << "  \"gpu_ms\": {";
+    bool first = true;
+    for (const auto& scope : gpu_scopes) {
+        file << (first ? "\n" : ",\n") << "    " << JsonString(scope.first) << ": ";
+        write_summary({scope.second.Average(), scope.second.Percentile(50),
+                       scope.second.Percentile(95), scope.second.Percentile(99),
+                       scope.second.Max()});
+        first = false;
+    }
+    file << (first ? "},\n" : "\n  },\n");
+
+    file << "  \"host_memory_kib\": {\"resident\": " << memory.ResidentKiB
+         << ", \"peak_resident\": " << memory.PeakResidentKiB << "},\n";
+
+    file << "  \"device_memory_bytes\": {";
+    for (uint32_t i = 0; i < MEMORY_CATEGORY_COUNT; i++) {
+        MemoryCategory category = static_cast<MemoryCategory>(i);
+        file << (i ? ", " : "") << JsonString(MemoryCategoryName(category)) << ": "
+             << device_memory.CategoryBytes(category);
+    }
+    file << "},\n  \"heaps\": [";
+    std::vector<HeapUsage> heaps = device_memory.Heaps();
+    for (size_t i = 0; i < heaps.size(); i++) {
+        file << (i ? ",\n" : "\n") << "    {\"device_local\": "
+             << (heaps[i].DeviceLocal ? "true" : "false") << ", \"size\": " << heaps[i].Size
+             << ", \"usage\": " << heaps[i].Usage << ", \"budget\": " << heaps[i].Budget
+             << ", \"tracked\": " << heaps[i].Tracked << "}";
+    }
+    file << "\n  ]\n}\n";
+    std::cout << "Benchmark: Summary written to " << config.OutputPath << std::endl;
+}
+
+} // namespace Backend
@@ -0,0 +1,217 @@
+#pragma once
+#include "DescriptorAllocator.h"
+#include "HostAllocator.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace Backend {
+
+/*
+ * Checks that the device can do bindless textures (VK_EXT_descriptor_indexing).
+ * The device must be Vulkan 1.1 for vkGetPhysicalDeviceFeatures2.
+ * @param dev : The physical device
+ * @param features : Filled with the features to chain in VkDeviceCreateInfo::pNext
+ */
+inline bool QueryBindlessSupport(VkPhysicalDevice                            dev,
+                                 VkPhysicalDeviceDescriptorIndexingFeaturesEXT& features) {
+    VkPhysicalDeviceProperties dev_properties;
+    vkGetPhysicalDeviceProperties(dev, &dev_properties);
+    if (dev_properties.apiVersion < VK_API_VERSION_1_1) {
+        return false;
+    }
+
+    uint32_t ext_count;
+    vkEnumerateDeviceExtensionProperties(dev, nullptr, &ext_count, nullptr);
+    std::vector<VkExtensionProperties> dev_available_ext(ext_count);
+    vkEnumerateDeviceExtensionProperties(dev, nullptr, &ext_count,
+                                         dev_available_ext.data());
+
+    bool ext_found = std::any_of(
+        dev_available_ext.begin(), dev_available_ext.end(),
+        [](const VkExtensionProperties& ext) {
+            return strcmp(ext.extensionName, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) == 0;
+        });
+    if (!ext_found) {
+        return false;
+    }
+
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT supported = {};
+    supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+
+    VkPhysicalDeviceFeatures2 dev_features = {};
+    dev_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    dev_features.pNext = &supported;
+    vkGetPhysicalDeviceFeatures2(dev, &dev_features);
+
+    if (!supported.runtimeDescriptorArray || !supported.descriptorBindingPartiallyBound ||
+        !supported.descriptorBindingVariableDescriptorCount ||
+        !supported.descriptorBindingSampledImageUpdateAfterBind) {
+        return false;
+    }
+
+    /* Only enable what the table uses */
+    features       = {};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+    features.runtimeDescriptorArray                        = VK_TRUE;
+    features.descriptorBindingPartiallyBound               = VK_TRUE;
+    features.descriptorBindingVariableDescriptorCount      = VK_TRUE;
+    features.descriptorBindingSampledImageUpdateAfterBind  = VK_TRUE;
+    features.shaderSampledImageArrayNonUniformIndexing =
+        supported.shaderSampledImageArrayNonUniformIndexing;
+    return true;
+}
+
+/*
+ * One global set holding every texture of the scene (set = 1, binding = 0 in
+ * Shaders/shader.frag compiled with -DBINDLESS). Materials reference their textures
+ * by index (push constant), so the set is bound once per command buffer.
+ */
+class BindlessTextureTable {
+  public:
+    /*
+     * @param device : Device created with the features of QueryBindlessSupport()
+     * @param physical_dev : Used to clamp the table size to the device limits
+     * @param layout_cache : The table layout is cached with the other layouts
+     * @param max_textures (Optional) : Size of the texture array
+     */
+    void Init(VkDevice device, VkPhysicalDevice physical_dev,
+              DescriptorLayoutCache& layout_cache, uint32_t max_textures = 4096) {
+        _device = device;
+
+        VkPhysicalDeviceDescriptorIndexingPropertiesEXT indexing_properties = {};
+        indexing_properties.sType =
+            VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_PROPERTIES_EXT;
+        VkPhysicalDeviceProperties2 dev_properties = {};
+        dev_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+        dev_properties.pNext = &indexing_properties;
+        vkGetPhysicalDeviceProperties2(physical_dev, &dev_properties);
+
+        /* A combined image sampler counts against the sampled image and sampler limits */
+        const VkPhysicalDeviceDescriptorIndexingPropertiesEXT& limits = indexing_properties;
+        _capacity = std::min({max_textures,
+                              limits.maxDescriptorSetUpdateAfterBindSampledImages,
+                              limits.maxPerStageDescriptorUpdateAfterBindSampledImages,
+                              limits.maxDescriptorSetUpdateAfterBindSamplers,
+                              limits.maxPerStageDescriptorUpdateAfterBindSamplers});
+
+        /* === LAYOUT === */
+        VkDescriptorSetLayoutBinding textures_binding = {};
+        textures_binding.binding                      = 0;
+        textures_binding.descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        textures_binding.descriptorCount = _capacity;
+        textures_binding.stageFlags      = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+        /* Unused slots are allowed, slots can be written while the set is bound */
+        VkDescriptorBindingFlagsEXT binding_flags =
+            VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT |
+            VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT |
+            VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT_EXT;
+
+        VkDescriptorSetLayoutBindingFlagsCreateInfoEXT binding_flags_info = {};
+        binding_flags_info.sType =
+            VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+        binding_flags_info.bindingCount  = 1;
+        binding_flags_info.pBindingFlags = &binding_flags;
+
+        Layout = layout_cache.CreateLayout(
+            {textures_binding},
+            VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT,
+            &binding_flags_info);
+
+        /* === POOL === */
+        VkDescriptorPoolSize pool_size = {};
+        pool_size.type                 = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        pool_size.descriptorCount      = _capacity;
+
+        VkDescriptorPoolCreateInfo pool_info = {};
+        pool_info.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        pool_info.flags         = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+        pool_info.poolSizeCount = 1;
+        pool_info.pPoolSizes    = &pool_size;
+        pool_info.maxSets       = 1;
+
+        if (vkCreateDescriptorPool(_device, &pool_info, HostCallbacks(), &_pool) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("Failed to create bindless descriptor pool");
+        }
+
+        /* === SET === */
+        VkDescriptorSetVariableDescriptorCountAllocateInfoEXT variable_count_info = {};
+        variable_count_info.sType =
+            VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO_EXT;
+        variable_count_info.descriptorSetCount = 1;
+        variable_count_info.pDescriptorCounts  = &_capacity;
+
+        VkDescriptorSetAllocateInfo alloc_info = {};
+        alloc_info.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        alloc_info.pNext              = &variable_count_info;
+        alloc_info.descriptorPool     = _pool;
+        alloc_info.descriptorSetCount = 1;
+        alloc_info.pSetLayouts        = &Layout;
+
+        if (vkAllocateDescriptorSets(_device, &alloc_info, &Set) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate bindless descriptor set");
+        }
+    }
+
+    /*
+     * Write a texture in the next free slot of the table
+     * @return : Index of the texture in the shader array
+     */
+    uint32_t Register(VkImageView view, VkSampler sampler) {
+        if (_count >= _capacity) {
+            throw std::runtime_error("Bindless texture table is full");
+        }
+
+        VkDescriptorImageInfo image_info = {};
+        image_info.imageLayout           = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        image_info.imageView             = view;
+        image_info.sampler               = sampler;
+
+        VkWriteDescriptorSet descriptor_write = {};
+        descriptor_write.sType                = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        descriptor_write.dstSet               = Set;
+        descriptor_write.dstBinding           = 0;
+        descriptor_write.dstArrayElement      = _count;
+        descriptor_write.descriptorType       = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        descriptor_write.descriptorCount      = 1;
+        descriptor_write.pImageInfo           = &image_info;
+
+        vkUpdateDescriptorSets(_device, 1, &descriptor_write, 0, nullptr);
+        return _count++;
+    }
+
+    uint32_t TextureCount() const { return _count; }
+
+    /*
+     * The layout is owned by the DescriptorLayoutCache
+     */
+    void Destroy() {
+        if (_pool != VK_NULL_HANDLE) {
+            vkDestroyDescriptorPool(_device, _pool, HostCallbacks());
+            _pool = VK_NULL_HANDLE;
+        }
+    }
+
+  public:
+    VkDescriptorSetLayout Layout = VK_NULL_HANDLE;
+    VkDescriptorSet       Set    = VK_NULL_HANDLE;
+
+  private:
+    VkDevice         _device;
+    VkDescriptorPool _pool     = VK_NULL_HANDLE;
+    uint32_t         _capacity = 0;
+    uint32_t         _count    = 0;
+};
+
+/* Per draw material data of the bindless path (push_constant block of shader.frag) */
+struct MaterialPushConstants {
+    uint32_t TextureIndex;
+};
+
+} // namespace Backend
@@ -0,0 +1,295 @@
+#pragma once
+#include "CpuProfiler.h"
+#include "FrameAllocator.h"
+#include "HostAllocator.h"
+#include "JobSystem.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace Backend {
+
+/* Mix a value in a key (ex: handles a recorded bucket depends on) */
+inline uint64_t HashCombine(uint64_t seed, uint64_t value) {
+    return seed ^ (value + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+}
+
+/*
+ * Records a render pass from a draw list on several threads.
+ * The draw list is cut in buckets of consecutive draws, each bucket is recorded in its
+ * own secondary command buffer and the caller's primary (FrameContextRing) executes
+ * them in draw order. Every frame in flight keeps its buckets with a copy of the draws
+ * they were recorded from : only the buckets whose draws (or context) changed since
+ * that frame slot was last recorded are re-recorded, on the job system. A static scene
+ * costs a compare and one vkCmdExecuteCommands.
+ * The caller must have waited on the frame's fence first.
+ */
+class ParallelCommandRecorder {
+  public:
+    /*
+     * Records the draws [first, last) in a secondary command buffer. Secondaries
+     * inherit nothing but the render pass : pipeline, sets and buffers must be bound
+     * by every bucket, and anything it reads from must be part of the context key.
+     */
+    using RecordSlice = FunctionRef<void(VkCommandBuffer, size_t first, size_t last)>;
+
+    /*
+     * @param device : Device that owns the pools
+     * @param queue_family : Family of the queue the primaries are submitted to
+     * @param frame_count : Frames in flight
+     * @param jobs : Records the buckets, must outlive the recorder
+     * @param draws_per_bucket (Optional) : Granularity of the diff and of the threading
+     */
+    void Init(VkDevice device, uint32_t queue_family, uint32_t frame_count,
+              JobSystem& jobs, uint32_t draws_per_bucket = 256) {
+        _device           = device;
+        _jobs             = &jobs;
+        _draws_per_bucket = std::max(1u, draws_per_bucket);
+
+        _frames.resize(frame_count);
+        for (FrameBuckets& frame : _frames) {
+            for (uint32_t i = 0; i < jobs.ThreadCount(); i++) {
+                frame.ThreadPools.push_back(_CreatePool(queue_family));
+            }
+        }
+    }
+
+    /*
+     * Record a render pass of a frame
+     * @param primary : Command buffer of the frame, in the recording state
+     * @param frame_index : Frame in flight index, its fence must be signaled
+     * @param scratch : Temporaries of the frame (FrameContext::Scratch)
+     * @param renderpass_info : Render pass, framebuffer, area and clear values
+     * @param draws : Draw list, diffed bytewise against the previous one of this frame
+     *                slot (padding must be explicit)
+     * @param context_key : Everything else the buckets depend on (pipeline, sets, ...)
+     * @param record_slice : Called for every bucket that must be re-recorded
+     */
+    template <typename Draw>
+    void RecordRenderPass(VkCommandBuffer primary, uint32_t frame_index,
+                          LinearAllocator&             scratch,
+                          const VkRenderPassBeginInfo& renderpass_info,
+                          const std::vector<Draw>& draws, uint64_t context_key,
+                          const RecordSlice& record_slice) {
+        static_assert(std::is_trivially_copyable<Draw>::value, "Draws are diffed bytewise");
+        _RecordRenderPass(primary, frame_index, scratch, renderpass_info,
+                          reinterpret_cast<const uint8_t*>(draws.data()), sizeof(Draw),
+                          draws.size(), context_key, record_slice);
+    }
+
+    /*
+     * Force every bucket to be re-recorded (ex: a resource bound by the buckets changed
+     * without changing its handle)
+     */
+    void Invalidate() {
+        for (FrameBuckets& frame : _frames) {
+            for (Bucket& bucket : frame.Buckets) {
+                bucket.Valid = false;
+            }
+        }
+    }
+
+    /*
+     * Pipeline statistics the secondaries must inherit, when the render passes are
+     * recorded inside a VK_QUERY_TYPE_PIPELINE_STATISTICS query. The device must have
+     * inheritedQueries enabled, leave it at 0 otherwise. Changing them invalidates the
+     * buckets.
+     */
+    void SetInheritedStatistics(VkQueryPipelineStatisticFlags statistics) {
+        if (statistics != _inherited_statistics) {
+            _inherited_statistics = statistics;
+            Invalidate();
+        }
+    }
+
+    uint32_t ThreadCount() const { return _jobs->ThreadCount(); }
+    /* CPU time of the last RecordRenderPass(), its bucket count and re-recorded buckets */
+    double   LastRecordMs() const { return _last_record_ms; }
+    uint32_t LastBucketCount() const { return _last_bucket_count; }
+    uint32_t LastRecordedBuckets() const { return _last_recorded_buckets; }
+
+    /*
+     * The frames must not be in use by the GPU anymore
+     */
+    void Destroy() {
+        for (FrameBuckets& frame : _frames) {
+            for (VkCommandPool pool : frame.ThreadPools) {
+                vkDestroyCommandPool(_device, pool, HostCallbacks());
+            }
+        }
+        _frames.clear();
+    }
+
+  private:
+    struct Bucket {
+        VkCommandBuffer      Secondary = VK_NULL_HANDLE;
+        std::vector<uint8_t> Draws; /* Copy of the draws it was recorded from */
+        uint64_t             Context     = 0;
+        VkRenderPass         RenderPass  = VK_NULL_HANDLE;
+        VkFramebuffer        Framebuffer = VK_NULL_HANDLE;
+        bool                 Valid       = false;
+    };
+
+    /*
+     * Bucket i is recorded in pool (i % pool count), one pool per job system thread.
+     * Each pool is used by one job at a time, whatever thread runs it.
+     */
+    struct FrameBuckets {
+        std::vector<VkCommandPool> ThreadPools;
+        std::vector<Bucket>        Buckets;
+    };
+
+    void _RecordRenderPass(VkCommandBuffer primary, uint32_t frame_index,
+                           LinearAllocator&             scratch,
+                           const VkRenderPassBeginInfo& renderpass_info,
+                           const uint8_t* draws, size_t stride, size_t draw_count,
+                           uint64_t context_key, const RecordSlice& record_slice) {
+        CPU_SCOPE("RecordRenderPass");
+        auto          start = std::chrono::high_resolution_clock::now();
+        FrameBuckets& frame = _frames[frame_index];
+
+        size_t bucket_count = (draw_count + _draws_per_bucket - 1) / _draws_per_bucket;
+        if (frame.Buckets.size() < bucket_count) {
+            frame.Buckets.resize(bucket_count);
+        }
+
+        /* === DIFF === */
+        FrameVector<size_t> dirty_buckets(scratch);
+        dirty_buckets.reserve(bucket_count);
+        for (size_t i = 0; i < bucket_count; i++) {
+            const Bucket&  bucket = frame.Buckets[i];
+            size_t         first  = i * _draws_per_bucket;
+            size_t         last   = std::min(draw_count, first + _draws_per_bucket);
+            const uint8_t* bytes  = draws + first * stride;
+            size_t         size   = (last - first) * stride;
+
+            if (!bucket.Valid || bucket.Context != context_key ||
+                bucket.RenderPass != renderpass_info.renderPass ||
+                bucket.Framebuffer != renderpass_info.framebuffer ||
+                bucket.Draws.size() != size || memcmp(bucket.Draws.data(), bytes, size) != 0) {
+                dirty_buckets.push_back(i);
+            }
+        }
+
+        /* === RECORD === */
+        auto record_bucket = [&](size_t index) {
+            CPU_SCOPE("RecordBucket");
+            Bucket& bucket = frame.Buckets[index];
+            if (bucket.Secondary == VK_NULL_HANDLE) {
+                VkCommandPool pool = frame.ThreadPools[index % frame.ThreadPools.size()];
+                bucket.Secondary   = _AllocateSecondary(pool);
+            }
+
+            VkCommandBufferInheritanceInfo inheritance_info = {};
+            inheritance_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+            inheritance_info.renderPass         = renderpass_info.renderPass;
+            inheritance_info.subpass            = 0;
+            inheritance_info.framebuffer        = renderpass_info.framebuffer;
+            inheritance_info.pipelineStatistics = _inherited_statistics;
+
+            VkCommandBufferBeginInfo begin_info = {};
+            begin_info.sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+            begin_info.flags            = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+            begin_info.pInheritanceInfo = &inheritance_info;
+
+            /* Implicit reset of the secondary */
+            if (vkBeginCommandBuffer(bucket.Secondary, &begin_info) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to begin recording secondary CommandBuffer");
+            }
+            size_t first = index * _draws_per_bucket;
+            size_t last  = std::min(draw_count, first + _draws_per_bucket);
+            record_slice(bucket.Secondary, first, last);
+            if (vkEndCommandBuffer(bucket.Secondary) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to record secondary CommandBuffer");
+            }
+
+            bucket.Draws.assign(draws + first * stride, draws + last * stride);
+            bucket.Context     = context_key;
+            bucket.RenderPass  = renderpass_info.renderPass;
+            bucket.Framebuffer = renderpass_info.framebuffer;
+            bucket.Valid       = true;
+        };
+
+        if (dirty_buckets.size() == 1) {
+            /* Not worth waking the workers */
+            record_bucket(dirty_buckets[0]);
+        } else if (dirty_buckets.size() > 1) {
+            uint32_t pool_count = static_cast<uint32_t>(frame.ThreadPools.size());
+            _jobs->ParallelFor(0, pool_count, 1, [&](uint32_t first, uint32_t last) {
+                for (uint32_t pool = first; pool < last; pool++) {
+                    for (size_t index : dirty_buckets) {
+                        if (index % pool_count == pool) {
+                            record_bucket(index);
+                        }
+                    }
+                }
+            });
+        }
+
+        /* === PRIMARY === */
+        vkCmdBeginRenderPass(primary, &renderpass_info,
+                             VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+        FrameVector<VkCommandBuffer> secondaries(scratch);
+        secondaries.reserve(bucket_count);
+        for (size_t i = 0; i < bucket_count; i++) {
+            secondaries.push_back(frame.Buckets[i].Secondary);
+        }
+        if (!secondaries.empty()) {
+            vkCmdExecuteCommands(primary, static_cast<uint32_t>(secondaries.size()),
+                                 secondaries.data());
+        }
+        vkCmdEndRenderPass(primary);
+
+        _last_bucket_count     = static_cast<uint32_t>(bucket_count);
+        _last_recorded_buckets = static_cast<uint32_t>(dirty_buckets.size());
+        _last_record_ms        = std::chrono::duration<double, std::milli>(
+                              std::chrono::high_resolution_clock::now() - start)
+                              .count();
+    }
+
+    VkCommandPool _CreatePool(uint32_t queue_family) {
+        VkCommandPoolCreateInfo pool_info = {};
+        pool_info.sType                   = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        pool_info.queueFamilyIndex        = queue_family;
+        pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT; /* Per bucket */
+
+        VkCommandPool pool;
+        if (vkCreateCommandPool(_device, &pool_info, HostCallbacks(), &pool) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("Failed to create CommandPool");
+        }
+        return pool;
+    }
+
+    VkCommandBuffer _AllocateSecondary(VkCommandPool pool) {
+        VkCommandBufferAllocateInfo alloc_info = {};
+        alloc_info.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        alloc_info.commandPool        = pool;
+        alloc_info.level              = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        alloc_info.commandBufferCount = 1;
+
+        VkCommandBuffer command_buffer;
+        if (vkAllocateCommandBuffers(_device, &alloc_info, &command_buffer) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate CommandBuffers");
+        }
+        return command_buffer;
+    }
+
+    VkDevice                      _device;
+    JobSystem*                    _jobs             = nullptr;
+    uint32_t                      _draws_per_bucket = 256;
+    std::vector<FrameBuckets>     _frames;
+    VkQueryPipelineStatisticFlags _inherited_statistics  = 0;
+    double                        _last_record_ms        = 0.0;
+    uint32_t                      _last_bucket_count     = 0;
+    uint32_t                      _last_recorded_buckets = 0;
+};
+
+} // namespace Backend
@@ -0,0 +1,224 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/*
+ * CPU_SCOPE("name") / CPU_FUNCTION() : scoped markers
+ * CPU_PROFILER_EXPORT() : write the trace
+ * Compiled out unless ENABLE_CPU_PROFILER is defined (makefile CPU_PROFILER=1). When
+ * compiled in, the events are only recorded if VT_CPU_TRACE names the output file.
+ */
+#ifdef ENABLE_CPU_PROFILER
+#define CPU_PROFILER_CONCAT_(a, b) a##b
+#define CPU_PROFILER_CONCAT(a, b) CPU_PROFILER_CONCAT_(a, b)
+#define CPU_SCOPE(name) Backend::CpuScope CPU_PROFILER_CONCAT(_cpu_scope_, __LINE__)(name)
+#define CPU_FUNCTION() CPU_SCOPE(__func__)
+#define CPU_THREAD_NAME(name) Backend::CpuProfiler::Get().SetThreadName(name)
+#define CPU_PROFILER_EXPORT() Backend::CpuProfiler::Get().ExportIfRequested()
+#else
+#define CPU_SCOPE(name)
+#define CPU_FUNCTION()
+#define CPU_THREAD_NAME(name)
+#define CPU_PROFILER_EXPORT()
+#endif
+
+namespace Backend {
+
+/*
+ * Complete events (begin + duration) in per thread buffers. A thread only appends to
+ * its own buffer : chunks are published with release stores, the exporter reads what
+ * was published, no lock on the recording path.
+ */
+class CpuProfiler {
+  public:
+    static CpuProfiler& Get() {
+        static CpuProfiler profiler;
+        return profiler;
+    }
+
+    bool Enabled() const { return _enabled; }
+
+    /*
+     * @param name : Must outlive the profiler (literal, __func__)
+     * @param start_ns : From Now()
+     */
+    void Record(const char* name, uint64_t start_ns, uint64_t end_ns) {
+        ThreadBuffer& buffer = _LocalBuffer();
+        Chunk*        chunk  = buffer.Tail;
+        uint32_t      count  = chunk->Count.load(std::memory_order_relaxed);
+        if (count == Chunk::Capacity) {
+            if (buffer.ChunkCount == _max_chunks_per_thread) {
+                buffer.Dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            Chunk* next = new Chunk();
+            chunk->Next.store(next, std::memory_order_release);
+            buffer.Tail = chunk = next;
+            buffer.ChunkCount++;
+            count = 0;
+        }
+        chunk->Events[count] = {name, start_ns, end_ns - start_ns};
+        chunk->Count.store(count + 1, std::memory_order_release);
+    }
+
+    /* Names the calling thread in the trace */
+    void SetThreadName(const std::string& name) {
+        if (_enabled) {
+            ThreadBuffer&               buffer = _LocalBuffer();
+            std::lock_guard<std::mutex> lock(_mutex);
+            buffer.Name = name;
+        }
+    }
+
+    uint64_t Now() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - _start)
+            .count();
+    }
+
+    /*
+     * Chrome Trace Event JSON (chrome://tracing, ui.perfetto.dev) of the events recorded
+     * so far. Events recorded meanwhile by other threads may be missing.
+     */
+    void ExportChromeTrace(const std::string& path) {
+        std::ofstream file(path);
+        if (!file) {
+            std::cerr << "CpuProfiler: Failed to open " << path << std::endl;
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        bool     first   = true;
+        uint64_t events  = 0;
+        uint64_t dropped = 0;
+        for (size_t tid = 0; tid < _buffers.size(); tid++) {
+            const ThreadBuffer& buffer = *_buffers[tid];
+            file << (first ? "" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,"
+                 << "\"tid\":" << tid << ",\"args\":{\"name\":\"" << buffer.Name << "\"}}";
+            first = false;
+
+            for (const Chunk* chunk = &buffer.Head; chunk;
+                 chunk = chunk->Next.load(std::memory_order_acquire)) {
+                uint32_t count = chunk->Count.load(std::memory_order_acquire);
+                for (uint32_t i = 0; i < count; i++) {
+                    const Event& event = chunk->Events[i];
+                    /* Microseconds, with the nanoseconds as decimals */
+                    file << ",\n{\"ph\":\"X\",\"name\":\"" << event.Name
+                         << "\",\"pid\":1,\"tid\":" << tid << ",\"ts\":" << event.StartNs / 1000
+                         << "." << _Decimals(event.StartNs) << ",\"dur\":"
+                         << event.DurationNs / 1000 << "." << _Decimals(event.DurationNs)
+                         << "}";
+                }
+                events += count;
+            }
+            dropped += buffer.Dropped.load(std::memory_order_relaxed);
+        }
+        file << "\n]}\n";
+        std::cout << "CpuProfiler: " << events << " events written to " << path << " ("
+                  << dropped << " dropped)" << std::endl;
+    }
+
+    /*
+     * Export to VT_CPU_TRACE, if set
+     */
+    void ExportIfRequested() {
+        if (_enabled) {
+            ExportChromeTrace(_output_path);
+        }
+    }
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Event {
+        const char* Name;
+        uint64_t    StartNs;
+        uint64_t    DurationNs;
+    };
+
+    struct Chunk {
+        static const uint32_t Capacity = 4096;
+        Event                 Events[Capacity];
+        std::atomic<uint32_t> Count{0};
+        std::atomic<Chunk*>   Next{nullptr};
+    };
+
+    struct ThreadBuffer {
+        Chunk                 Head;
+        Chunk*                Tail       = &Head;
+        uint32_t              ChunkCount = 1;
+        std::atomic<uint64_t> Dropped{0};
+        std::string           Name;
+
+        ~ThreadBuffer() {
+            Chunk* chunk = Head.Next.load();
+            while (chunk) {
+                Chunk* next = chunk->Next.load();
+                delete chunk;
+                chunk = next;
+            }
+        }
+    };
+
+    CpuProfiler() : _start(Clock::now()) {
+        if (const char* path = std::getenv("VT_CPU_TRACE")) {
+            _enabled     = true;
+            _output_path = path;
+        }
+    }
+
+    /* Registered once per thread, the buffers live as long as the profiler */
+    ThreadBuffer& _LocalBuffer() {
+        thread_local ThreadBuffer* buffer = nullptr;
+        if (!buffer) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _buffers.emplace_back(new ThreadBuffer());
+            buffer       = _buffers.back().get();
+            buffer->Name = "Thread " + std::to_string(_buffers.size() - 1);
+        }
+        return *buffer;
+    }
+
+    static std::string _Decimals(uint64_t ns) {
+        std::string decimals = std::to_string(ns % 1000);
+        return std::string(3 - decimals.size(), '0') + decimals;
+    }
+
+    Clock::time_point                          _start;
+    bool                                       _enabled = false;
+    std::string                                _output_path;
+    uint32_t                                   _max_chunks_per_thread = 256; /* 1M events */
+    std::mutex                                 _mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> _buffers;
+};
+
+/*
+ * Records an event for its lifetime, nothing when the profiler isn't enabled
+ */
+class CpuScope {
+  public:
+    explicit CpuScope(const char* name) : _name(name) {
+        CpuProfiler& profiler = CpuProfiler::Get();
+        _start                = profiler.Enabled() ? profiler.Now() : 0;
+    }
+    ~CpuScope() {
+        CpuProfiler& profiler = CpuProfiler::Get();
+        if (profiler.Enabled()) {
+            profiler.Record(_name, _start, profiler.Now());
+        }
+    }
+
+  private:
+    const char* _name;
+    uint64_t    _start;
+};
+
+} // namespace Backend
@@ -1,5 +1,6 @@
 #include "Application.h"
 #include "Buffer.h"
+#include "SlotMap.h"
 
 #include <stdexcept>
 
@@ -29,10 +30,11 @@ struct MaterialProperties {
 };
 
 struct Material {
-    std::string        Name;
-    MaterialProperties Properties;
-    VkDescriptorSet    DescriptorSet;
-    VkPipeline*        Pipeline; /* Pointer to the pipeline used by this material */
+    std::string                 Name;
+    MaterialProperties          Properties;
+    Backend::MaterialShading    Shading; /* Variant: Backend::SelectVariant(Shading) */
+    VkDescriptorSet             DescriptorSet;
+    Backend::Handle<VkPipeline> Pipeline; /* In the renderer's pipeline pool */
 };
 
 struct Light {
@@ -105,7 +107,8 @@ class DeferredRenderer {
         _app._CreateImage(_gbuffer.Width, _gbuffer.Height, format,
                           VK_IMAGE_TILING_OPTIMAL, usage, 1, 0,
                           VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, attachment->Image,
-                          attachment->Memory);
+                          attachment->Memory, Backend::MemoryCategory::Attachment,
+                          "gbuffer attachment");
 
         attachment->View =
             _app._CreateImageView(attachment->Image, attachment->Format, aspect_mask);
@@ -198,13 +201,14 @@ class DeferredRenderer {
             VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
         dependencies[0].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
+        /* The lighting pass samples the attachments in the same command buffer */
         dependencies[1].srcSubpass   = 0;
         dependencies[1].dstSubpass   = VK_SUBPASS_EXTERNAL;
         dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-        dependencies[1].dstStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+        dependencies[1].dstStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
         dependencies[1].srcAccessMask =
             VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-        dependencies[1].dstAccessMask   = VK_ACCESS_MEMORY_READ_BIT;
+        dependencies[1].dstAccessMask   = VK_ACCESS_SHADER_READ_BIT;
         dependencies[1].dependencyFlags = VK_DEPENDENCY_BY_REGION_BIT;
 
         /* Renderpass */
@@ -218,7 +222,8 @@ class DeferredRenderer {
         renderpass_info.dependencyCount = 2;
         renderpass_info.pDependencies   = dependencies.data();
 
-        VK_ASSERT(vkCreateRenderPass(_app._device, &renderpass_info, nullptr,
+        VK_ASSERT(vkCreateRenderPass(_app._device, &renderpass_info,
+                                     Backend::HostCallbacks(),
                                      &_gbuffer.Renderpass),
                   "Failed to create RenderPass");
 
@@ -235,15 +240,9 @@ class DeferredRenderer {
      * -Bind OffscreenPipeline
      * -Bind Uniforms, Vertices and Indices
      * -Draw Background and Objects
+     * @param command_buffer : Command buffer of the frame, in the recording state
      */
-    void _RecordOffscreenRenderpass() {
-        /* Sync objects */
-        VkSemaphoreCreateInfo semaphore_info = {};
-        semaphore_info.sType                 = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-        VK_ASSERT(vkCreateSemaphore(_app._device, &semaphore_info, nullptr,
-                                    &_offscreen_semaphore),
-                  "Failed to create OffscreenSemaphore");
-
+    void _RecordOffscreenRenderpass(VkCommandBuffer command_buffer) {
         /* Clear attachment values */
         std::array<VkClearValue, 4> clear_vals;
         clear_vals[0].color        = {{0.f, 0.f, 0.f, 0.f}};
@@ -260,12 +259,7 @@ class DeferredRenderer {
         renderpass_info.clearValueCount = static_cast<uint32>(clear_vals.size());
         renderpass_info.pClearValues    = clear_vals.data();
 
-        /* Begin command recording */
-        if (_offscreen_cmd_buffer == VK_NULL_HANDLE) {
-            _offscreen_cmd_buffer = _app._BeginSingleTimeCommands();
-        }
-
-        vkCmdBeginRenderPass(_offscreen_cmd_buffer, &renderpass_info,
+        vkCmdBeginRenderPass(command_buffer, &renderpass_info,
                              VK_SUBPASS_CONTENTS_INLINE);
 
         VkViewport offscreen_viewport = {};
@@ -281,43 +275,92 @@ class DeferredRenderer {
         offscreen_scissor.extent.width  = _gbuffer.Width;
         offscreen_scissor.extent.height = _gbuffer.Height;
 
-        vkCmdSetViewport(_offscreen_cmd_buffer, 0, 1, &offscreen_viewport);
-        vkCmdSetScissor(_offscreen_cmd_buffer, 0, 1, &offscreen_scissor);
-        vkCmdBindPipeline(_offscreen_cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+        vkCmdSetViewport(command_buffer, 0, 1, &offscreen_viewport);
+        vkCmdSetScissor(command_buffer, 0, 1, &offscreen_scissor);
+        vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
                           _pipelines.Offscreen);
 
         VkDeviceSize offsets[1] = {0};
 
+        /* Bindless : the texture table is bound once, the draws push their material */
+        if (_app._bindless) {
+            vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                    _pipeline_layouts.Offscreen, 1, 1,
+                                    &_app._bindless_textures.Set, 0, nullptr);
+        }
+
         /* Background */
-        vkCmdBindDescriptorSets(_offscreen_cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                                _pipeline_layouts.Offscreen, 0, 1,
-                                &_descriptor_sets.Floor, 0, nullptr);
-        vkCmdBindVertexBuffers(_offscreen_cmd_buffer, VERTEX_BUFFER_BIND_ID, 1,
+        if (_app._bindless) {
+            vkCmdPushConstants(command_buffer, _pipeline_layouts.Offscreen,
+                               VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                               sizeof(Backend::MaterialPushConstants),
+                               &_material_constants.Floor);
+        } else {
+            vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                    _pipeline_layouts.Offscreen, 0, 1,
+                                    &_descriptor_sets.Floor, 0, nullptr);
+        }
+        vkCmdBindVertexBuffers(command_buffer, VERTEX_BUFFER_BIND_ID, 1,
                                &_app._vertex_buffer, offsets);
-        vkCmdBindIndexBuffer(_offscreen_cmd_buffer, _app._index_buffer, 0,
+        vkCmdBindIndexBuffer(command_buffer, _app._index_buffer, 0,
                              VK_INDEX_TYPE_UINT32);
-        vkCmdDrawIndexed(_offscreen_cmd_buffer,
+        vkCmdDrawIndexed(command_buffer,
                          static_cast<uint32>(_app._indices.size()), 1, 0, 0, 0);
 
         /* Object */
-        vkCmdBindDescriptorSets(_offscreen_cmd_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                                _pipeline_layouts.Offscreen, 0, 1,
-                                &_descriptor_sets.Model, 0, nullptr);
-        vkCmdBindVertexBuffers(_offscreen_cmd_buffer, VERTEX_BUFFER_BIND_ID, 1,
+        if (_app._bindless) {
+            vkCmdPushConstants(command_buffer, _pipeline_layouts.Offscreen,
+                               VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                               sizeof(Backend::MaterialPushConstants),
+                               &_material_constants.Model);
+        } else {
+            vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                    _pipeline_layouts.Offscreen, 0, 1,
+                                    &_descriptor_sets.Model, 0, nullptr);
+        }
+        vkCmdBindVertexBuffers(command_buffer, VERTEX_BUFFER_BIND_ID, 1,
                                &_app._vertex_buffer, offsets);
-        vkCmdBindIndexBuffer(_offscreen_cmd_buffer, _app._index_buffer, 0,
+        vkCmdBindIndexBuffer(command_buffer, _app._index_buffer, 0,
                              VK_INDEX_TYPE_UINT32);
-        vkCmdDrawIndexed(_offscreen_cmd_buffer,
+        vkCmdDrawIndexed(command_buffer,
                          static_cast<uint32>(_app._indices.size()), 3, 0, 0, 0);
 
-        _app._EndSingleTimeCommands(_offscreen_cmd_buffer);
+        vkCmdEndRenderPass(command_buffer);
+    }
+
+    /*
+     * Pipeline of a material, VK_NULL_HANDLE once the pipeline was destroyed
+     */
+    VkPipeline _MaterialPipeline(const Material& material) const {
+        const VkPipeline* pipeline = _material_pipelines.Get(material.Pipeline);
+        return pipeline ? *pipeline : VK_NULL_HANDLE;
+    }
+
+    /*
+     * Copy the live lights to the lighting pass uniform, the extra ones are dropped and
+     * the unused entries have a radius of 0
+     */
+    void _PackLights() {
+        const uint32 max_lights = sizeof(_ubo_frag_lights.Lights) / sizeof(Light);
+        uint32       count      = 0;
+        for (const Light& light : _lights) {
+            if (count == max_lights) {
+                break;
+            }
+            _ubo_frag_lights.Lights[count++] = light;
+        }
+        for (; count < max_lights; count++) {
+            _ubo_frag_lights.Lights[count] = {};
+        }
     }
 
     /*
-     *
-     *
+     * Record the composition pass of a frame with the app's parallel recorder
+     * (debug display and lighting pass are two entries of the draw list)
+     * @param command_buffer : Command buffer of the frame, in the recording state
+     * @param img_index : Swapchain image to render to
      */
-    void _RecordOnScreenRenderPass() {
+    void _RecordOnScreenRenderPass(VkCommandBuffer command_buffer, uint32 img_index) {
         VkClearValue clear_vals[2];
         clear_vals[0].color        = {{0.26f, 0.23f, 0.31f, 1.0f}};
         clear_vals[1].depthStencil = {1.f, 0};
@@ -325,71 +368,104 @@ class DeferredRenderer {
         VkRenderPassBeginInfo renderpass_info = {};
         renderpass_info.sType                 = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
         renderpass_info.renderPass            = _app._renderpass;
+        renderpass_info.framebuffer           = _app._swapchain_framebuffers[img_index];
         renderpass_info.renderArea.offset.x   = 0;
         renderpass_info.renderArea.offset.y   = 0;
         renderpass_info.renderArea.extent     = _app._swapchain_extent;
         renderpass_info.clearValueCount       = 2;
         renderpass_info.pClearValues          = clear_vals;
 
-        for (int32 i = 0; i < _app._command_buffers.size(); i++) {
-            renderpass_info.framebuffer = _app._swapchain_framebuffers[i];
-
-            _app._command_buffers[i] = _app._BeginSingleTimeCommands();
-
-            vkCmdBeginRenderPass(_app._command_buffers[i], &renderpass_info,
-                                 VK_SUBPASS_CONTENTS_INLINE);
-
-            VkViewport viewport = {};
-            viewport.x          = 0.f;
-            viewport.y          = 0.f;
-            viewport.width      = (float)_app._swapchain_extent.width;
-            viewport.height     = (float)_app._swapchain_extent.height;
-            viewport.minDepth   = 0.f;
-            viewport.maxDepth   = 1.f;
+        VkViewport viewport = {};
+        viewport.x          = 0.f;
+        viewport.y          = 0.f;
+        viewport.width      = (float)_app._swapchain_extent.width;
+        viewport.height     = (float)_app._swapchain_extent.height;
+        viewport.minDepth   = 0.f;
+        viewport.maxDepth   = 1.f;
+
+        bool DEBUG_DISPLAY = true;
+
+        /* Diffed bytewise by the recorder, no implicit padding */
+        struct OnScreenDraw {
+            VkPipeline Pipeline;
+            VkViewport Viewport;
+            uint32     InstanceCount;
+            uint32     FirstIndex;
+            int32      VertexOffset;
+            uint32     FirstInstance;
+        };
+        std::vector<OnScreenDraw> draws;
+        if (DEBUG_DISPLAY) {
+            draws.push_back({_pipelines.Debug, viewport, 1, 0, 0, 1});
+
+            viewport.x      = viewport.width * 0.5f;
+            viewport.y      = viewport.height * 0.5f;
+            viewport.width  = viewport.width * 0.5f;
+            viewport.height = viewport.height * 0.5f;
+        }
+        draws.push_back({_pipelines.Deferred, viewport, 6, 1, 0, 1});
 
+        auto record_slice = [&](VkCommandBuffer secondary, size_t first, size_t last) {
             VkRect2D scissor = {};
             scissor.offset   = {0, 0};
             scissor.extent   = _app._swapchain_extent;
-
-            vkCmdSetViewport(_app._command_buffers[i], 0, 1, &viewport);
-            vkCmdSetScissor(_app._command_buffers[i], 0, 1, &scissor);
+            vkCmdSetScissor(secondary, 0, 1, &scissor);
 
             VkDeviceSize offsets[1] = {0};
-            vkCmdBindDescriptorSets(
-                _app._command_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-                _pipeline_layouts.Deferred, 0, 1, &_descriptor_set, 0, nullptr);
-
-            bool DEBUG_DISPLAY = true;
-            if (DEBUG_DISPLAY) {
-                vkCmdBindPipeline(_app._command_buffers[i],
-                                  VK_PIPELINE_BIND_POINT_GRAPHICS, _pipelines.Debug);
-
-                vkCmdBindVertexBuffers(_app._command_buffers[i], VERTEX_BUFFER_BIND_ID,
-                                       1, &_app._vertex_buffer, offsets);
-                vkCmdBindIndexBuffer(_app._command_buffers[i], _app._index_buffer, 0,
-                                     VK_INDEX_TYPE_UINT32);
-                vkCmdDrawIndexed(_app._command_buffers[i],
-                                 static_cast<uint32>(_app._indices.size()), 1, 0, 0, 1);
-
-                viewport.x      = viewport.width * 0.5f;
-                viewport.y      = viewport.height * 0.5f;
-                viewport.width  = viewport.width * 0.5f;
-                viewport.height = viewport.height * 0.5f;
-                vkCmdSetViewport(_app._command_buffers[i], 0, 1, &viewport);
-            }
-
-            vkCmdBindPipeline(_app._command_buffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS,
-                              _pipelines.Deferred);
-
-            vkCmdBindVertexBuffers(_app._command_buffers[i], VERTEX_BUFFER_BIND_ID, 1,
+            vkCmdBindDescriptorSets(secondary, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                    _pipeline_layouts.Deferred, 0, 1, &_descriptor_set, 0,
+                                    nullptr);
+            vkCmdBindVertexBuffers(secondary, VERTEX_BUFFER_BIND_ID, 1,
                                    &_app._vertex_buffer, offsets);
-            vkCmdBindIndexBuffer(_app._command_buffers[i], _app._index_buffer, 0,
+            vkCmdBindIndexBuffer(secondary, _app._index_buffer, 0,
                                  VK_INDEX_TYPE_UINT32);
-            vkCmdDrawIndexed(_app._command_buffers[i],
-                             static_cast<uint32>(_app._indices.size()), 6, 1, 0, 1);
 
-            _app._EndSingleTimeCommands(_app._command_buffers[i]);
+            for (size_t i = first; i < last; i++) {
+                vkCmdSetViewport(secondary, 0, 1, &draws[i].Viewport);
+                vkCmdBindPipeline(secondary, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                  draws[i].Pipeline);
+                vkCmdDrawIndexed(secondary, static_cast<uint32>(_app._indices.size()),
+                                 draws[i].InstanceCount, draws[i].FirstIndex,
+                                 draws[i].VertexOffset, draws[i].FirstInstance);
+            }
+        };
+
+        uint64_t context_key = Backend::HashCombine((uint64_t)_descriptor_set,
+                                                    (uint64_t)_app._vertex_buffer);
+        _app._command_recorder.RecordRenderPass(command_buffer, _app._frames.CurrentIndex(),
+                                                _app._frames.Current().Scratch,
+                                                renderpass_info, draws, context_key,
+                                                record_slice);
+    }
+
+    /*
+     * Record G-Buffer and lighting passes in one command buffer of the current frame
+     * (recycled by the frame context once the frame's fence is signaled).
+     * Dead code : DeferredRenderer isn't compiled (main.cpp only includes Application.h),
+     * so the "gbuffer" and "lighting" GPU scopes never run. The compiled frame is timed
+     * by the "scene", "readback" and "uploads" scopes of Application.
+     * The pipeline statistics passes below are dead for the same reason, the compiled
+     * statistics come from the "scene" pass of Application::_DrawFrame().
+     */
+    VkCommandBuffer _RecordFrame(uint32 img_index) {
+        VkCommandBuffer command_buffer = _app._frames.BeginCommandBuffer();
+        _app._gpu_profiler.BeginFrame(command_buffer, _app._frames.CurrentIndex());
+        _app._pipeline_stats.BeginFrame(command_buffer, _app._frames.CurrentIndex());
+        {
+            Backend::GpuScope scope(_app._gpu_profiler, command_buffer, "gbuffer");
+            uint32_t pass = _app._pipeline_stats.BeginPass(command_buffer, "gbuffer");
+            _RecordOffscreenRenderpass(command_buffer);
+            _app._pipeline_stats.EndPass(command_buffer, pass);
+        }
+        {
+            /* Lighting and debug display share the on-screen pass */
+            Backend::GpuScope scope(_app._gpu_profiler, command_buffer, "lighting");
+            uint32_t pass = _app._pipeline_stats.BeginPass(command_buffer, "lighting");
+            _RecordOnScreenRenderPass(command_buffer, img_index);
+            _app._pipeline_stats.EndPass(command_buffer, pass);
         }
+        VK_ASSERT(vkEndCommandBuffer(command_buffer), "Failed to record CommandBuffer");
+        return command_buffer;
     }
 
   private:
@@ -446,13 +522,19 @@ class DeferredRenderer {
         VkDescriptorSet Floor;
     } _descriptor_sets;
 
+    /* Texture indices in the bindless table (used instead of _descriptor_sets) */
+    struct {
+        Backend::MaterialPushConstants Model;
+        Backend::MaterialPushConstants Floor;
+    } _material_constants;
+
     VkDescriptorSet       _descriptor_set;
     VkDescriptorSetLayout _descriptor_layout;
 
-    /* For rendering the scene to the G-Buffer attachments */
-    VkCommandBuffer _offscreen_cmd_buffer = VK_NULL_HANDLE;
-    /* For synchronizing between offscreen and onscreen scene rendering */
-    VkSemaphore _offscreen_semaphore = VK_NULL_HANDLE;
+    /* Scene entities, referenced by handle (a destroyed entry leaves stale handles) */
+    Backend::SlotMap<Material>   _materials;
+    Backend::SlotMap<Light>      _lights;
+    Backend::SlotMap<VkPipeline> _material_pipelines;
 };
 
 //==========SCENE=================
@@ -0,0 +1,110 @@
+#pragma once
+#include "HostAllocator.h"
+#include "MemoryTracker.h"
+#include "TimelineSync.h"
+
+#include <vulkan/vulkan.h>
+
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <utility>
+
+namespace Backend {
+
+/*
+ * Resources destroyed once the GPU is done with them, without waiting for the device.
+ * An entry keeps the QueueTimeline value of the last submission that used the
+ * resource; Drain() (once per frame) runs the entries the timeline has passed.
+ */
+class DeletionQueue {
+  public:
+    /*
+     * @param memory_tracker (Optional) : Frees the memory of PushBuffer()/PushImage()
+     */
+    void Init(QueueTimeline& timeline, MemoryTracker* memory_tracker = nullptr) {
+        _timeline       = &timeline;
+        _memory_tracker = memory_tracker;
+    }
+
+    /*
+     * @param destroy : Destroys the resource, called on the thread calling Drain()
+     * @param last_use : Timeline value of the last submission using the resource
+     */
+    void Push(std::function<void()> destroy, uint64_t last_use) {
+        _entries.push_back({last_use, std::move(destroy)});
+    }
+
+    /*
+     * The resource was used up to the last submission
+     */
+    void Push(std::function<void()> destroy) {
+        Push(std::move(destroy), _timeline->LastSubmitted());
+    }
+
+    void PushBuffer(VkDevice device, VkBuffer buffer, VkDeviceMemory memory) {
+        Push([=] {
+            vkDestroyBuffer(device, buffer, HostCallbacks());
+            _FreeMemory(device, memory);
+        });
+    }
+
+    void PushImage(VkDevice device, VkImage image, VkImageView view, VkDeviceMemory memory) {
+        Push([=] {
+            vkDestroyImageView(device, view, HostCallbacks());
+            vkDestroyImage(device, image, HostCallbacks());
+            _FreeMemory(device, memory);
+        });
+    }
+
+    /*
+     * Destroy what the GPU doesn't use anymore. Stops at the first entry still in use
+     * (an entry pushed with an older value than the previous ones is only delayed).
+     */
+    void Drain() {
+        while (!_entries.empty() && _timeline->IsComplete(_entries.front().LastUse)) {
+            _entries.front().Destroy();
+            _entries.pop_front();
+            _destroyed++;
+        }
+    }
+
+    /*
+     * Destroy everything, the device must be idle. Reports what was still pending.
+     */
+    void Flush() {
+        if (!_entries.empty()) {
+            std::cout << "DeletionQueue: " << _entries.size()
+                      << " entries still pending at shutdown (" << _destroyed
+                      << " destroyed in flight)" << std::endl;
+        }
+        while (!_entries.empty()) {
+            _entries.front().Destroy();
+            _entries.pop_front();
+        }
+    }
+
+    size_t PendingCount() const { return _entries.size(); }
+    size_t DestroyedCount() const { return _destroyed; }
+
+  private:
+    void _FreeMemory(VkDevice device, VkDeviceMemory memory) {
+        if (_memory_tracker) {
+            _memory_tracker->Free(memory);
+        } else {
+            vkFreeMemory(device, memory, HostCallbacks());
+        }
+    }
+
+    struct Entry {
+        uint64_t              LastUse;
+        std::function<void()> Destroy;
+    };
+
+    QueueTimeline*    _timeline       = nullptr;
+    MemoryTracker*    _memory_tracker = nullptr;
+    std::deque<Entry> _entries;
+    size_t            _destroyed = 0;
+};
+
+} // namespace Backend
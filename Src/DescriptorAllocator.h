@@ -0,0 +1,332 @@
+#pragma once
+#include "HostAllocator.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Backend {
+
+/*
+ * Set layouts are created once per distinct list of bindings.
+ * Two callers asking for the same bindings get the same VkDescriptorSetLayout.
+ */
+class DescriptorLayoutCache {
+  public:
+    void Init(VkDevice device) { _device = device; }
+
+    /*
+     * Returns the layout matching the bindings, creating it on the first request
+     * @param bindings : Order doesn't matter, they are sorted by binding index
+     * @param flags (Optional) : VkDescriptorSetLayoutCreateFlags of the layout
+     * @param next (Optional) : pNext chain of the create info (not part of the key)
+     */
+    VkDescriptorSetLayout
+    CreateLayout(std::vector<VkDescriptorSetLayoutBinding> bindings,
+                 VkDescriptorSetLayoutCreateFlags flags = 0, const void* next = nullptr) {
+        std::sort(bindings.begin(), bindings.end(),
+                  [](const VkDescriptorSetLayoutBinding& a,
+                     const VkDescriptorSetLayoutBinding& b) {
+                      return a.binding < b.binding;
+                  });
+
+        LayoutKey key = {bindings, flags};
+        auto      it  = _layouts.find(key);
+        if (it != _layouts.end()) {
+            return it->second;
+        }
+
+        VkDescriptorSetLayoutCreateInfo layout_info = {};
+        layout_info.sType        = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        layout_info.pNext        = next;
+        layout_info.flags        = flags;
+        layout_info.bindingCount = static_cast<uint32_t>(bindings.size());
+        layout_info.pBindings    = bindings.data();
+
+        VkDescriptorSetLayout layout;
+        if (vkCreateDescriptorSetLayout(_device, &layout_info, HostCallbacks(), &layout) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("Failed to create descriptor set layout");
+        }
+
+        _bindings.emplace(layout, key.Bindings);
+        _layouts.emplace(std::move(key), layout);
+        return layout;
+    }
+
+    /*
+     * Bindings a layout was created with (sorted by binding index)
+     * @param layout : A layout created by this cache
+     */
+    const std::vector<VkDescriptorSetLayoutBinding>&
+    GetBindings(VkDescriptorSetLayout layout) const {
+        auto it = _bindings.find(layout);
+        if (it == _bindings.end()) {
+            throw std::runtime_error("Descriptor set layout not created by the cache");
+        }
+        return it->second;
+    }
+
+    size_t LayoutCount() const { return _layouts.size(); }
+
+    void Destroy() {
+        for (auto& layout : _layouts) {
+            vkDestroyDescriptorSetLayout(_device, layout.second, HostCallbacks());
+        }
+        _layouts.clear();
+        _bindings.clear();
+    }
+
+  private:
+    struct LayoutKey {
+        std::vector<VkDescriptorSetLayoutBinding> Bindings;
+        VkDescriptorSetLayoutCreateFlags          Flags;
+
+        bool operator==(const LayoutKey& other) const {
+            if (Flags != other.Flags || Bindings.size() != other.Bindings.size()) {
+                return false;
+            }
+            for (size_t i = 0; i < Bindings.size(); i++) {
+                const VkDescriptorSetLayoutBinding& a = Bindings[i];
+                const VkDescriptorSetLayoutBinding& b = other.Bindings[i];
+                if (a.binding != b.binding || a.descriptorType != b.descriptorType ||
+                    a.descriptorCount != b.descriptorCount ||
+                    a.stageFlags != b.stageFlags ||
+                    a.pImmutableSamplers != b.pImmutableSamplers) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    };
+
+    struct LayoutKeyHash {
+        size_t operator()(const LayoutKey& key) const {
+            size_t hash = std::hash<uint32_t>()(key.Flags);
+            for (const auto& binding : key.Bindings) {
+                /* binding | type | count | stages packed in one word */
+                size_t packed = static_cast<size_t>(binding.binding) |
+                                static_cast<size_t>(binding.descriptorType) << 8 |
+                                static_cast<size_t>(binding.descriptorCount) << 16 |
+                                static_cast<size_t>(binding.stageFlags) << 32;
+                hash ^= std::hash<size_t>()(packed) + 0x9e3779b9 + (hash << 6) +
+                        (hash >> 2);
+            }
+            return hash;
+        }
+    };
+
+    VkDevice                                                              _device;
+    std::unordered_map<LayoutKey, VkDescriptorSetLayout, LayoutKeyHash> _layouts;
+    std::unordered_map<VkDescriptorSetLayout, std::vector<VkDescriptorSetLayoutBinding>>
+        _bindings;
+};
+
+/*
+ * Descriptor sets are allocated from a chain of pools : when the current pool is
+ * full a new one is created (or recycled) and the allocation is retried.
+ * Sets are never freed one by one, ResetPools() gives back every set at once
+ * (ex: a per frame allocator is reset when the frame's fence is signaled).
+ * A layout needing more descriptors than a whole pool holds gets a dedicated pool sized
+ * from its bindings (only when the allocator knows the layout cache).
+ */
+class DescriptorAllocator {
+  public:
+    /*
+     * @param device : Device that owns the pools
+     * @param sets_per_pool (Optional) : maxSets of each pool of the chain
+     * @param layouts (Optional) : Cache the layouts were created with, used to size a
+     *                             dedicated pool when a set doesn't fit the ratios
+     */
+    void Init(VkDevice device, uint32_t sets_per_pool = 256,
+              const DescriptorLayoutCache* layouts = nullptr) {
+        _device        = device;
+        _sets_per_pool = sets_per_pool;
+        _layouts       = layouts;
+    }
+
+    /*
+     * Allocate a set, growing the chain if the current pool is exhausted
+     * @param layout : Layout of the set
+     * @param target : Handle to the set to be allocated
+     * @param next (Optional) : pNext chain of the allocate info
+     */
+    void Allocate(VkDescriptorSetLayout layout, VkDescriptorSet& target,
+                  const void* next = nullptr) {
+        if (_current_pool == VK_NULL_HANDLE) {
+            _current_pool = _GrabPool();
+        }
+
+        VkDescriptorSetAllocateInfo alloc_info = {};
+        alloc_info.sType              = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        alloc_info.pNext              = next;
+        alloc_info.descriptorPool     = _current_pool;
+        alloc_info.descriptorSetCount = 1;
+        alloc_info.pSetLayouts        = &layout;
+
+        VkResult result = vkAllocateDescriptorSets(_device, &alloc_info, &target);
+        if (result == VK_ERROR_FRAGMENTED_POOL || result == VK_ERROR_OUT_OF_POOL_MEMORY) {
+            /* Pool is full, chain a new one */
+            _current_pool            = _GrabPool();
+            alloc_info.descriptorPool = _current_pool;
+            result = vkAllocateDescriptorSets(_device, &alloc_info, &target);
+        }
+        bool pool_full =
+            result == VK_ERROR_FRAGMENTED_POOL || result == VK_ERROR_OUT_OF_POOL_MEMORY;
+        if (pool_full && _layouts != nullptr) {
+            /* Doesn't fit even an empty pool, the layout exceeds the ratios */
+            alloc_info.descriptorPool = _CreateDedicatedPool(layout);
+            result = vkAllocateDescriptorSets(_device, &alloc_info, &target);
+        }
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate descriptor sets");
+        }
+        _allocated_sets++;
+    }
+
+    /*
+     * Allocate a list of sets sharing the same layout
+     * @param count : Number of sets
+     * @param target : Resized to count
+     */
+    void Allocate(VkDescriptorSetLayout layout, size_t count,
+                  std::vector<VkDescriptorSet>& target) {
+        target.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            Allocate(layout, target[i]);
+        }
+    }
+
+    /*
+     * Give back every set allocated since the last reset. The pools are kept for reuse.
+     * The sets must not be in use by the GPU anymore.
+     */
+    void ResetPools() {
+        for (VkDescriptorPool pool : _used_pools) {
+            vkResetDescriptorPool(_device, pool, 0);
+            _free_pools.push_back(pool);
+        }
+        _used_pools.clear();
+        for (VkDescriptorPool pool : _dedicated_pools) {
+            vkDestroyDescriptorPool(_device, pool, HostCallbacks());
+        }
+        _dedicated_pools.clear();
+        _current_pool   = VK_NULL_HANDLE;
+        _allocated_sets = 0;
+    }
+
+    size_t PoolCount() const {
+        return _used_pools.size() + _free_pools.size() + _dedicated_pools.size();
+    }
+    size_t AllocatedSets() const { return _allocated_sets; }
+
+    void Destroy() {
+        ResetPools();
+        for (VkDescriptorPool pool : _free_pools) {
+            vkDestroyDescriptorPool(_device, pool, HostCallbacks());
+        }
+        _free_pools.clear();
+    }
+
+  private:
+    VkDescriptorPool _GrabPool() {
+        VkDescriptorPool pool;
+        if (!_free_pools.empty()) {
+            pool = _free_pools.back();
+            _free_pools.pop_back();
+        } else {
+            pool = _CreatePool();
+        }
+        _used_pools.push_back(pool);
+        return pool;
+    }
+
+    VkDescriptorPool _CreatePool() {
+        /* Descriptors per set, on average */
+        static const std::pair<VkDescriptorType, float> pool_ratios[] = {
+            {VK_DESCRIPTOR_TYPE_SAMPLER, 0.5f},
+            {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 2.f},
+            {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 4.f},
+            {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 4.f},
+            {VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, 0.5f},
+            {VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER, 0.5f},
+            {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, 1.f},
+            {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1.f},
+            {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0.5f},
+            {VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT, 0.5f},
+        };
+
+        std::vector<VkDescriptorPoolSize> pool_sizes;
+        for (const auto& ratio : pool_ratios) {
+            VkDescriptorPoolSize pool_size = {};
+            pool_size.type                 = ratio.first;
+            pool_size.descriptorCount =
+                static_cast<uint32_t>(ratio.second * _sets_per_pool);
+            pool_sizes.push_back(pool_size);
+        }
+
+        VkDescriptorPoolCreateInfo pool_info = {};
+        pool_info.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+        pool_info.pPoolSizes    = pool_sizes.data();
+        pool_info.maxSets       = _sets_per_pool;
+
+        VkDescriptorPool pool;
+        if (vkCreateDescriptorPool(_device, &pool_info, HostCallbacks(), &pool) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("Failed to create descriptor pool");
+        }
+        return pool;
+    }
+
+    /*
+     * Pool holding exactly one set of the layout. Destroyed by the next ResetPools().
+     * @param layout : A layout created by the allocator's layout cache
+     */
+    VkDescriptorPool _CreateDedicatedPool(VkDescriptorSetLayout layout) {
+        std::vector<VkDescriptorPoolSize> pool_sizes;
+        for (const auto& binding : _layouts->GetBindings(layout)) {
+            if (binding.descriptorCount == 0) {
+                continue;
+            }
+            auto it = std::find_if(pool_sizes.begin(), pool_sizes.end(),
+                                   [&](const VkDescriptorPoolSize& size) {
+                                       return size.type == binding.descriptorType;
+                                   });
+            if (it == pool_sizes.end()) {
+                pool_sizes.push_back({binding.descriptorType, binding.descriptorCount});
+            } else {
+                it->descriptorCount += binding.descriptorCount;
+            }
+        }
+
+        VkDescriptorPoolCreateInfo pool_info = {};
+        pool_info.sType         = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+        pool_info.poolSizeCount = static_cast<uint32_t>(pool_sizes.size());
+        pool_info.pPoolSizes    = pool_sizes.data();
+        pool_info.maxSets       = 1;
+
+        VkDescriptorPool pool;
+        if (vkCreateDescriptorPool(_device, &pool_info, HostCallbacks(), &pool) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("Failed to create dedicated descriptor pool");
+        }
+        _dedicated_pools.push_back(pool);
+        return pool;
+    }
+
+    VkDevice                      _device;
+    uint32_t                      _sets_per_pool  = 256;
+    size_t                        _allocated_sets = 0;
+    const DescriptorLayoutCache*  _layouts        = nullptr;
+    VkDescriptorPool              _current_pool   = VK_NULL_HANDLE;
+    std::vector<VkDescriptorPool> _used_pools;
+    std::vector<VkDescriptorPool> _free_pools;
+    std::vector<VkDescriptorPool> _dedicated_pools;
+};
+
+} // namespace Backend
@@ -0,0 +1,305 @@
+#pragma once
+#include "DescriptorAllocator.h"
+#include "HostAllocator.h"
+
+#include <vulkan/vulkan.h>
+
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+namespace Backend {
+
+/* One descriptor of a template record, every entry has the same stride */
+union DescriptorData {
+    VkDescriptorImageInfo  Image;
+    VkDescriptorBufferInfo Buffer;
+    VkBufferView           TexelBuffer;
+};
+
+/*
+ * vkUpdateDescriptorSetWithTemplate template for a list of bindings of a layout.
+ * The data of a set is a record of DescriptorData, one per descriptor, in binding order.
+ * Update templates are core in Vulkan 1.1 : on a 1.0 device no VkDescriptorUpdateTemplate
+ * is created and DescriptorWriter::Flush() falls back to vkUpdateDescriptorSets.
+ */
+struct DescriptorUpdateTemplate {
+    VkDevice                   Device;
+    VkDescriptorUpdateTemplate Template = VK_NULL_HANDLE;
+    uint32_t                   SlotCount = 0; /* DescriptorData per record */
+    std::vector<uint32_t>      BindingSlots;  /* Binding index -> first slot */
+    std::vector<VkDescriptorSetLayoutBinding> Bindings;
+
+    /*
+     * @param device : Device that owns the layout
+     * @param physical_dev : Its physical device, the template needs apiVersion 1.1
+     * @param layout : Layout of the sets that will be updated
+     * @param bindings : Bindings written by the template, usually every binding of the
+     *                   layout (DescriptorLayoutCache::GetBindings)
+     */
+    void Init(VkDevice device, VkPhysicalDevice physical_dev,
+              VkDescriptorSetLayout                            layout,
+              const std::vector<VkDescriptorSetLayoutBinding>& bindings) {
+        Device   = device;
+        Bindings = bindings;
+
+        std::vector<VkDescriptorUpdateTemplateEntry> entries;
+        for (const auto& binding : bindings) {
+            VkDescriptorUpdateTemplateEntry entry = {};
+            entry.dstBinding                      = binding.binding;
+            entry.dstArrayElement                 = 0;
+            entry.descriptorCount                 = binding.descriptorCount;
+            entry.descriptorType                  = binding.descriptorType;
+            entry.offset                          = SlotCount * sizeof(DescriptorData);
+            entry.stride                          = sizeof(DescriptorData);
+            entries.push_back(entry);
+
+            if (BindingSlots.size() <= binding.binding) {
+                BindingSlots.resize(binding.binding + 1, UINT32_MAX);
+            }
+            BindingSlots[binding.binding] = SlotCount;
+            SlotCount += binding.descriptorCount;
+        }
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physical_dev, &properties);
+        if (properties.apiVersion < VK_API_VERSION_1_1) {
+            return;
+        }
+
+        VkDescriptorUpdateTemplateCreateInfo template_info = {};
+        template_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO;
+        template_info.descriptorUpdateEntryCount = static_cast<uint32_t>(entries.size());
+        template_info.pDescriptorUpdateEntries   = entries.data();
+        template_info.templateType = VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET;
+        template_info.descriptorSetLayout = layout;
+
+        if (vkCreateDescriptorUpdateTemplate(Device, &template_info,
+                                             HostCallbacks(), &Template) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("Failed to create descriptor update template");
+        }
+    }
+
+    void Destroy() {
+        if (Template != VK_NULL_HANDLE) {
+            vkDestroyDescriptorUpdateTemplate(Device, Template, HostCallbacks());
+            Template = VK_NULL_HANDLE;
+        }
+    }
+};
+
+/*
+ * Gathers the descriptor writes of a frame and applies them in one Flush().
+ * Every descriptor of a template must be written before the flush.
+ * The record storage is kept between flushes, so a frame doesn't allocate once the
+ * writer has seen its largest frame.
+ */
+class DescriptorWriter {
+  public:
+    void Init(VkDevice device) { _device = device; }
+
+    /*
+     * Start the record of a set, the following writes go to this set
+     * @param set : Set to be updated on Flush()
+     * @param update_template : Template matching the set layout
+     */
+    DescriptorWriter& Begin(VkDescriptorSet set, const DescriptorUpdateTemplate& update_template) {
+        Record record      = {};
+        record.Set         = set;
+        record.Template    = &update_template;
+        record.FirstSlot   = _data.size();
+        _data.resize(_data.size() + update_template.SlotCount);
+        _records.push_back(record);
+        return *this;
+    }
+
+    /*
+     * @param binding : Binding of the descriptor
+     * @param info : Buffer, offset and range
+     * @param element (Optional) : Array element for arrays of descriptors
+     */
+    DescriptorWriter& WriteBuffer(uint32_t binding, const VkDescriptorBufferInfo& info,
+                                  uint32_t element = 0) {
+        _Slot(binding, element).Buffer = info;
+        return *this;
+    }
+
+    DescriptorWriter& WriteImage(uint32_t binding, const VkDescriptorImageInfo& info,
+                                 uint32_t element = 0) {
+        _Slot(binding, element).Image = info;
+        return *this;
+    }
+
+    /*
+     * Update every recorded set, then clear the records (the storage is kept).
+     * Records whose template has no VkDescriptorUpdateTemplate (1.0 device) are
+     * written with a single vkUpdateDescriptorSets, one write per descriptor.
+     */
+    void Flush() {
+        for (const Record& record : _records) {
+            if (record.Template->Template != VK_NULL_HANDLE) {
+                vkUpdateDescriptorSetWithTemplate(_device, record.Set,
+                                                  record.Template->Template,
+                                                  &_data[record.FirstSlot]);
+            } else {
+                _AppendWrites(record);
+            }
+        }
+        if (!_writes.empty()) {
+            vkUpdateDescriptorSets(_device, static_cast<uint32_t>(_writes.size()),
+                                   _writes.data(), 0, nullptr);
+        }
+        _records.clear();
+        _data.clear();
+        _writes.clear();
+    }
+
+    size_t PendingSets() const { return _records.size(); }
+
+  private:
+    struct Record {
+        VkDescriptorSet                 Set;
+        const DescriptorUpdateTemplate* Template;
+        size_t                          FirstSlot;
+    };
+
+    DescriptorData& _Slot(uint32_t binding, uint32_t element) {
+        if (_records.empty()) {
+            throw std::runtime_error("DescriptorWriter::Begin must be called before writes");
+        }
+        const Record&                   record          = _records.back();
+        const DescriptorUpdateTemplate& update_template = *record.Template;
+        if (binding >= update_template.BindingSlots.size() ||
+            update_template.BindingSlots[binding] == UINT32_MAX) {
+            throw std::runtime_error("Binding is not part of the update template");
+        }
+        for (const auto& layout_binding : update_template.Bindings) {
+            if (layout_binding.binding == binding &&
+                element >= layout_binding.descriptorCount) {
+                throw std::runtime_error("Array element out of the binding's range");
+            }
+        }
+        return _data[record.FirstSlot + update_template.BindingSlots[binding] + element];
+    }
+
+    /* One VkWriteDescriptorSet per descriptor, DescriptorData isn't a packed array */
+    void _AppendWrites(const Record& record) {
+        for (const auto& binding : record.Template->Bindings) {
+            size_t first =
+                record.FirstSlot + record.Template->BindingSlots[binding.binding];
+            for (uint32_t element = 0; element < binding.descriptorCount; element++) {
+                DescriptorData& data = _data[first + element];
+
+                VkWriteDescriptorSet write = {};
+                write.sType                = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                write.dstSet               = record.Set;
+                write.dstBinding           = binding.binding;
+                write.dstArrayElement      = element;
+                write.descriptorType       = binding.descriptorType;
+                write.descriptorCount      = 1;
+                switch (binding.descriptorType) {
+                case VK_DESCRIPTOR_TYPE_SAMPLER:
+                case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER:
+                case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE:
+                case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE:
+                case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT:
+                    write.pImageInfo = &data.Image;
+                    break;
+                case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER:
+                case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER:
+                    write.pTexelBufferView = &data.TexelBuffer;
+                    break;
+                default:
+                    write.pBufferInfo = &data.Buffer;
+                    break;
+                }
+                _writes.push_back(write);
+            }
+        }
+    }
+
+    VkDevice                          _device;
+    std::vector<Record>               _records;
+    std::vector<DescriptorData>       _data;
+    std::vector<VkWriteDescriptorSet> _writes; /* 1.0 fallback, kept between flushes */
+};
+
+/*
+ * Compare the VkWriteDescriptorSet path (one vkUpdateDescriptorSets per set) with the
+ * template writer, on a layout of one uniform buffer (binding 0) and one combined
+ * image sampler (binding 1).
+ * @param physical_dev : Without 1.1 both paths end up in vkUpdateDescriptorSets
+ * @param layout_cache : Cache that created the layout
+ * @param buffer_info : Written at binding 0 of every set
+ * @param image_info : Written at binding 1 of every set
+ * @param set_count : Sets updated per iteration ("frame")
+ * @param iterations : Number of frames
+ */
+inline void BenchmarkDescriptorWrites(VkDevice device, VkPhysicalDevice physical_dev,
+                                      DescriptorLayoutCache&        layout_cache,
+                                      VkDescriptorSetLayout         layout,
+                                      const VkDescriptorBufferInfo& buffer_info,
+                                      const VkDescriptorImageInfo&  image_info,
+                                      uint32_t set_count = 1024, uint32_t iterations = 100) {
+    DescriptorAllocator allocator;
+    allocator.Init(device);
+    std::vector<VkDescriptorSet> sets;
+    allocator.Allocate(layout, set_count, sets);
+
+    using Clock = std::chrono::high_resolution_clock;
+
+    /* === Raw writes === */
+    auto raw_start = Clock::now();
+    for (uint32_t it = 0; it < iterations; it++) {
+        for (VkDescriptorSet set : sets) {
+            VkWriteDescriptorSet descriptor_write[2] = {};
+            descriptor_write[0].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptor_write[0].dstSet          = set;
+            descriptor_write[0].dstBinding      = 0;
+            descriptor_write[0].descriptorType  = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            descriptor_write[0].descriptorCount = 1;
+            descriptor_write[0].pBufferInfo     = &buffer_info;
+
+            descriptor_write[1].sType           = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            descriptor_write[1].dstSet          = set;
+            descriptor_write[1].dstBinding      = 1;
+            descriptor_write[1].descriptorType  = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            descriptor_write[1].descriptorCount = 1;
+            descriptor_write[1].pImageInfo      = &image_info;
+
+            vkUpdateDescriptorSets(device, 2, descriptor_write, 0, nullptr);
+        }
+    }
+    auto raw_end = Clock::now();
+
+    /* === Template writer === */
+    DescriptorUpdateTemplate update_template;
+    update_template.Init(device, physical_dev, layout, layout_cache.GetBindings(layout));
+    DescriptorWriter writer;
+    writer.Init(device);
+
+    auto template_start = Clock::now();
+    for (uint32_t it = 0; it < iterations; it++) {
+        for (VkDescriptorSet set : sets) {
+            writer.Begin(set, update_template)
+                .WriteBuffer(0, buffer_info)
+                .WriteImage(1, image_info);
+        }
+        writer.Flush();
+    }
+    auto template_end = Clock::now();
+
+    update_template.Destroy();
+    allocator.Destroy();
+
+    double raw_ms = std::chrono::duration<double, std::milli>(raw_end - raw_start).count();
+    double template_ms =
+        std::chrono::duration<double, std::milli>(template_end - template_start).count();
+    std::cout << "DescriptorWrites(" << set_count << " sets x " << iterations
+              << "): raw " << raw_ms / iterations << "ms/frame, template "
+              << template_ms / iterations << "ms/frame" << std::endl;
+}
+
+} // namespace Backend
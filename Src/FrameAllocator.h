@@ -0,0 +1,207 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace Backend {
+
+/*
+ * Global operator new calls, counted when ENABLE_HEAP_COUNTER is defined (makefile
+ * HEAP_COUNTER=1, the replacement operators are in main.cpp). Read ThreadAllocations()
+ * around a piece of code to check that it doesn't allocate, the other threads (log
+ * writer, readback, job workers) aren't counted there.
+ */
+class HeapCounter {
+  public:
+    static bool Enabled() {
+#ifdef ENABLE_HEAP_COUNTER
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    /* Every thread */
+    static uint64_t Allocations() { return _Counter().load(std::memory_order_relaxed); }
+    /* Calling thread only */
+    static uint64_t ThreadAllocations() { return _thread_counter; }
+
+    /* Called by the replacement operator new */
+    static void OnAllocation() {
+        _Counter().fetch_add(1, std::memory_order_relaxed);
+        _thread_counter++;
+    }
+
+  private:
+    /* Constant initialized : safe in operator new, before any constructor ran */
+    static inline thread_local uint64_t _thread_counter = 0;
+
+    static std::atomic<uint64_t>& _Counter() {
+        static std::atomic<uint64_t> counter{0};
+        return counter;
+    }
+};
+
+/*
+ * Bump allocator for the temporaries of a frame : Allocate() moves an offset in one
+ * block, Reset() gives everything back at once (FrameContextRing does it once the
+ * frame's submission is done). Nothing is freed individually.
+ * When the block is full, the allocation comes from the heap and is counted in
+ * OverflowCount(); the next Reset() grows the block to the peak of the frame, so a
+ * steady frame loop doesn't touch the heap.
+ * Not thread safe : one allocator per frame, used by the thread recording it.
+ */
+class LinearAllocator {
+  public:
+    LinearAllocator() = default;
+    LinearAllocator(const LinearAllocator&) = delete;
+    LinearAllocator& operator=(const LinearAllocator&) = delete;
+
+    /* Containers of frames (FrameContextRing) */
+    LinearAllocator(LinearAllocator&& other) noexcept { *this = std::move(other); }
+    LinearAllocator& operator=(LinearAllocator&& other) noexcept {
+        std::swap(_block, other._block);
+        std::swap(_capacity, other._capacity);
+        std::swap(_offset, other._offset);
+        std::swap(_peak, other._peak);
+        std::swap(_overflow_count, other._overflow_count);
+        _overflow.swap(other._overflow);
+        return *this;
+    }
+
+    /*
+     * @param capacity : Bytes of the block, grown by Reset() if a frame needs more
+     */
+    void Init(size_t capacity) {
+        Destroy();
+        _block    = static_cast<uint8_t*>(std::malloc(capacity));
+        _capacity = _block ? capacity : 0;
+    }
+
+    /*
+     * @param alignment : Power of two
+     * @return : Valid until the next Reset(), nullptr only if the heap is exhausted
+     */
+    void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t)) {
+        size_t offset = (_offset + alignment - 1) & ~(alignment - 1);
+        if (offset + size <= _capacity) {
+            _offset = offset + size;
+            _peak   = std::max(_peak, _offset);
+            return _block + offset;
+        }
+
+        /* Past the block : counted in the peak as if it had room */
+        _peak = std::max(_peak, offset + size);
+        void* memory = std::malloc(size + alignment);
+        if (!memory) {
+            return nullptr;
+        }
+        _overflow.push_back(memory);
+        _overflow_count++;
+        uintptr_t aligned = (reinterpret_cast<uintptr_t>(memory) + alignment - 1) &
+                            ~uintptr_t(alignment - 1);
+        return reinterpret_cast<void*>(aligned);
+    }
+
+    template <typename T>
+    T* AllocateArray(size_t count) {
+        return static_cast<T*>(Allocate(count * sizeof(T), alignof(T)));
+    }
+
+    /*
+     * Every allocation since the last reset becomes invalid
+     */
+    void Reset() {
+        if (!_overflow.empty()) {
+            for (void* memory : _overflow) {
+                std::free(memory);
+            }
+            _overflow.clear();
+            /* Room for the frame that overflowed, plus some slack */
+            Init(_peak + _peak / 4);
+        }
+        _offset = 0;
+    }
+
+    size_t Used() const { return _offset; }
+    size_t Capacity() const { return _capacity; }
+    /* Largest frame so far, overflow included */
+    size_t Peak() const { return _peak; }
+    /* Allocations that didn't fit in the block, since the start */
+    uint64_t OverflowCount() const { return _overflow_count; }
+
+    void Destroy() {
+        for (void* memory : _overflow) {
+            std::free(memory);
+        }
+        _overflow.clear();
+        std::free(_block);
+        _block    = nullptr;
+        _capacity = 0;
+        _offset   = 0;
+    }
+
+    ~LinearAllocator() { Destroy(); }
+
+  private:
+    uint8_t*           _block          = nullptr;
+    size_t             _capacity       = 0;
+    size_t             _offset         = 0;
+    size_t             _peak           = 0;
+    uint64_t           _overflow_count = 0;
+    std::vector<void*> _overflow; /* Heap allocations of the frame, freed by Reset() */
+};
+
+/*
+ * Standard allocator adapter over a LinearAllocator, deallocate() does nothing.
+ * The container must not outlive the frame (see FrameVector).
+ */
+template <typename T>
+class FrameStlAllocator {
+  public:
+    using value_type = T;
+
+    FrameStlAllocator(LinearAllocator& allocator) : _allocator(&allocator) {}
+
+    template <typename U>
+    FrameStlAllocator(const FrameStlAllocator<U>& other) : _allocator(other.Allocator()) {}
+
+    T* allocate(size_t count) {
+        T* memory = _allocator->AllocateArray<T>(count);
+        if (!memory) {
+            throw std::bad_alloc();
+        }
+        return memory;
+    }
+
+    void deallocate(T*, size_t) {}
+
+    LinearAllocator* Allocator() const { return _allocator; }
+
+    template <typename U>
+    bool operator==(const FrameStlAllocator<U>& other) const {
+        return _allocator == other.Allocator();
+    }
+    template <typename U>
+    bool operator!=(const FrameStlAllocator<U>& other) const {
+        return _allocator != other.Allocator();
+    }
+
+  private:
+    LinearAllocator* _allocator;
+};
+
+/*
+ * Vector of a frame : FrameVector<VkImageMemoryBarrier> barriers(frame.Scratch);
+ * Growing it leaves the old storage in the frame's block, reserve() when the size is
+ * known.
+ */
+template <typename T>
+using FrameVector = std::vector<T, FrameStlAllocator<T>>;
+
+} // namespace Backend
@@ -0,0 +1,179 @@
+#pragma once
+#include "FrameAllocator.h"
+#include "HostAllocator.h"
+#include "TimelineSync.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+namespace Backend {
+
+/*
+ * What a frame in flight owns. The command pool is transient and reset as a whole once
+ * the frame's submission is done; its command buffers are allocated the first time
+ * they're needed and reused by every later frame. Scratch holds the CPU temporaries of
+ * the frame (barriers, draw lists, descriptor writes...) and is reset along the pool.
+ */
+struct FrameContext {
+    VkCommandPool                CommandPool;
+    uint64_t                     SubmitValue = 0; /* QueueTimeline value of the submit */
+    VkSemaphore                  ImageAvailable;
+    VkSemaphore                  RenderFinished;
+    std::vector<VkCommandBuffer> CommandBuffers;
+    uint32_t                     UsedCommandBuffers = 0;
+    LinearAllocator              Scratch;
+};
+
+/*
+ * Ring of FrameContext, one per frame in flight.
+ * BeginFrame() -> BeginCommandBuffer()... -> SubmitValue = timeline.Submit() -> EndFrame()
+ */
+class FrameContextRing {
+  public:
+    /*
+     * @param device : Device that owns the objects
+     * @param queue_family : Family of the queue the command buffers are submitted to
+     * @param timeline : Timeline of that queue, the frames are submitted through it
+     * @param frame_count : Frames in flight
+     * @param scratch_bytes (Optional) : Initial block of every frame's Scratch
+     */
+    void Init(VkDevice device, uint32_t queue_family, QueueTimeline& timeline,
+              uint32_t frame_count, size_t scratch_bytes = 64 * 1024) {
+        _device           = device;
+        _timeline         = &timeline;
+        _frames_in_flight = frame_count;
+        _frames.resize(frame_count);
+
+        VkCommandPoolCreateInfo pool_info = {};
+        pool_info.sType                   = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        pool_info.queueFamilyIndex        = queue_family;
+        pool_info.flags                   = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+
+        VkSemaphoreCreateInfo semaphore_info = {};
+        semaphore_info.sType                 = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+        for (FrameContext& frame : _frames) {
+            frame.Scratch.Init(scratch_bytes);
+            if (vkCreateCommandPool(_device, &pool_info,
+                                    HostCallbacks(), &frame.CommandPool) !=
+                VK_SUCCESS) {
+                throw std::runtime_error("Failed to create CommandPool");
+            }
+            if (vkCreateSemaphore(_device, &semaphore_info, HostCallbacks(),
+                                  &frame.ImageAvailable) != VK_SUCCESS ||
+                vkCreateSemaphore(_device, &semaphore_info, HostCallbacks(),
+                                  &frame.RenderFinished) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to create Semaphores");
+            }
+        }
+    }
+
+    /*
+     * Fewer frames in flight than the ring size : a frame also waits for the one
+     * submitted frame_count frames before it. Takes effect on the next BeginFrame().
+     * @param frame_count : Between 1 and FrameCount()
+     */
+    void SetFramesInFlight(uint32_t frame_count) {
+        _frames_in_flight = std::max(1u, std::min(frame_count, FrameCount()));
+    }
+
+    /*
+     * Wait until the GPU is done with the current frame (and with the frame
+     * FramesInFlight() frames before), then recycle its command buffers and scratch.
+     * The frame's submit must store its value in SubmitValue.
+     * Only a wait that actually blocks shows up in the CPU profile.
+     */
+    FrameContext& BeginFrame() {
+        FrameContext&       frame    = _frames[_current];
+        const FrameContext& throttle =
+            _frames[(_current + FrameCount() - _frames_in_flight) % FrameCount()];
+        uint64_t wait_value = std::max(frame.SubmitValue, throttle.SubmitValue);
+        if (!_timeline->IsComplete(wait_value)) {
+            CPU_SCOPE("FrameContextRing::BeginFrame wait");
+            _timeline->Wait(wait_value);
+        }
+
+        vkResetCommandPool(_device, frame.CommandPool, 0);
+        frame.UsedCommandBuffers = 0;
+        frame.Scratch.Reset();
+        return frame;
+    }
+
+    /*
+     * Next primary command buffer of the current frame, in the recording state
+     */
+    VkCommandBuffer BeginCommandBuffer() {
+        FrameContext& frame = _frames[_current];
+        if (frame.UsedCommandBuffers == frame.CommandBuffers.size()) {
+            VkCommandBufferAllocateInfo alloc_info = {};
+            alloc_info.sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+            alloc_info.commandPool        = frame.CommandPool;
+            alloc_info.level              = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+            alloc_info.commandBufferCount = 1;
+
+            VkCommandBuffer command_buffer;
+            if (vkAllocateCommandBuffers(_device, &alloc_info, &command_buffer) !=
+                VK_SUCCESS) {
+                throw std::runtime_error("Failed to allocate CommandBuffers");
+            }
+            frame.CommandBuffers.push_back(command_buffer);
+        }
+        VkCommandBuffer command_buffer = frame.CommandBuffers[frame.UsedCommandBuffers++];
+
+        VkCommandBufferBeginInfo begin_info = {};
+        begin_info.sType                    = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        begin_info.flags                    = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+        if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to begin recording CommandBuffer");
+        }
+        return command_buffer;
+    }
+
+    void EndFrame() { _current = (_current + 1) % _frames.size(); }
+
+    FrameContext& Current() { return _frames[_current]; }
+    uint32_t      CurrentIndex() const { return _current; }
+    uint32_t      FrameCount() const { return static_cast<uint32_t>(_frames.size()); }
+    uint32_t      FramesInFlight() const { return _frames_in_flight; }
+
+    /* Largest Scratch use of a frame and allocations that didn't fit, since the start */
+    size_t ScratchPeak() const {
+        size_t peak = 0;
+        for (const FrameContext& frame : _frames) {
+            peak = std::max(peak, frame.Scratch.Peak());
+        }
+        return peak;
+    }
+    uint64_t ScratchOverflows() const {
+        uint64_t overflows = 0;
+        for (const FrameContext& frame : _frames) {
+            overflows += frame.Scratch.OverflowCount();
+        }
+        return overflows;
+    }
+
+    /*
+     * The frames must not be in use by the GPU anymore
+     */
+    void Destroy() {
+        for (FrameContext& frame : _frames) {
+            vkDestroySemaphore(_device, frame.RenderFinished, HostCallbacks());
+            vkDestroySemaphore(_device, frame.ImageAvailable, HostCallbacks());
+            vkDestroyCommandPool(_device, frame.CommandPool, HostCallbacks());
+            frame.Scratch.Destroy();
+        }
+        _frames.clear();
+    }
+
+  private:
+    VkDevice                  _device;
+    QueueTimeline*            _timeline = nullptr;
+    std::vector<FrameContext> _frames;
+    uint32_t                  _current          = 0;
+    uint32_t                  _frames_in_flight = 0;
+};
+
+} // namespace Backend
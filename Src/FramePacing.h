@@ -0,0 +1,191 @@
+#pragma once
+#include "TimelineSync.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace Backend {
+
+/*
+ * LowLatency : MAILBOX/IMMEDIATE, 1 frame in flight, input sampled just before record
+ * Throughput : MAILBOX, every frame of the ring in flight
+ * VSync : FIFO, 2 frames in flight
+ */
+enum class PacingProfile { LowLatency, Throughput, VSync };
+
+struct PacingConfig {
+    PacingProfile                 Profile;
+    std::vector<VkPresentModeKHR> PresentModes;   /* By preference, FIFO is the fallback */
+    uint32_t                      ImageCount;     /* Requested, clamped by the surface */
+    uint32_t                      FramesInFlight; /* Clamped by the frame ring */
+    bool                          LateInput;      /* Poll the input after the acquire */
+};
+
+inline const char* PacingProfileName(PacingProfile profile) {
+    switch (profile) {
+    case PacingProfile::LowLatency: return "low-latency";
+    case PacingProfile::Throughput: return "throughput";
+    case PacingProfile::VSync: return "vsync";
+    }
+    return "unknown";
+}
+
+inline PacingProfile NextPacingProfile(PacingProfile profile) {
+    switch (profile) {
+    case PacingProfile::LowLatency: return PacingProfile::Throughput;
+    case PacingProfile::Throughput: return PacingProfile::VSync;
+    case PacingProfile::VSync: return PacingProfile::LowLatency;
+    }
+    return PacingProfile::Throughput;
+}
+
+/*
+ * @param frame_count : Size of the frame ring, the most frames that can be in flight
+ */
+inline PacingConfig GetPacingConfig(PacingProfile profile, uint32_t frame_count) {
+    PacingConfig config = {};
+    config.Profile      = profile;
+    switch (profile) {
+    case PacingProfile::LowLatency:
+        /* MAILBOX needs a spare image to replace, IMMEDIATE tears but never waits */
+        config.PresentModes   = {VK_PRESENT_MODE_MAILBOX_KHR, VK_PRESENT_MODE_IMMEDIATE_KHR};
+        config.ImageCount     = 3;
+        config.FramesInFlight = 1;
+        config.LateInput      = true;
+        break;
+    case PacingProfile::Throughput:
+        config.PresentModes   = {VK_PRESENT_MODE_MAILBOX_KHR};
+        config.ImageCount     = 3;
+        config.FramesInFlight = frame_count;
+        config.LateInput      = false;
+        break;
+    case PacingProfile::VSync:
+        config.PresentModes   = {VK_PRESENT_MODE_FIFO_KHR};
+        config.ImageCount     = 3;
+        config.FramesInFlight = 2;
+        config.LateInput      = false;
+        break;
+    }
+    config.FramesInFlight = std::max(1u, std::min(config.FramesInFlight, frame_count));
+    return config;
+}
+
+/*
+ * Profile from VT_PACING (low-latency, throughput, vsync) and frames in flight from
+ * VT_FRAMES_IN_FLIGHT, so a deployment is tuned without recompiling.
+ * @param fallback : Profile used when VT_PACING isn't set or unknown
+ */
+inline PacingConfig GetPacingConfigFromEnv(PacingProfile fallback, uint32_t frame_count) {
+    PacingProfile profile = fallback;
+    if (const char* name = std::getenv("VT_PACING")) {
+        for (PacingProfile candidate : {PacingProfile::LowLatency, PacingProfile::Throughput,
+                                        PacingProfile::VSync}) {
+            if (std::string(name) == PacingProfileName(candidate)) {
+                profile = candidate;
+            }
+        }
+    }
+    PacingConfig config = GetPacingConfig(profile, frame_count);
+    if (const char* frames = std::getenv("VT_FRAMES_IN_FLIGHT")) {
+        uint32_t count        = static_cast<uint32_t>(std::atoi(frames));
+        config.FramesInFlight = std::max(1u, std::min(count, frame_count));
+    }
+    return config;
+}
+
+inline VkPresentModeKHR ChoosePresentMode(const PacingConfig& config,
+                                          const std::vector<VkPresentModeKHR>& available) {
+    for (VkPresentModeKHR preferred : config.PresentModes) {
+        if (std::find(available.begin(), available.end(), preferred) != available.end()) {
+            return preferred;
+        }
+    }
+    return VK_PRESENT_MODE_FIFO_KHR; /* Always supported */
+}
+
+/*
+ * Input-to-present latency of the frames in flight, from the moment the frame sampled
+ * its input to
+ * -the return of vkQueuePresentKHR (CPU side)
+ * -the completion of its submission, seen by Update() or by the frame ring's wait (GPU
+ *  side, the scanout itself isn't observable without a present timing extension)
+ */
+class LatencyTracker {
+  public:
+    void Init(uint32_t frame_count) { _frames.assign(frame_count, {}); }
+
+    /*
+     * The input of the next presented frame. Kept aside until OnPresented() : sampled
+     * before the frame ring's wait, the slot still belongs to the previous frame.
+     */
+    void OnInputSampled() { _input_time = Clock::now(); }
+
+    /*
+     * @param submit_value : QueueTimeline value of the frame's submission
+     */
+    void OnPresented(uint32_t frame_index, uint64_t submit_value) {
+        Frame& frame      = _frames[frame_index];
+        frame.InputTime   = _input_time;
+        frame.SubmitValue = submit_value;
+        frame.Pending     = true;
+        _present_ms += _Ms(frame.InputTime);
+        _presented++;
+    }
+
+    /*
+     * Account the frames the GPU finished, once per frame
+     */
+    void Update(QueueTimeline& timeline) {
+        for (Frame& frame : _frames) {
+            if (frame.Pending && timeline.IsComplete(frame.SubmitValue)) {
+                frame.Pending = false;
+                _complete_ms += _Ms(frame.InputTime);
+                _completed++;
+            }
+        }
+    }
+
+    /* Averages since the last ResetAverages() */
+    double AveragePresentMs() const { return _presented ? _present_ms / _presented : 0.0; }
+    double AverageCompleteMs() const { return _completed ? _complete_ms / _completed : 0.0; }
+
+    void ResetAverages() {
+        _present_ms = _complete_ms = 0.0;
+        _presented = _completed = 0;
+    }
+
+    /* Also drop the frames still pending, they won't be accounted by Update() */
+    void Reset() {
+        for (Frame& frame : _frames) {
+            frame.Pending = false;
+        }
+        ResetAverages();
+    }
+
+  private:
+    using Clock = std::chrono::high_resolution_clock;
+
+    struct Frame {
+        Clock::time_point InputTime;
+        uint64_t          SubmitValue = 0;
+        bool              Pending     = false;
+    };
+
+    static double _Ms(Clock::time_point since) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+    }
+
+    std::vector<Frame> _frames;
+    Clock::time_point  _input_time;
+    double             _present_ms  = 0.0;
+    double             _complete_ms = 0.0;
+    uint32_t           _presented   = 0;
+    uint32_t           _completed   = 0;
+};
+
+} // namespace Backend
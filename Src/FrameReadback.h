@@ -0,0 +1,511 @@
+#pragma once
+#include "CpuProfiler.h"
+#include "HostAllocator.h"
+#include "MemoryTracker.h"
+#include "TimelineSync.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Backend {
+
+/*
+ * Png : 8 bits RGB, stored (uncompressed) deflate blocks, cheap enough to keep up
+ *       with the frame rate
+ * Raw : Pixels as the GPU wrote them, tightly packed, in the image format
+ */
+enum class CaptureFormat { Png, Raw };
+
+/*
+ * Copies the final image of captured frames into a ring of host visible buffers.
+ * A buffer is read once the timeline passed its frame's submission (Poll(), N frames
+ * later), then a worker thread encodes and writes it. The render thread never waits :
+ * a frame is dropped when no buffer is free.
+ * RecordCopy() -> timeline.Submit() -> OnSubmitted() ... Poll() every frame
+ */
+class FrameReadback {
+  public:
+    /*
+     * @param format : Format of the captured images, 4 bytes per pixel (RGBA/BGRA 8)
+     * @param extent : Size of the captured images
+     * @param slot_count : Buffers of the ring, more than the frames in flight so the
+     *                     writes can lag behind
+     * @param output_prefix : Files are output_prefix + frame number + extension
+     * @param memory_tracker (Optional) : Accounts the buffers as readback memory
+     */
+    void Init(VkPhysicalDevice physical_dev, VkDevice device, QueueTimeline& timeline,
+              VkFormat format, VkExtent2D extent, uint32_t slot_count,
+              const std::string& output_prefix, CaptureFormat file_format,
+              MemoryTracker* memory_tracker = nullptr) {
+        _device         = device;
+        _memory_tracker = memory_tracker;
+        _timeline       = &timeline;
+        _format         = format;
+        _extent         = extent;
+        _prefix         = output_prefix;
+        _file_format    = file_format;
+
+        switch (format) {
+        case VK_FORMAT_B8G8R8A8_UNORM:
+        case VK_FORMAT_B8G8R8A8_SRGB: _swap_red_blue = true; break;
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB: _swap_red_blue = false; break;
+        default: throw std::runtime_error("Readback format not supported");
+        }
+
+        VkDeviceSize size = VkDeviceSize(extent.width) * extent.height * 4;
+        _slots.reset(new Slot[slot_count]);
+        _slot_count = slot_count;
+        for (uint32_t i = 0; i < slot_count; i++) {
+            _CreateSlot(physical_dev, size, _slots[i]);
+        }
+
+        _running = true;
+        _worker  = std::thread([this] { _WorkerLoop(); });
+    }
+
+    /*
+     * Copy an image into a free buffer of the ring
+     * @param command_buffer : In the recording state, outside of a render pass
+     * @param image : Written by the color attachment output stage
+     * @param layout : Layout of the image, it is left in this layout
+     * @param frame_number : Names the file
+     * @return : False if the frame is dropped (every buffer busy)
+     */
+    bool RecordCopy(VkCommandBuffer command_buffer, VkImage image, VkImageLayout layout,
+                    uint64_t frame_number) {
+        Slot* slot = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (uint32_t i = 0; i < _slot_count && !slot; i++) {
+                Slot& candidate = _slots[(_next + i) % _slot_count];
+                if (candidate.State == SlotState::Free) {
+                    slot  = &candidate;
+                    _next = (_next + i + 1) % _slot_count;
+                }
+            }
+            if (!slot) {
+                _dropped++;
+                return false;
+            }
+            slot->State = SlotState::Recorded;
+        }
+        slot->FrameNumber = frame_number;
+        _recorded         = slot;
+
+        /* === IMAGE : layout -> TRANSFER_SRC === */
+        VkImageMemoryBarrier image_barrier = {};
+        image_barrier.sType                = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        image_barrier.srcAccessMask        = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        image_barrier.dstAccessMask        = VK_ACCESS_TRANSFER_READ_BIT;
+        image_barrier.oldLayout            = layout;
+        image_barrier.newLayout            = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        image_barrier.srcQueueFamilyIndex  = VK_QUEUE_FAMILY_IGNORED;
+        image_barrier.dstQueueFamilyIndex  = VK_QUEUE_FAMILY_IGNORED;
+        image_barrier.image                = image;
+        image_barrier.subresourceRange     = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1,
+                             &image_barrier);
+
+        /* === COPY === */
+        VkBufferImageCopy region = {};
+        region.bufferOffset      = 0;
+        region.bufferRowLength   = 0; /* Tightly packed */
+        region.bufferImageHeight = 0;
+        region.imageSubresource  = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+        region.imageOffset       = {0, 0, 0};
+        region.imageExtent       = {_extent.width, _extent.height, 1};
+        vkCmdCopyImageToBuffer(command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                               slot->Buffer, 1, &region);
+
+        /* === BUFFER -> HOST, IMAGE -> layout === */
+        VkBufferMemoryBarrier buffer_barrier = {};
+        buffer_barrier.sType                 = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        buffer_barrier.srcAccessMask         = VK_ACCESS_TRANSFER_WRITE_BIT;
+        buffer_barrier.dstAccessMask         = VK_ACCESS_HOST_READ_BIT;
+        buffer_barrier.srcQueueFamilyIndex   = VK_QUEUE_FAMILY_IGNORED;
+        buffer_barrier.dstQueueFamilyIndex   = VK_QUEUE_FAMILY_IGNORED;
+        buffer_barrier.buffer                = slot->Buffer;
+        buffer_barrier.offset                = 0;
+        buffer_barrier.size                  = VK_WHOLE_SIZE;
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1, &buffer_barrier,
+                             0, nullptr);
+
+        if (layout != VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL) {
+            image_barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+            image_barrier.dstAccessMask = 0; /* Present : visibility is implicit */
+            image_barrier.oldLayout     = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+            image_barrier.newLayout     = layout;
+            vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                 VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0,
+                                 nullptr, 1, &image_barrier);
+        }
+        return true;
+    }
+
+    /*
+     * @param submit_value : Timeline value of the submission holding the last RecordCopy()
+     */
+    void OnSubmitted(uint64_t submit_value) {
+        if (!_recorded) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(_mutex);
+        _recorded->SubmitValue = submit_value;
+        _recorded->State       = SlotState::InFlight;
+        _recorded              = nullptr;
+    }
+
+    /*
+     * Hand the buffers the GPU is done with to the worker, once per frame
+     */
+    void Poll() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (uint32_t i = 0; i < _slot_count; i++) {
+            Slot& slot = _slots[i];
+            if (slot.State == SlotState::InFlight && _timeline->IsComplete(slot.SubmitValue)) {
+                _HandToWorker(slot);
+            }
+        }
+    }
+
+    /*
+     * Wait for the captures in flight and their writes
+     */
+    void Flush() {
+        std::unique_lock<std::mutex> lock(_mutex);
+        for (uint32_t i = 0; i < _slot_count; i++) {
+            Slot& slot = _slots[i];
+            if (slot.State == SlotState::InFlight) {
+                _timeline->Wait(slot.SubmitValue);
+                _HandToWorker(slot);
+            }
+        }
+        _idle.wait(lock, [this] { return _queue.empty() && !_writing; });
+    }
+
+    uint32_t WrittenCount() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _written;
+    }
+    uint32_t DroppedCount() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _dropped;
+    }
+
+    /*
+     * The copies must not be in use by the GPU anymore
+     */
+    void Destroy() {
+        if (!_worker.joinable()) {
+            return;
+        }
+        Flush();
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _running = false;
+        }
+        _wake.notify_all();
+        _worker.join();
+
+        for (uint32_t i = 0; i < _slot_count; i++) {
+            vkUnmapMemory(_device, _slots[i].Memory);
+            vkDestroyBuffer(_device, _slots[i].Buffer, HostCallbacks());
+            if (_memory_tracker) {
+                _memory_tracker->Free(_slots[i].Memory);
+            } else {
+                vkFreeMemory(_device, _slots[i].Memory, HostCallbacks());
+            }
+        }
+        _slots.reset();
+        std::cout << "FrameReadback: " << _written << " frames written, " << _dropped
+                  << " dropped" << std::endl;
+    }
+
+  private:
+    /* Free -> Recorded -> InFlight (render thread) -> Writing -> Free (worker) */
+    enum class SlotState { Free, Recorded, InFlight, Writing };
+
+    struct Slot {
+        VkBuffer       Buffer;
+        VkDeviceMemory Memory;
+        void*          Mapped;
+        bool           Coherent;
+        uint64_t       SubmitValue = 0;
+        uint64_t       FrameNumber = 0;
+        SlotState      State       = SlotState::Free;
+    };
+
+    void _CreateSlot(VkPhysicalDevice physical_dev, VkDeviceSize size, Slot& slot) {
+        VkBufferCreateInfo buffer_info = {};
+        buffer_info.sType              = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+        buffer_info.size               = size;
+        buffer_info.usage              = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+        buffer_info.sharingMode        = VK_SHARING_MODE_EXCLUSIVE;
+        if (vkCreateBuffer(_device, &buffer_info, HostCallbacks(), &slot.Buffer) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("Failed to create readback buffer");
+        }
+
+        VkMemoryRequirements mem_requirements;
+        vkGetBufferMemoryRequirements(_device, slot.Buffer, &mem_requirements);
+
+        /* Cached : the CPU reads every byte, uncached reads are very slow */
+        VkMemoryPropertyFlags properties;
+        uint32_t              memory_type = _FindMemoryType(
+            physical_dev, mem_requirements.memoryTypeBits,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+            properties);
+        if (memory_type == UINT32_MAX) {
+            memory_type = _FindMemoryType(physical_dev, mem_requirements.memoryTypeBits,
+                                          VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                              VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                                          properties);
+        }
+        if (memory_type == UINT32_MAX) {
+            throw std::runtime_error("Failed to find memory type");
+        }
+        slot.Coherent = properties & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+        VkMemoryAllocateInfo alloc_info = {};
+        alloc_info.sType                = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        alloc_info.allocationSize       = mem_requirements.size;
+        alloc_info.memoryTypeIndex      = memory_type;
+        VkResult result;
+        if (_memory_tracker) {
+            result = _memory_tracker->Allocate(alloc_info, slot.Memory,
+                                               MemoryCategory::Readback, "readback slot");
+        } else {
+            result = vkAllocateMemory(_device, &alloc_info, HostCallbacks(), &slot.Memory);
+        }
+        if (result != VK_SUCCESS) {
+            throw std::runtime_error("Failed to allocate readback memory");
+        }
+        vkBindBufferMemory(_device, slot.Buffer, slot.Memory, 0);
+        vkMapMemory(_device, slot.Memory, 0, VK_WHOLE_SIZE, 0, &slot.Mapped);
+    }
+
+    static uint32_t _FindMemoryType(VkPhysicalDevice physical_dev, uint32_t type_filter,
+                                    VkMemoryPropertyFlags  required,
+                                    VkMemoryPropertyFlags& properties) {
+        VkPhysicalDeviceMemoryProperties mem_properties;
+        vkGetPhysicalDeviceMemoryProperties(physical_dev, &mem_properties);
+        for (uint32_t i = 0; i < mem_properties.memoryTypeCount; i++) {
+            properties = mem_properties.memoryTypes[i].propertyFlags;
+            if ((type_filter & (1 << i)) && (properties & required) == required) {
+                return i;
+            }
+        }
+        return UINT32_MAX;
+    }
+
+    /* _mutex must be held */
+    void _HandToWorker(Slot& slot) {
+        if (!slot.Coherent) {
+            VkMappedMemoryRange range = {};
+            range.sType               = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+            range.memory              = slot.Memory;
+            range.offset              = 0;
+            range.size                = VK_WHOLE_SIZE;
+            vkInvalidateMappedMemoryRanges(_device, 1, &range);
+        }
+        slot.State = SlotState::Writing;
+        _queue.push_back(&slot);
+        _wake.notify_one();
+    }
+
+    void _WorkerLoop() {
+        CPU_THREAD_NAME("Readback writer");
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true) {
+            _wake.wait(lock, [this] { return !_queue.empty() || !_running; });
+            if (_queue.empty()) {
+                return; /* Stopped */
+            }
+            Slot* slot = _queue.front();
+            _queue.pop_front();
+            _writing = true;
+
+            lock.unlock();
+            bool written = _WriteFile(*slot);
+            lock.lock();
+
+            if (written) {
+                _written++;
+            } else {
+                _dropped++;
+            }
+            slot->State = SlotState::Free;
+            _writing    = false;
+            _idle.notify_all();
+        }
+    }
+
+    bool _WriteFile(const Slot& slot) {
+        CPU_FUNCTION();
+        std::ostringstream path;
+        path << _prefix << std::setw(6) << std::setfill('0') << slot.FrameNumber
+             << (_file_format == CaptureFormat::Png ? ".png" : ".raw");
+
+        std::ofstream file(path.str(), std::ios::binary);
+        if (!file) {
+            std::cerr << "FrameReadback: Failed to open " << path.str() << std::endl;
+            return false;
+        }
+
+        const uint8_t* pixels = static_cast<const uint8_t*>(slot.Mapped);
+        if (_file_format == CaptureFormat::Raw) {
+            file.write(reinterpret_cast<const char*>(pixels),
+                       std::streamsize(_extent.width) * _extent.height * 4);
+        } else {
+            _WritePng(file, pixels);
+        }
+        return file.good();
+    }
+
+    /*
+     * PNG with stored deflate blocks : no compression library, and the encoding
+     * costs little more than a copy
+     */
+    void _WritePng(std::ofstream& file, const uint8_t* pixels) {
+        uint32_t width = _extent.width, height = _extent.height;
+
+        /* Scanlines : filter byte (none) + RGB */
+        _scanlines.resize(size_t(width * 3 + 1) * height);
+        uint8_t* out = _scanlines.data();
+        int      r   = _swap_red_blue ? 2 : 0;
+        int      b   = _swap_red_blue ? 0 : 2;
+        for (uint32_t y = 0; y < height; y++) {
+            *out++ = 0;
+            const uint8_t* row = pixels + size_t(y) * width * 4;
+            for (uint32_t x = 0; x < width; x++) {
+                *out++ = row[x * 4 + r];
+                *out++ = row[x * 4 + 1];
+                *out++ = row[x * 4 + b];
+            }
+        }
+
+        /* zlib stream : header, stored blocks of at most 65535 bytes, adler32 */
+        std::vector<uint8_t> zlib = {0x78, 0x01};
+        zlib.reserve(_scanlines.size() + _scanlines.size() / 65535 * 5 + 16);
+        size_t offset = 0;
+        do {
+            size_t  len  = std::min<size_t>(65535, _scanlines.size() - offset);
+            uint8_t last = offset + len == _scanlines.size();
+            zlib.push_back(last);
+            zlib.push_back(len & 0xFF);
+            zlib.push_back(len >> 8);
+            zlib.push_back(~len & 0xFF);
+            zlib.push_back((~len >> 8) & 0xFF);
+            zlib.insert(zlib.end(), _scanlines.begin() + offset,
+                        _scanlines.begin() + offset + len);
+            offset += len;
+        } while (offset < _scanlines.size());
+        _PushBigEndian(zlib, _Adler32(_scanlines.data(), _scanlines.size()));
+
+        std::vector<uint8_t> header;
+        _PushBigEndian(header, width);
+        _PushBigEndian(header, height);
+        header.insert(header.end(), {8, 2, 0, 0, 0}); /* 8 bits, RGB, deflate, no interlace */
+
+        static const uint8_t signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+        file.write(reinterpret_cast<const char*>(signature), sizeof(signature));
+        _WriteChunk(file, "IHDR", header);
+        _WriteChunk(file, "IDAT", zlib);
+        _WriteChunk(file, "IEND", {});
+    }
+
+    static void _WriteChunk(std::ofstream& file, const char* type,
+                            const std::vector<uint8_t>& data) {
+        std::vector<uint8_t> bytes;
+        _PushBigEndian(bytes, static_cast<uint32_t>(data.size()));
+        bytes.insert(bytes.end(), type, type + 4);
+        bytes.insert(bytes.end(), data.begin(), data.end());
+        _PushBigEndian(bytes, _Crc32(bytes.data() + 4, bytes.size() - 4));
+        file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    }
+
+    static void _PushBigEndian(std::vector<uint8_t>& bytes, uint32_t value) {
+        bytes.insert(bytes.end(), {uint8_t(value >> 24), uint8_t(value >> 16),
+                                   uint8_t(value >> 8), uint8_t(value)});
+    }
+
+    static uint32_t _Crc32(const uint8_t* data, size_t size) {
+        static const std::array<uint32_t, 256> table = [] {
+            std::array<uint32_t, 256> t = {};
+            for (uint32_t n = 0; n < 256; n++) {
+                uint32_t c = n;
+                for (int k = 0; k < 8; k++) {
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                t[n] = c;
+            }
+            return t;
+        }();
+        uint32_t crc = 0xFFFFFFFFu;
+        for (size_t i = 0; i < size; i++) {
+            crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        }
+        return crc ^ 0xFFFFFFFFu;
+    }
+
+    static uint32_t _Adler32(const uint8_t* data, size_t size) {
+        uint32_t a = 1, b = 0;
+        while (size > 0) {
+            size_t block = std::min<size_t>(size, 5552); /* No overflow before the modulo */
+            for (size_t i = 0; i < block; i++) {
+                a += data[i];
+                b += a;
+            }
+            a %= 65521;
+            b %= 65521;
+            data += block;
+            size -= block;
+        }
+        return (b << 16) | a;
+    }
+
+    VkDevice                _device;
+    MemoryTracker*          _memory_tracker = nullptr;
+    QueueTimeline*          _timeline       = nullptr;
+    VkFormat                _format;
+    VkExtent2D              _extent;
+    std::string             _prefix;
+    CaptureFormat           _file_format;
+    bool                    _swap_red_blue = false;
+    std::unique_ptr<Slot[]> _slots;
+    uint32_t                _slot_count = 0;
+    uint32_t                _next       = 0;
+    Slot*                   _recorded   = nullptr; /* Waiting for OnSubmitted() */
+
+    /* Worker, the slot states and counters are guarded by _mutex */
+    std::thread             _worker;
+    std::mutex              _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _idle;
+    std::deque<Slot*>       _queue;
+    bool                    _running = false;
+    bool                    _writing = false;
+    uint32_t                _written = 0;
+    uint32_t                _dropped = 0;
+    std::vector<uint8_t>    _scanlines; /* Worker only */
+};
+
+} // namespace Backend
@@ -0,0 +1,299 @@
+#pragma once
+#include "CpuProfiler.h"
+#include "RollingStats.h"
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+namespace Backend {
+
+/*
+ * Text written by a worker thread : the render thread only appends to a string, the
+ * console flushes and the file writes happen off the frame.
+ */
+class AsyncLogWriter {
+  public:
+    /*
+     * @param csv_path (Optional) : File receiving WriteCsv(), nothing when empty
+     */
+    void Start(const std::string& csv_path = "") {
+        if (!csv_path.empty()) {
+            _csv.open(csv_path);
+            if (!_csv) {
+                std::cerr << "AsyncLogWriter: Failed to open " << csv_path << std::endl;
+            }
+        }
+        _csv_enabled = _csv.is_open();
+        _running = true;
+        _worker  = std::thread([this] { _WorkerLoop(); });
+    }
+
+    /* Console output */
+    void Write(std::string text) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _console += text;
+        _wake.notify_one();
+    }
+
+    void WriteCsv(std::string rows) {
+        if (!_csv_enabled) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(_mutex);
+        _csv_rows += rows;
+        _wake.notify_one();
+    }
+
+    bool CsvEnabled() const { return _csv_enabled; }
+
+    /*
+     * Write what is pending and join the worker
+     */
+    void Stop() {
+        if (!_worker.joinable()) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _running = false;
+            _wake.notify_one();
+        }
+        _worker.join();
+        _csv.close();
+    }
+
+    ~AsyncLogWriter() { Stop(); }
+
+  private:
+    void _WorkerLoop() {
+        CPU_THREAD_NAME("Log writer");
+        std::string console, csv_rows;
+        std::unique_lock<std::mutex> lock(_mutex);
+        while (true) {
+            _wake.wait(lock, [this] {
+                return !_running || !_console.empty() || !_csv_rows.empty();
+            });
+            console.swap(_console);
+            csv_rows.swap(_csv_rows);
+            bool running = _running;
+
+            lock.unlock();
+            std::cout << console << std::flush;
+            _csv << csv_rows;
+            console.clear();
+            csv_rows.clear();
+            lock.lock();
+
+            if (!running && _console.empty() && _csv_rows.empty()) {
+                return;
+            }
+        }
+    }
+
+    std::thread             _worker;
+    std::mutex              _mutex;
+    std::condition_variable _wake;
+    bool                    _running = false;
+    std::string             _console;  /* Guarded by _mutex */
+    std::string             _csv_rows; /* Guarded by _mutex */
+    std::ofstream           _csv;      /* Worker only once started */
+    bool                    _csv_enabled = false; /* _csv opened, read by the writers */
+};
+
+struct FrameTimeSummary {
+    double Average, P50, P95, P99, Max;
+};
+
+/*
+ * Timings of every frame :
+ * -CPU : from BeginFrame() to EndFrame()
+ * -Wait : time blocked on the frame ring (fence / timeline) in between
+ * -Present interval : between two OnPresented(), what the user sees
+ * Kept in fixed windows for the percentiles, plus a histogram and the stutter count
+ * since the start. BeginFrame() -> BeginWait()/EndWait() -> OnPresented() -> EndFrame()
+ */
+class FrameStatistics {
+  public:
+    /* 0.5ms wide, the last one counts everything above 16.5ms */
+    static const uint32_t HistogramBuckets = 34;
+
+    /*
+     * @param window : Frames kept for the percentiles
+     * @param stutter_factor : A present interval this many times the running average
+     *                         is a stutter
+     * @param csv_path (Optional) : One row per frame, written from a worker thread
+     */
+    void Init(size_t window = 1024, double stutter_factor = 2.0,
+              const std::string& csv_path = "") {
+        _cpu_ms         = RollingStats(window);
+        _wait_ms        = RollingStats(window);
+        _present_ms     = RollingStats(window);
+        _stutter_factor = stutter_factor;
+        _log.Start(csv_path);
+        if (_log.CsvEnabled()) {
+            _csv_rows = "frame,cpu_ms,wait_ms,present_interval_ms\n";
+        }
+    }
+
+    /*
+     * Forget the frames so far (ex: after a warmup)
+     * @param window : Frames kept for the percentiles from now on
+     */
+    void Reset(size_t window) {
+        _cpu_ms           = RollingStats(window);
+        _wait_ms          = RollingStats(window);
+        _present_ms       = RollingStats(window);
+        _histogram        = {};
+        _interval_average = 0.0;
+        _stutters         = 0;
+        _frame_count      = 0;
+        _presented        = false;
+    }
+
+    void BeginFrame() {
+        _frame_start = Clock::now();
+        _frame_wait  = 0.0;
+    }
+
+    void BeginWait() { _wait_start = Clock::now(); }
+    void EndWait() { _frame_wait += _Ms(_wait_start, Clock::now()); }
+
+    void OnPresented() {
+        Clock::time_point now = Clock::now();
+        if (_presented) {
+            double interval = _Ms(_last_present, now);
+            if (_interval_average > 0.0 &&
+                interval > _stutter_factor * _interval_average) {
+                _stutters++;
+            }
+            /* Exponential average, a stutter only moves it slightly */
+            _interval_average = _interval_average > 0.0
+                                    ? _interval_average * 0.95 + interval * 0.05
+                                    : interval;
+            _present_ms.Add(interval);
+            _frame_interval = interval;
+        }
+        _presented    = true;
+        _last_present = now;
+    }
+
+    void EndFrame() {
+        double cpu = _Ms(_frame_start, Clock::now());
+        _cpu_ms.Add(cpu);
+        _wait_ms.Add(_frame_wait);
+        size_t bucket = std::min<size_t>(static_cast<size_t>(cpu * 2.0), HistogramBuckets - 1);
+        _histogram[bucket]++;
+
+        if (_log.CsvEnabled()) {
+            char row[96];
+            std::snprintf(row, sizeof(row), "%llu,%.4f,%.4f,%.4f\n",
+                          static_cast<unsigned long long>(_frame_count), cpu, _frame_wait,
+                          _frame_interval);
+            _csv_rows += row;
+        }
+        _frame_interval = 0.0;
+        _frame_count++;
+    }
+
+    FrameTimeSummary CpuSummary() const { return _Summarize(_cpu_ms); }
+    FrameTimeSummary WaitSummary() const { return _Summarize(_wait_ms); }
+    FrameTimeSummary PresentSummary() const { return _Summarize(_present_ms); }
+    uint64_t         StutterCount() const { return _stutters; }
+    uint64_t         FrameCount() const { return _frame_count; }
+    /* CPU frame times since the start, in 0.5ms buckets */
+    const std::array<uint64_t, HistogramBuckets>& Histogram() const { return _histogram; }
+
+    /*
+     * Percentiles of the window, written by the log worker with the pending CSV rows
+     * @param extra (Optional) : Appended to the report (other subsystems' statistics)
+     */
+    void Report(const std::string& extra = "") {
+        std::ostringstream report;
+        report << std::fixed << std::setprecision(2);
+        _WriteSummary(report, "CPU", CpuSummary());
+        _WriteSummary(report, "Wait", WaitSummary());
+        _WriteSummary(report, "Present", PresentSummary());
+        report << "Stutters: " << _stutters << " / " << _frame_count << " frames\n";
+        _log.Write(report.str() + extra);
+        FlushCsv();
+    }
+
+    /* CPU frame time histogram, for the end of a run */
+    void ReportHistogram() {
+        std::ostringstream report;
+        report << "CPU frame time histogram:\n";
+        for (uint32_t i = 0; i < HistogramBuckets; i++) {
+            if (_histogram[i] == 0) {
+                continue;
+            }
+            const char* unit = i + 1 == HistogramBuckets ? "+ ms " : " ms  ";
+            report << std::setw(5) << i * 0.5 << unit << std::setw(8) << _histogram[i]
+                   << "\n";
+        }
+        _log.Write(report.str());
+    }
+
+    void FlushCsv() {
+        if (!_csv_rows.empty()) {
+            _log.WriteCsv(std::move(_csv_rows));
+            _csv_rows.clear();
+        }
+    }
+
+    /*
+     * Write what is pending, the statistics can't be reported afterwards
+     */
+    void Destroy() {
+        FlushCsv();
+        _log.Stop();
+    }
+
+  private:
+    using Clock = std::chrono::steady_clock;
+
+    static double _Ms(Clock::time_point start, Clock::time_point end) {
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    static FrameTimeSummary _Summarize(const RollingStats& stats) {
+        return {stats.Average(), stats.Percentile(50), stats.Percentile(95),
+                stats.Percentile(99), stats.Max()};
+    }
+
+    static void _WriteSummary(std::ostream& out, const char* name,
+                              const FrameTimeSummary& summary) {
+        out << name << ": " << summary.Average << "ms avg, " << summary.P50 << "ms p50, "
+            << summary.P95 << "ms p95, " << summary.P99 << "ms p99, " << summary.Max
+            << "ms max\n";
+    }
+
+    RollingStats                           _cpu_ms;
+    RollingStats                           _wait_ms;
+    RollingStats                           _present_ms;
+    std::array<uint64_t, HistogramBuckets> _histogram = {};
+    double                                 _stutter_factor   = 2.0;
+    double                                 _interval_average = 0.0;
+    uint64_t                               _stutters         = 0;
+    uint64_t                               _frame_count      = 0;
+
+    Clock::time_point _frame_start;
+    Clock::time_point _wait_start;
+    Clock::time_point _last_present;
+    double            _frame_wait     = 0.0;
+    double            _frame_interval = 0.0; /* 0 until the second present */
+    bool              _presented      = false;
+
+    std::string    _csv_rows; /* Rows since the last FlushCsv() */
+    AsyncLogWriter _log;
+};
+
+} // namespace Backend
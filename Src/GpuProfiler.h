@@ -0,0 +1,213 @@
+#pragma once
+#include "HostAllocator.h"
+#include "RollingStats.h"
+
+#include <vulkan/vulkan.h>
+
+#include <functional>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace Backend {
+
+/* GPU milliseconds by scope name, looked up by const char* without a temporary key */
+using GpuScopeStats = std::map<std::string, RollingStats, std::less<>>;
+
+/*
+ * Named GPU scopes measured with timestamp queries. Every slot (frame in flight) owns a
+ * range of the query pool; the results of a slot are read when the slot comes back,
+ * N frames later, once its submission is known to be done, so the read never waits.
+ * BeginFrame(slot) -> BeginScope()/EndScope()... -> submit
+ * One more slot is kept for the single time (upload) command buffers.
+ */
+class GpuProfiler {
+  public:
+    /*
+     * @param queue_family : Family of the queue the scopes are recorded for
+     * @param frame_count : Frames in flight
+     * @param max_scopes : Scopes per frame, the following ones are ignored
+     */
+    void Init(VkPhysicalDevice physical_dev, VkDevice device, uint32_t queue_family,
+              uint32_t frame_count, uint32_t max_scopes = 32) {
+        _device     = device;
+        _max_scopes = max_scopes;
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physical_dev, &properties);
+        _ns_per_tick = properties.limits.timestampPeriod;
+
+        uint32_t family_count = 0;
+        vkGetPhysicalDeviceQueueFamilyProperties(physical_dev, &family_count, nullptr);
+        std::vector<VkQueueFamilyProperties> families(family_count);
+        vkGetPhysicalDeviceQueueFamilyProperties(physical_dev, &family_count,
+                                                 families.data());
+        uint32_t valid_bits = families[queue_family].timestampValidBits;
+        if (valid_bits == 0) {
+            return; /* No timestamps on this queue, the profiler does nothing */
+        }
+        _tick_mask = valid_bits >= 64 ? ~0ull : (1ull << valid_bits) - 1;
+
+        _slots.resize(frame_count + 1);
+        VkQueryPoolCreateInfo pool_info = {};
+        pool_info.sType                 = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        pool_info.queryType             = VK_QUERY_TYPE_TIMESTAMP;
+        pool_info.queryCount            = static_cast<uint32_t>(_slots.size()) * max_scopes * 2;
+        if (vkCreateQueryPool(_device, &pool_info, HostCallbacks(), &_query_pool) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("Failed to create timestamp QueryPool");
+        }
+        _results.resize(max_scopes * 2);
+    }
+
+    bool Enabled() const { return _query_pool != VK_NULL_HANDLE; }
+
+    /*
+     * Read the previous results of the slot and reset its queries. The slot's last
+     * submission must be done (the frame context waited for it).
+     * @param command_buffer : Command buffer of the frame, outside of a render pass
+     */
+    void BeginFrame(VkCommandBuffer command_buffer, uint32_t frame_index) {
+        _BeginSlot(command_buffer, frame_index);
+    }
+
+    /*
+     * Same as BeginFrame() for a single time command buffer, ResolveUploads() once it
+     * was waited for
+     */
+    void BeginUploads(VkCommandBuffer command_buffer) {
+        _BeginSlot(command_buffer, static_cast<uint32_t>(_slots.size()) - 1);
+    }
+
+    void ResolveUploads() {
+        if (Enabled()) {
+            _Resolve(_slots.back(), static_cast<uint32_t>(_slots.size()) - 1);
+        }
+    }
+
+    /*
+     * Scopes can't be written between vkCmdBeginRenderPass and vkCmdEndRenderPass when
+     * the pass executes secondary command buffers, they enclose whole passes.
+     * @param name : Scopes of the same name are accumulated, must outlive the profiler
+     * @return : Handle for EndScope()
+     */
+    uint32_t BeginScope(VkCommandBuffer command_buffer, const char* name) {
+        if (!Enabled() || _current->Names.size() == _max_scopes) {
+            return UINT32_MAX;
+        }
+        uint32_t scope = static_cast<uint32_t>(_current->Names.size());
+        _current->Names.push_back(name);
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, _query_pool,
+                            _current_first_query + scope * 2);
+        return scope;
+    }
+
+    void EndScope(VkCommandBuffer command_buffer, uint32_t scope) {
+        if (scope == UINT32_MAX) {
+            return;
+        }
+        vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                            _query_pool, _current_first_query + scope * 2 + 1);
+    }
+
+    /* GPU milliseconds of every scope, by name */
+    const GpuScopeStats& Scopes() const { return _scopes; }
+
+    /*
+     * Forget the samples so far (ex: after a warmup)
+     * @param window : Samples kept per scope from now on
+     */
+    void ResetScopes(size_t window = 256) {
+        _scopes.clear();
+        _window = window;
+    }
+
+    /*
+     * Read every slot, once the queue is idle (end of a run)
+     */
+    void ResolveAll() {
+        for (uint32_t i = 0; Enabled() && i < _slots.size(); i++) {
+            _Resolve(_slots[i], i);
+        }
+    }
+
+    void Destroy() {
+        if (_query_pool != VK_NULL_HANDLE) {
+            vkDestroyQueryPool(_device, _query_pool, HostCallbacks());
+            _query_pool = VK_NULL_HANDLE;
+        }
+    }
+
+  private:
+    struct Slot {
+        std::vector<const char*> Names; /* Scopes written since the last reset */
+    };
+
+    void _BeginSlot(VkCommandBuffer command_buffer, uint32_t slot_index) {
+        if (!Enabled()) {
+            return;
+        }
+        Slot& slot = _slots[slot_index];
+        _Resolve(slot, slot_index);
+
+        _current             = &slot;
+        _current_first_query = slot_index * _max_scopes * 2;
+        vkCmdResetQueryPool(command_buffer, _query_pool, _current_first_query,
+                            _max_scopes * 2);
+    }
+
+    void _Resolve(Slot& slot, uint32_t slot_index) {
+        if (slot.Names.empty()) {
+            return;
+        }
+        uint32_t query_count = static_cast<uint32_t>(slot.Names.size()) * 2;
+        /* No WAIT_BIT : the submission is done, NOT_READY would mean a scope never ended */
+        VkResult result = vkGetQueryPoolResults(
+            _device, _query_pool, slot_index * _max_scopes * 2, query_count,
+            query_count * sizeof(uint64_t), _results.data(), sizeof(uint64_t),
+            VK_QUERY_RESULT_64_BIT);
+        if (result == VK_SUCCESS) {
+            for (size_t i = 0; i < slot.Names.size(); i++) {
+                uint64_t ticks = (_results[i * 2 + 1] - _results[i * 2]) & _tick_mask;
+                /* Lookup without a key string : no allocation once the scope exists */
+                auto scope = _scopes.find(slot.Names[i]);
+                if (scope == _scopes.end()) {
+                    scope = _scopes.emplace(slot.Names[i], RollingStats(_window)).first;
+                }
+                scope->second.Add(ticks * _ns_per_tick / 1e6);
+            }
+        }
+        slot.Names.clear();
+    }
+
+    VkDevice                            _device;
+    VkQueryPool                         _query_pool = VK_NULL_HANDLE;
+    uint32_t                            _max_scopes = 0;
+    double                              _ns_per_tick = 1.0;
+    uint64_t                            _tick_mask   = ~0ull;
+    std::vector<Slot>                   _slots;
+    Slot*                               _current             = nullptr;
+    uint32_t                            _current_first_query = 0;
+    std::vector<uint64_t>               _results;
+    GpuScopeStats                       _scopes;
+    size_t                              _window = 256;
+};
+
+/*
+ * Scope for the lifetime of the object
+ */
+class GpuScope {
+  public:
+    GpuScope(GpuProfiler& profiler, VkCommandBuffer command_buffer, const char* name)
+        : _profiler(profiler), _command_buffer(command_buffer),
+          _scope(profiler.BeginScope(command_buffer, name)) {}
+    ~GpuScope() { _profiler.EndScope(_command_buffer, _scope); }
+
+  private:
+    GpuProfiler&    _profiler;
+    VkCommandBuffer _command_buffer;
+    uint32_t        _scope;
+};
+
+} // namespace Backend
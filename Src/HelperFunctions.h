@@ -1,4 +1,6 @@
 #pragma once
+#include "HostAllocator.h"
+
 #include <fstream>
 #include <vector>
 #include <vulkan/vulkan.h>
@@ -41,7 +43,8 @@ VkPipelineShaderStageCreateInfo LoadShader(const char*           filepath,
     module_info.pCode = reinterpret_cast<const uint32*>(shdcode.data());
 
     VkShaderModule shader_module;
-    VK_ASSERT(vkCreateShaderModule(device, &module_info, nullptr, &shader_module),
+    VK_ASSERT(vkCreateShaderModule(device, &module_info,
+                                   Backend::HostCallbacks(), &shader_module),
               "Failed to create shader module");
 
     VkPipelineShaderStageCreateInfo stage_info={};
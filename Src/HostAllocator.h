@@ -0,0 +1,296 @@
+#pragma once
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+
+namespace Backend {
+
+/*
+ * Counters of an allocation scope (VkSystemAllocationScope), bytes as requested by the
+ * driver
+ */
+struct HostScopeStats {
+    uint64_t LiveBytes;
+    uint64_t PeakBytes;
+    uint64_t LiveCount;
+    uint64_t Allocations;   /* Since the start, moving reallocations included */
+    uint64_t PoolHits;      /* Allocations served from the freed blocks of the arena */
+    uint64_t InternalBytes; /* Driver's own allocations it reported (executable memory) */
+};
+
+/*
+ * VkAllocationCallbacks for every vkCreate/vkDestroy/vkAllocateMemory/vkFreeMemory, see
+ * HostCallbacks(). Each allocation scope has its own arena : power of two blocks from
+ * 32B to 64KiB are kept on free lists once freed and reused by the next allocations of
+ * that scope, so a steady frame loop stops hitting malloc. Larger blocks go to malloc.
+ * The freed blocks are only given back at exit.
+ * Enable() before the instance is created, the objects must be destroyed with the
+ * callbacks they were created with.
+ */
+class HostAllocator {
+  public:
+    static const uint32_t SCOPE_COUNT = VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE + 1;
+
+    static HostAllocator& Get() {
+        static HostAllocator allocator;
+        return allocator;
+    }
+
+    /*
+     * Only the first call counts : Vulkan objects can't change allocator
+     */
+    void Enable(bool enable) {
+        if (!_configured) {
+            _configured = true;
+            _enabled    = enable;
+        }
+    }
+
+    /* nullptr (driver's allocator) when not enabled */
+    const VkAllocationCallbacks* Callbacks() const {
+        return _enabled ? &_callbacks : nullptr;
+    }
+
+    bool Enabled() const { return _enabled; }
+
+    HostScopeStats ScopeStats(VkSystemAllocationScope scope) const {
+        const Arena&                arena = _arenas[scope];
+        std::lock_guard<std::mutex> lock(arena.Mutex);
+        return arena.Stats;
+    }
+
+    static const char* ScopeName(uint32_t scope) {
+        switch (scope) {
+        case VK_SYSTEM_ALLOCATION_SCOPE_COMMAND: return "command";
+        case VK_SYSTEM_ALLOCATION_SCOPE_OBJECT: return "object";
+        case VK_SYSTEM_ALLOCATION_SCOPE_CACHE: return "cache";
+        case VK_SYSTEM_ALLOCATION_SCOPE_DEVICE: return "device";
+        case VK_SYSTEM_ALLOCATION_SCOPE_INSTANCE: return "instance";
+        }
+        return "unknown";
+    }
+
+    /*
+     * One line per scope, with the allocations since the previous Report() : the churn
+     * of the frame loop
+     */
+    void Report(std::ostream& out) {
+        if (!_enabled) {
+            return;
+        }
+        for (uint32_t scope = 0; scope < SCOPE_COUNT; scope++) {
+            HostScopeStats stats = ScopeStats(static_cast<VkSystemAllocationScope>(scope));
+            out << "Host " << std::setw(8) << std::left << ScopeName(scope) << std::right
+                << ": " << stats.LiveBytes / 1024 << "KiB live (" << stats.LiveCount
+                << "), " << stats.PeakBytes / 1024 << "KiB peak, "
+                << stats.Allocations - _reported_allocations[scope] << " allocs ("
+                << stats.PoolHits - _reported_pool_hits[scope] << " pooled) since last, "
+                << stats.InternalBytes / 1024 << "KiB internal\n";
+            _reported_allocations[scope] = stats.Allocations;
+            _reported_pool_hits[scope]   = stats.PoolHits;
+        }
+    }
+
+    ~HostAllocator() {
+        for (Arena& arena : _arenas) {
+            for (Block*& list : arena.FreeLists) {
+                while (list) {
+                    Block* next = list->Next;
+                    std::free(list);
+                    list = next;
+                }
+            }
+        }
+    }
+
+  private:
+    static const uint32_t MIN_CLASS   = 5;  /* 32B */
+    static const uint32_t MAX_CLASS   = 16; /* 64KiB */
+    static const uint32_t CLASS_COUNT = MAX_CLASS - MIN_CLASS + 1;
+    static const uint32_t LARGE       = UINT32_MAX;
+
+    /* Just before the pointer given to the driver */
+    struct alignas(16) Header {
+        void*    Base;     /* What malloc returned */
+        size_t   Capacity; /* Usable bytes from Base */
+        size_t   Size;     /* Requested */
+        uint32_t Class;    /* LARGE when not pooled */
+        uint32_t Scope;
+    };
+
+    /* A freed block, on its arena's list */
+    struct Block {
+        Block* Next;
+    };
+
+    struct Arena {
+        mutable std::mutex Mutex;
+        Block*             FreeLists[CLASS_COUNT] = {};
+        HostScopeStats     Stats                  = {};
+    };
+
+    HostAllocator() {
+        _callbacks                       = {};
+        _callbacks.pUserData             = this;
+        _callbacks.pfnAllocation         = &_Allocation;
+        _callbacks.pfnReallocation       = &_Reallocation;
+        _callbacks.pfnFree               = &_Free;
+        _callbacks.pfnInternalAllocation = &_InternalAllocation;
+        _callbacks.pfnInternalFree       = &_InternalFree;
+    }
+
+    void* _Allocate(size_t size, size_t alignment, uint32_t scope) {
+        alignment   = std::max<size_t>(alignment, alignof(Header));
+        size_t need = sizeof(Header) + alignment - 1 + size;
+
+        uint32_t size_class = MIN_CLASS;
+        while (size_class <= MAX_CLASS && (size_t(1) << size_class) < need) {
+            size_class++;
+        }
+
+        Arena& arena = _arenas[scope];
+        void*  base  = nullptr;
+        size_t capacity;
+        {
+            std::lock_guard<std::mutex> lock(arena.Mutex);
+            if (size_class <= MAX_CLASS) {
+                capacity     = size_t(1) << size_class;
+                Block*& list = arena.FreeLists[size_class - MIN_CLASS];
+                if (list) {
+                    base = list;
+                    list = list->Next;
+                    arena.Stats.PoolHits++;
+                }
+            }
+            arena.Stats.Allocations++;
+            arena.Stats.LiveCount++;
+            arena.Stats.LiveBytes += size;
+            arena.Stats.PeakBytes = std::max(arena.Stats.PeakBytes, arena.Stats.LiveBytes);
+        }
+        if (size_class > MAX_CLASS) {
+            size_class = LARGE;
+            capacity   = need;
+        }
+        if (!base) {
+            base = std::malloc(capacity);
+            if (!base) {
+                _Unaccount(scope, size);
+                return nullptr;
+            }
+        }
+
+        uintptr_t user = reinterpret_cast<uintptr_t>(base) + sizeof(Header) + alignment - 1;
+        user &= ~uintptr_t(alignment - 1);
+        Header* header   = reinterpret_cast<Header*>(user) - 1;
+        header->Base     = base;
+        header->Capacity = capacity;
+        header->Size     = size;
+        header->Class    = size_class;
+        header->Scope    = scope;
+        return reinterpret_cast<void*>(user);
+    }
+
+    void _Release(void* memory) {
+        Header* header = static_cast<Header*>(memory) - 1;
+        _Unaccount(header->Scope, header->Size);
+        if (header->Class == LARGE) {
+            std::free(header->Base);
+            return;
+        }
+        Arena&                      arena = _arenas[header->Scope];
+        Block*&                     list  = arena.FreeLists[header->Class - MIN_CLASS];
+        Block*                      block = static_cast<Block*>(header->Base);
+        std::lock_guard<std::mutex> lock(arena.Mutex);
+        block->Next = list;
+        list        = block;
+    }
+
+    /* Live counters of a freed (or failed) allocation */
+    void _Unaccount(uint32_t scope, size_t size) {
+        Arena&                      arena = _arenas[scope];
+        std::lock_guard<std::mutex> lock(arena.Mutex);
+        arena.Stats.LiveCount--;
+        arena.Stats.LiveBytes -= size;
+    }
+
+    static void* VKAPI_PTR _Allocation(void* user_data, size_t size, size_t alignment,
+                                       VkSystemAllocationScope scope) {
+        return static_cast<HostAllocator*>(user_data)->_Allocate(size, alignment, scope);
+    }
+
+    static void* VKAPI_PTR _Reallocation(void* user_data, void* original, size_t size,
+                                         size_t alignment, VkSystemAllocationScope scope) {
+        HostAllocator* allocator = static_cast<HostAllocator*>(user_data);
+        if (!original) {
+            return allocator->_Allocate(size, alignment, scope);
+        }
+        if (size == 0) {
+            allocator->_Release(original);
+            return nullptr;
+        }
+
+        Header* header = static_cast<Header*>(original) - 1;
+        if (static_cast<uint8_t*>(original) + size <=
+                static_cast<uint8_t*>(header->Base) + header->Capacity &&
+            reinterpret_cast<uintptr_t>(original) % alignment == 0) {
+            /* Grows or shrinks in place */
+            Arena&                      arena = allocator->_arenas[header->Scope];
+            std::lock_guard<std::mutex> lock(arena.Mutex);
+            arena.Stats.LiveBytes = arena.Stats.LiveBytes - header->Size + size;
+            arena.Stats.PeakBytes = std::max(arena.Stats.PeakBytes, arena.Stats.LiveBytes);
+            header->Size          = size;
+            return original;
+        }
+
+        void* memory = allocator->_Allocate(size, alignment, scope);
+        if (memory) {
+            std::memcpy(memory, original, std::min(size, header->Size));
+            allocator->_Release(original);
+        }
+        return memory;
+    }
+
+    static void VKAPI_PTR _Free(void* user_data, void* memory) {
+        if (memory) {
+            static_cast<HostAllocator*>(user_data)->_Release(memory);
+        }
+    }
+
+    static void VKAPI_PTR _InternalAllocation(void* user_data, size_t size,
+                                              VkInternalAllocationType,
+                                              VkSystemAllocationScope scope) {
+        Arena& arena = static_cast<HostAllocator*>(user_data)->_arenas[scope];
+        std::lock_guard<std::mutex> lock(arena.Mutex);
+        arena.Stats.InternalBytes += size;
+    }
+
+    static void VKAPI_PTR _InternalFree(void* user_data, size_t size,
+                                        VkInternalAllocationType,
+                                        VkSystemAllocationScope scope) {
+        Arena& arena = static_cast<HostAllocator*>(user_data)->_arenas[scope];
+        std::lock_guard<std::mutex> lock(arena.Mutex);
+        arena.Stats.InternalBytes -= size;
+    }
+
+    VkAllocationCallbacks _callbacks;
+    bool                  _configured = false;
+    bool                  _enabled    = false;
+    Arena                 _arenas[SCOPE_COUNT];
+    uint64_t              _reported_allocations[SCOPE_COUNT] = {};
+    uint64_t              _reported_pool_hits[SCOPE_COUNT]   = {};
+};
+
+/*
+ * pAllocator of the vkCreate/vkDestroy/vkAllocateMemory/vkFreeMemory calls
+ */
+inline const VkAllocationCallbacks* HostCallbacks() {
+    return HostAllocator::Get().Callbacks();
+}
+
+} // namespace Backend
@@ -0,0 +1,505 @@
+#pragma once
+#include "CpuProfiler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace Backend {
+
+template <typename Signature>
+class FunctionRef;
+
+/*
+ * Non owning reference to a callable, what std::function is for the duration of a call
+ * without its heap allocation (a lambda capturing more than two pointers allocates
+ * once per std::function). The callable must outlive the FunctionRef.
+ */
+template <typename Result, typename... Args>
+class FunctionRef<Result(Args...)> {
+  public:
+    template <typename Callable, typename = std::enable_if_t<!std::is_same<
+                                     std::decay_t<Callable>, FunctionRef>::value>>
+    FunctionRef(Callable&& callable)
+        : _callable(const_cast<void*>(static_cast<const void*>(std::addressof(callable)))),
+          _invoke([](void* target, Args... args) -> Result {
+              return (*static_cast<std::remove_reference_t<Callable>*>(target))(
+                  std::forward<Args>(args)...);
+          }) {}
+
+    Result operator()(Args... args) const {
+        return _invoke(_callable, std::forward<Args>(args)...);
+    }
+
+  private:
+    void* _callable;
+    Result (*_invoke)(void*, Args...);
+};
+
+/*
+ * Jobs left before JobSystem::Wait() returns, the dependency between a group of jobs
+ * and what needs their results. Must outlive its jobs.
+ */
+class JobCounter {
+  public:
+    bool IsDone() const { return _pending.load(std::memory_order_acquire) == 0; }
+
+  private:
+    friend class JobSystem;
+
+    std::atomic<uint32_t> _pending{0};
+    std::atomic<bool>     _failed{false};
+    std::exception_ptr    _exception; /* First exception of the jobs, set once */
+};
+
+/*
+ * Work stealing scheduler : every thread has its own queue, a thread runs the newest
+ * jobs of its queue first (still in cache) and steals the oldest ones of the other
+ * queues when its own is empty. The main thread is thread 0 : it runs jobs while it
+ * waits in Wait() or ParallelFor(), the workers are threads 1 to ThreadCount() - 1.
+ * Jobs that must run on the main thread (GLFW calls) go through SubmitMain().
+ * Submit(job, &counter) ... Wait(counter), or ParallelFor() which does both.
+ * An exception thrown by a job is rethrown by the Wait() of its counter. A job without
+ * a counter that throws while a thread helps in Wait() is rethrown by that Wait() once
+ * the counter is done (never while its jobs still run), RunMainThreadJobs() rethrows
+ * it directly. On a worker's own loop it terminates : give it a counter.
+ */
+class JobSystem {
+  public:
+    static constexpr uint32_t NOT_A_JOB_THREAD = UINT32_MAX;
+
+    /*
+     * Must be called from the main thread
+     * @param thread_count (Optional) : Threads running jobs, main thread included.
+     *                                  0 uses one thread per core
+     */
+    void Init(uint32_t thread_count = 0) {
+        if (thread_count == 0) {
+            thread_count = std::max(1u, std::thread::hardware_concurrency());
+        }
+        _queues = std::vector<Queue>(thread_count);
+        _quit.store(false, std::memory_order_relaxed);
+        _SetThreadIndex(0);
+        for (uint32_t i = 1; i < thread_count; i++) {
+            _threads.emplace_back(&JobSystem::_WorkerLoop, this, i);
+        }
+    }
+
+    uint32_t ThreadCount() const { return static_cast<uint32_t>(_queues.size()); }
+
+    /* 0 on the main thread, NOT_A_JOB_THREAD on a thread the system doesn't own */
+    uint32_t ThreadIndex() const {
+        const ThreadSlot& slot = _ThreadSlot();
+        return slot.System == this ? slot.Index : NOT_A_JOB_THREAD;
+    }
+
+    /*
+     * Run a job on any thread
+     * @param counter (Optional) : Counts the job until it's done
+     */
+    void Submit(std::function<void()> job, JobCounter* counter = nullptr) {
+        if (counter) {
+            counter->_pending.fetch_add(1, std::memory_order_relaxed);
+        }
+        _Push({&JobSystem::_RunFunction, new std::function<void()>(std::move(job)), 0, 0,
+               counter});
+        _WakeWorkers(1);
+    }
+
+    /*
+     * Run a job on the main thread, on its next RunMainThreadJobs() or while it waits
+     */
+    void SubmitMain(std::function<void()> job, JobCounter* counter = nullptr) {
+        if (counter) {
+            counter->_pending.fetch_add(1, std::memory_order_relaxed);
+        }
+        std::lock_guard<std::mutex> lock(_main_mutex);
+        _main_jobs.push_back({std::move(job), counter});
+    }
+
+    /*
+     * Main thread only, once per frame. When a job without a counter throws, the jobs
+     * after it are queued again before the exception leaves.
+     */
+    void RunMainThreadJobs() {
+        std::vector<MainJob> jobs;
+        {
+            std::lock_guard<std::mutex> lock(_main_mutex);
+            jobs.swap(_main_jobs);
+        }
+        for (size_t i = 0; i < jobs.size(); i++) {
+            try {
+                _Execute([&jobs, i] { jobs[i].Function(); }, jobs[i].Counter);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(_main_mutex);
+                _main_jobs.insert(_main_jobs.begin(),
+                                  std::make_move_iterator(jobs.begin() + i + 1),
+                                  std::make_move_iterator(jobs.end()));
+                throw;
+            }
+        }
+    }
+
+    /*
+     * Run or steal jobs until the counter's jobs are done (any thread of the system,
+     * other threads only steal)
+     */
+    void Wait(JobCounter& counter) {
+        std::exception_ptr uncounted = _Help(counter);
+        if (counter._failed.load(std::memory_order_acquire)) {
+            std::rethrow_exception(counter._exception);
+        }
+        if (uncounted) {
+            std::rethrow_exception(uncounted);
+        }
+    }
+
+    /*
+     * Wait() that drops the jobs' exceptions, for the paths already unwinding (JobGuard)
+     */
+    void WaitNoThrow(JobCounter& counter) noexcept { _Help(counter); }
+
+    /*
+     * Call body(first, last) on sub ranges of [begin, end) in parallel and wait, the
+     * calling thread takes part. No heap allocation once the queues have grown.
+     * @param grain : Items per job, at least 1
+     */
+    void ParallelFor(uint32_t begin, uint32_t end, uint32_t grain,
+                     FunctionRef<void(uint32_t first, uint32_t last)> body) {
+        if (begin >= end) {
+            return;
+        }
+        grain = std::max(1u, grain);
+        JobCounter counter;
+        uint32_t   job_count = (end - begin + grain - 1) / grain;
+        counter._pending.store(job_count, std::memory_order_relaxed);
+        for (uint32_t first = begin; first < end; first += std::min(grain, end - first)) {
+            uint32_t last = first + std::min(grain, end - first);
+            _Push({&JobSystem::_RunRange, &body, first, last, &counter});
+        }
+        _WakeWorkers(job_count);
+        Wait(counter);
+    }
+
+    /* Jobs taken from another thread's queue, since the start */
+    uint64_t Steals() const { return _steals.load(std::memory_order_relaxed); }
+
+    /*
+     * Jobs still queued are dropped, nothing must be waiting on them. The jobs being run
+     * are finished first.
+     */
+    void Destroy() {
+        {
+            std::lock_guard<std::mutex> lock(_sleep_mutex);
+            _quit.store(true, std::memory_order_release);
+        }
+        _wake.notify_all();
+        for (std::thread& thread : _threads) {
+            thread.join();
+        }
+        _threads.clear();
+        for (Queue& queue : _queues) {
+            Job job;
+            while (queue.PopBack(job)) {
+                if (job.Run == &JobSystem::_RunFunction) {
+                    delete static_cast<std::function<void()>*>(job.Context);
+                }
+            }
+        }
+        _queues.clear();
+        if (ThreadIndex() != NOT_A_JOB_THREAD) {
+            _SetThreadIndex(NOT_A_JOB_THREAD);
+        }
+    }
+
+    /* Joins the workers if Destroy() wasn't called (exception before the cleanup) */
+    ~JobSystem() {
+        if (!_threads.empty() || !_queues.empty()) {
+            Destroy();
+        }
+    }
+
+  private:
+    struct Job {
+        void (*Run)(void* context, uint32_t first, uint32_t last);
+        void*       Context;
+        uint32_t    First;
+        uint32_t    Last;
+        JobCounter* Counter;
+    };
+
+    struct MainJob {
+        std::function<void()> Function;
+        JobCounter*           Counter;
+    };
+
+    /* Ring of jobs : the owner works at the back, thieves take from the front */
+    struct Queue {
+        std::mutex       Mutex;
+        std::vector<Job> Ring = std::vector<Job>(64);
+        size_t           Head = 0; /* Oldest */
+        size_t           Size = 0;
+
+        void PushBack(const Job& job) {
+            std::lock_guard<std::mutex> lock(Mutex);
+            if (Size == Ring.size()) {
+                std::vector<Job> grown(Ring.size() * 2);
+                for (size_t i = 0; i < Size; i++) {
+                    grown[i] = Ring[(Head + i) % Ring.size()];
+                }
+                Ring.swap(grown);
+                Head = 0;
+            }
+            Ring[(Head + Size) % Ring.size()] = job;
+            Size++;
+        }
+
+        bool PopBack(Job& job) {
+            std::lock_guard<std::mutex> lock(Mutex);
+            if (Size == 0) {
+                return false;
+            }
+            Size--;
+            job = Ring[(Head + Size) % Ring.size()];
+            return true;
+        }
+
+        bool PopFront(Job& job) {
+            std::lock_guard<std::mutex> lock(Mutex);
+            if (Size == 0) {
+                return false;
+            }
+            job  = Ring[Head];
+            Head = (Head + 1) % Ring.size();
+            Size--;
+            return true;
+        }
+    };
+
+    struct ThreadSlot {
+        const JobSystem* System = nullptr;
+        uint32_t         Index  = NOT_A_JOB_THREAD;
+    };
+
+    static ThreadSlot& _ThreadSlot() {
+        thread_local ThreadSlot slot;
+        return slot;
+    }
+
+    void _SetThreadIndex(uint32_t index) {
+        _ThreadSlot() = {index == NOT_A_JOB_THREAD ? nullptr : this, index};
+    }
+
+    static void _RunFunction(void* context, uint32_t, uint32_t) {
+        std::unique_ptr<std::function<void()>> function(
+            static_cast<std::function<void()>*>(context));
+        (*function)();
+    }
+
+    static void _RunRange(void* context, uint32_t first, uint32_t last) {
+        (*static_cast<FunctionRef<void(uint32_t, uint32_t)>*>(context))(first, last);
+    }
+
+    /* Jobs of threads the system doesn't own go to the main thread's queue */
+    void _Push(const Job& job) {
+        uint32_t self = ThreadIndex();
+        _queues[self == NOT_A_JOB_THREAD ? 0 : self].PushBack(job);
+        _queued.fetch_add(1, std::memory_order_release);
+    }
+
+    bool _Pop(uint32_t self, Job& job) {
+        if (_queues[self].PopBack(job)) {
+            _queued.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+        return false;
+    }
+
+    /* Oldest job of another queue, starting after our own */
+    bool _Steal(uint32_t self, Job& job) {
+        uint32_t count = ThreadCount();
+        uint32_t start = self == NOT_A_JOB_THREAD ? 0 : self + 1;
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t victim = (start + i) % count;
+            if (victim != self && _queues[victim].PopFront(job)) {
+                _queued.fetch_sub(1, std::memory_order_relaxed);
+                _steals.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /*
+     * Run jobs until the counter is done. The jobs run here may belong to other counters
+     * or to none : the first exception of a job without a counter is kept and returned,
+     * leaving now would unwind a ParallelFor() body its range jobs still point to.
+     */
+    std::exception_ptr _Help(JobCounter& counter) {
+        uint32_t           self = ThreadIndex();
+        std::exception_ptr uncounted;
+        while (!counter.IsDone()) {
+            try {
+                if (self == 0) {
+                    RunMainThreadJobs();
+                }
+                Job job;
+                if ((self != NOT_A_JOB_THREAD && _Pop(self, job)) || _Steal(self, job)) {
+                    _Run(job);
+                } else {
+                    std::this_thread::yield();
+                }
+            } catch (...) {
+                if (!uncounted) {
+                    uncounted = std::current_exception();
+                }
+            }
+        }
+        return uncounted;
+    }
+
+    void _Run(const Job& job) {
+        _Execute([&job] { job.Run(job.Context, job.First, job.Last); }, job.Counter);
+    }
+
+    template <typename Function>
+    static void _Execute(const Function& function, JobCounter* counter) {
+        try {
+            function();
+        } catch (...) {
+            if (!counter) {
+                throw;
+            }
+            if (!counter->_failed.exchange(true, std::memory_order_relaxed)) {
+                counter->_exception = std::current_exception();
+                counter->_failed.store(true, std::memory_order_release);
+            }
+        }
+        if (counter) {
+            /* Last access : the waiter may destroy the counter right after */
+            counter->_pending.fetch_sub(1, std::memory_order_acq_rel);
+        }
+    }
+
+    void _WakeWorkers(uint32_t job_count) {
+        if (_threads.empty()) {
+            return;
+        }
+        {
+            /* A worker between its last check and its wait can't miss the jobs */
+            std::lock_guard<std::mutex> lock(_sleep_mutex);
+        }
+        if (job_count == 1) {
+            _wake.notify_one();
+        } else {
+            _wake.notify_all();
+        }
+    }
+
+    void _WorkerLoop(uint32_t index) {
+        CPU_THREAD_NAME("Job worker " + std::to_string(index));
+        _SetThreadIndex(index);
+        while (!_quit.load(std::memory_order_acquire)) {
+            Job job;
+            if (_Pop(index, job) || _Steal(index, job)) {
+                _Run(job);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(_sleep_mutex);
+            _wake.wait(lock, [this] {
+                return _quit.load(std::memory_order_relaxed) ||
+                       _queued.load(std::memory_order_acquire) > 0;
+            });
+        }
+    }
+
+    std::vector<Queue>       _queues; /* One per thread, 0 : main thread */
+    std::vector<std::thread> _threads;
+    std::atomic<int64_t>     _queued{0}; /* Jobs in the queues, < 0 while pushing */
+    std::atomic<uint64_t>    _steals{0};
+
+    std::mutex              _sleep_mutex;
+    std::condition_variable _wake;
+    std::atomic<bool>       _quit{false}; /* Set under _sleep_mutex */
+
+    std::mutex           _main_mutex;
+    std::vector<MainJob> _main_jobs;
+};
+
+/*
+ * Waits on a counter when leaving the scope : an exception thrown while jobs are in
+ * flight can't destroy the counter (or what the jobs use) under them.
+ * JobCounter loaded; jobs.Submit(load, &loaded); JobGuard guard(jobs, loaded); ...
+ */
+class JobGuard {
+  public:
+    JobGuard(JobSystem& jobs, JobCounter& counter) : _jobs(jobs), _counter(counter) {}
+    JobGuard(const JobGuard&) = delete;
+    JobGuard& operator=(const JobGuard&) = delete;
+    ~JobGuard() { _jobs.WaitNoThrow(_counter); }
+
+  private:
+    JobSystem&  _jobs;
+    JobCounter& _counter;
+};
+
+/*
+ * Scaling of the scheduler : the same compute bound ParallelFor with 1 to max_threads
+ * threads, speedup against one thread
+ * @param max_threads (Optional) : 0 uses one thread per core
+ * @param item_count : Items of the loop, in jobs of grain items
+ */
+inline void BenchmarkJobSystem(uint32_t max_threads = 0, uint32_t item_count = 1 << 22,
+                               uint32_t grain = 4096, uint32_t iterations = 20) {
+    if (max_threads == 0) {
+        max_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    std::vector<float> values(item_count);
+    for (uint32_t i = 0; i < item_count; i++) {
+        values[i] = static_cast<float>(i % 1024);
+    }
+
+    using Clock      = std::chrono::high_resolution_clock;
+    double single_ms = 0.0;
+    float  sink      = 0.0f;
+    for (uint32_t thread_count = 1; thread_count <= max_threads; thread_count++) {
+        JobSystem jobs;
+        jobs.Init(thread_count);
+        auto start = Clock::now();
+        for (uint32_t it = 0; it < iterations; it++) {
+            jobs.ParallelFor(0, item_count, grain, [&](uint32_t first, uint32_t last) {
+                for (uint32_t i = first; i < last; i++) {
+                    values[i] = std::sqrt(values[i] * 1.0001f + 1.0f);
+                }
+            });
+        }
+        double ms =
+            std::chrono::duration<double, std::milli>(Clock::now() - start).count() /
+            iterations;
+        single_ms = thread_count == 1 ? ms : single_ms;
+        sink += values[item_count / 2];
+        std::cout << "Jobs(" << thread_count << " threads): " << ms << "ms, x"
+                  << single_ms / ms << " speedup, " << jobs.Steals() << " steals"
+                  << std::endl;
+        jobs.Destroy();
+    }
+    if (sink < 0.0f) {
+        std::cout << sink << std::endl; /* Keeps the loop */
+    }
+}
+
+} // namespace Backend
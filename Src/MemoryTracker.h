@@ -0,0 +1,231 @@
+#pragma once
+#include "HostAllocator.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Backend {
+
+enum class MemoryCategory {
+    Vertex,
+    Index,
+    Uniform,
+    Texture,
+    Attachment,
+    Staging,
+    Readback /* Host copies of the frames (FrameReadback) */
+};
+const uint32_t MEMORY_CATEGORY_COUNT = 7;
+
+inline const char* MemoryCategoryName(MemoryCategory category) {
+    switch (category) {
+    case MemoryCategory::Vertex: return "vertex";
+    case MemoryCategory::Index: return "index";
+    case MemoryCategory::Uniform: return "uniform";
+    case MemoryCategory::Texture: return "texture";
+    case MemoryCategory::Attachment: return "attachment";
+    case MemoryCategory::Staging: return "staging";
+    case MemoryCategory::Readback: return "readback";
+    }
+    return "unknown";
+}
+
+/*
+ * Checks that the device reports its memory budget (VK_EXT_memory_budget, read through
+ * vkGetPhysicalDeviceMemoryProperties2 : Vulkan 1.1)
+ */
+inline bool QueryMemoryBudgetSupport(VkPhysicalDevice dev) {
+    VkPhysicalDeviceProperties dev_properties;
+    vkGetPhysicalDeviceProperties(dev, &dev_properties);
+    if (dev_properties.apiVersion < VK_API_VERSION_1_1) {
+        return false;
+    }
+
+    uint32_t ext_count;
+    vkEnumerateDeviceExtensionProperties(dev, nullptr, &ext_count, nullptr);
+    std::vector<VkExtensionProperties> dev_available_ext(ext_count);
+    vkEnumerateDeviceExtensionProperties(dev, nullptr, &ext_count,
+                                         dev_available_ext.data());
+    return std::any_of(dev_available_ext.begin(), dev_available_ext.end(),
+                       [](const VkExtensionProperties& ext) {
+                           return strcmp(ext.extensionName,
+                                         VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0;
+                       });
+}
+
+struct HeapUsage {
+    VkDeviceSize Size;
+    VkDeviceSize Tracked; /* Live allocations made through the tracker */
+    VkDeviceSize Usage;   /* Whole process, as seen by the driver (budget extension) */
+    VkDeviceSize Budget;  /* What the process can allocate without trouble, else Size */
+    bool         DeviceLocal;
+};
+
+/*
+ * Every vkAllocateMemory/vkFreeMemory goes through Allocate()/Free(), which keep the
+ * live allocations with their size, heap, category and debug name.
+ * Without VK_EXT_memory_budget, the heap usage is the tracked bytes and the budget is
+ * the heap size.
+ */
+class MemoryTracker {
+  public:
+    /*
+     * @param budget : VK_EXT_memory_budget is enabled on the device
+     */
+    void Init(VkPhysicalDevice physical_dev, VkDevice device, bool budget) {
+        _physical_dev = physical_dev;
+        _device       = device;
+        _budget       = budget;
+        vkGetPhysicalDeviceMemoryProperties(physical_dev, &_properties);
+        _heap_bytes.assign(_properties.memoryHeapCount, 0);
+    }
+
+    /*
+     * vkAllocateMemory, accounted on success
+     * @param name : Debug name, in the allocation dump
+     */
+    VkResult Allocate(const VkMemoryAllocateInfo& alloc_info, VkDeviceMemory& memory,
+                      MemoryCategory category, const std::string& name) {
+        VkResult result = vkAllocateMemory(_device, &alloc_info, HostCallbacks(), &memory);
+        if (result != VK_SUCCESS) {
+            return result;
+        }
+
+        uint32_t heap = _properties.memoryTypes[alloc_info.memoryTypeIndex].heapIndex;
+        std::lock_guard<std::mutex> lock(_mutex);
+        _live[memory] = {alloc_info.allocationSize, heap, category, name};
+        _heap_bytes[heap] += alloc_info.allocationSize;
+        _category_bytes[static_cast<uint32_t>(category)] += alloc_info.allocationSize;
+        return result;
+    }
+
+    /*
+     * vkFreeMemory, VK_NULL_HANDLE is ignored
+     */
+    void Free(VkDeviceMemory memory) {
+        if (memory == VK_NULL_HANDLE) {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            auto                        allocation = _live.find(memory);
+            if (allocation != _live.end()) {
+                _heap_bytes[allocation->second.Heap] -= allocation->second.Size;
+                _category_bytes[static_cast<uint32_t>(allocation->second.Category)] -=
+                    allocation->second.Size;
+                _live.erase(allocation);
+            }
+        }
+        vkFreeMemory(_device, memory, HostCallbacks());
+    }
+
+    VkDeviceSize CategoryBytes(MemoryCategory category) const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _category_bytes[static_cast<uint32_t>(category)];
+    }
+
+    size_t AllocationCount() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _live.size();
+    }
+
+    /*
+     * Usage and budget of every heap, queried from the driver on each call
+     */
+    std::vector<HeapUsage> Heaps() const {
+        VkPhysicalDeviceMemoryBudgetPropertiesEXT budget = {};
+        budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+        if (_budget) {
+            VkPhysicalDeviceMemoryProperties2 properties = {};
+            properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+            properties.pNext = &budget;
+            vkGetPhysicalDeviceMemoryProperties2(_physical_dev, &properties);
+        }
+
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::vector<HeapUsage>      heaps(_properties.memoryHeapCount);
+        for (uint32_t i = 0; i < _properties.memoryHeapCount; i++) {
+            const VkMemoryHeap& heap = _properties.memoryHeaps[i];
+            heaps[i].Size            = heap.size;
+            heaps[i].Tracked         = _heap_bytes[i];
+            heaps[i].Usage           = _budget ? budget.heapUsage[i] : _heap_bytes[i];
+            heaps[i].Budget          = _budget ? budget.heapBudget[i] : heap.size;
+            heaps[i].DeviceLocal     = heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+        }
+        return heaps;
+    }
+
+    /* One line per heap, flags the ones over 90% of their budget */
+    void ReportHeaps(std::ostream& out) const {
+        std::vector<HeapUsage> heaps = Heaps();
+        for (size_t i = 0; i < heaps.size(); i++) {
+            const HeapUsage& heap = heaps[i];
+            out << "Heap " << i << (heap.DeviceLocal ? " (device)" : " (host)") << ": "
+                << _MiB(heap.Usage) << " / " << _MiB(heap.Budget) << "MiB "
+                << (_budget ? "budget" : "size") << ", " << _MiB(heap.Tracked)
+                << "MiB tracked" << (heap.Usage * 10 > heap.Budget * 9 ? " OVER 90%" : "")
+                << "\n";
+        }
+    }
+
+    void ReportCategories(std::ostream& out) const {
+        out << "Memory:";
+        for (uint32_t i = 0; i < MEMORY_CATEGORY_COUNT; i++) {
+            out << " " << MemoryCategoryName(static_cast<MemoryCategory>(i)) << " "
+                << _MiB(CategoryBytes(static_cast<MemoryCategory>(i))) << "MiB";
+        }
+        out << " (" << AllocationCount() << " allocations)\n";
+    }
+
+    /*
+     * Every live allocation, largest first
+     */
+    void DumpAllocations(std::ostream& out) const {
+        std::vector<Allocation> allocations;
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            for (const auto& allocation : _live) {
+                allocations.push_back(allocation.second);
+            }
+        }
+        std::sort(allocations.begin(), allocations.end(),
+                  [](const Allocation& a, const Allocation& b) { return a.Size > b.Size; });
+
+        out << "Live allocations (" << allocations.size() << "):\n";
+        for (const Allocation& allocation : allocations) {
+            out << std::setw(12) << allocation.Size << " B  heap " << allocation.Heap
+                << "  " << std::setw(10) << std::left << MemoryCategoryName(allocation.Category)
+                << std::right << " " << allocation.Name << "\n";
+        }
+    }
+
+  private:
+    struct Allocation {
+        VkDeviceSize   Size;
+        uint32_t       Heap;
+        MemoryCategory Category;
+        std::string    Name;
+    };
+
+    static double _MiB(VkDeviceSize bytes) { return bytes / (1024.0 * 1024.0); }
+
+    VkPhysicalDevice                 _physical_dev;
+    VkDevice                         _device;
+    bool                             _budget = false;
+    VkPhysicalDeviceMemoryProperties _properties;
+
+    mutable std::mutex                             _mutex;
+    std::unordered_map<VkDeviceMemory, Allocation> _live;
+    std::vector<VkDeviceSize>                      _heap_bytes;
+    VkDeviceSize _category_bytes[MEMORY_CATEGORY_COUNT] = {};
+};
+
+} // namespace Backend
@@ -0,0 +1,201 @@
+#pragma once
+#include "HostAllocator.h"
+
+#include <vulkan/vulkan.h>
+
+#include <iomanip>
+#include <map>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace Backend {
+
+/* Counters of a pass, in the order of their VkQueryPipelineStatisticFlagBits */
+struct PassStatistics {
+    uint64_t InputVertices;       /* Input assembly */
+    uint64_t InputPrimitives;     /* Input assembly */
+    uint64_t VertexInvocations;   /* Vertex shader, below InputVertices with vertex reuse */
+    uint64_t ClippingInvocations; /* Primitives reaching the clipper */
+    uint64_t ClippingPrimitives;  /* Primitives out of the clipper (culled ones excluded) */
+    uint64_t FragmentInvocations; /* Fragment shader */
+};
+
+/*
+ * VK_QUERY_TYPE_PIPELINE_STATISTICS per named pass, needs the pipelineStatisticsQuery
+ * feature, and inheritedQueries since the passes execute secondary command buffers.
+ * Same ring as GpuProfiler : every frame in flight owns a range of queries, read
+ * without waiting when the frame slot comes back.
+ * BeginFrame(slot) -> BeginPass()/EndPass() around render passes -> submit
+ * Secondary command buffers executed in a pass must inherit Flags()
+ * (VkCommandBufferInheritanceInfo::pipelineStatistics).
+ */
+class PipelineStatistics {
+  public:
+    static VkQueryPipelineStatisticFlags Flags() {
+        return VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+               VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_PRIMITIVES_BIT |
+               VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+               VK_QUERY_PIPELINE_STATISTIC_CLIPPING_INVOCATIONS_BIT |
+               VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+               VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT;
+    }
+
+    static bool IsSupported(VkPhysicalDevice physical_dev) {
+        VkPhysicalDeviceFeatures features;
+        vkGetPhysicalDeviceFeatures(physical_dev, &features);
+        return features.pipelineStatisticsQuery && features.inheritedQueries;
+    }
+
+    /*
+     * The device must have been created with pipelineStatisticsQuery and inheritedQueries
+     * enabled
+     * @param frame_count : Frames in flight
+     * @param max_passes : Passes per frame, the following ones are ignored
+     */
+    void Init(VkDevice device, uint32_t frame_count, uint32_t max_passes = 8) {
+        _device     = device;
+        _max_passes = max_passes;
+        _slots.resize(frame_count);
+
+        VkQueryPoolCreateInfo pool_info = {};
+        pool_info.sType                 = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        pool_info.queryType             = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        pool_info.queryCount            = frame_count * max_passes;
+        pool_info.pipelineStatistics    = Flags();
+        if (vkCreateQueryPool(_device, &pool_info, HostCallbacks(), &_query_pool) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("Failed to create pipeline statistics QueryPool");
+        }
+        _results.resize(max_passes);
+    }
+
+    bool Enabled() const { return _query_pool != VK_NULL_HANDLE; }
+
+    /*
+     * Read the previous results of the slot and reset its queries, the slot's last
+     * submission must be done
+     * @param command_buffer : Command buffer of the frame, outside of a render pass
+     */
+    void BeginFrame(VkCommandBuffer command_buffer, uint32_t frame_index) {
+        if (!Enabled()) {
+            return;
+        }
+        Slot& slot = _slots[frame_index];
+        _Resolve(slot, frame_index);
+
+        _current             = &slot;
+        _current_first_query = frame_index * _max_passes;
+        vkCmdResetQueryPool(command_buffer, _query_pool, _current_first_query, _max_passes);
+    }
+
+    /*
+     * @param name : The last pass of a name in the frame is the one reported, must
+     *               outlive the object
+     * @return : Handle for EndPass()
+     */
+    uint32_t BeginPass(VkCommandBuffer command_buffer, const char* name) {
+        if (!Enabled() || _current->Names.size() == _max_passes) {
+            return UINT32_MAX;
+        }
+        uint32_t pass = static_cast<uint32_t>(_current->Names.size());
+        _current->Names.push_back(name);
+        vkCmdBeginQuery(command_buffer, _query_pool, _current_first_query + pass, 0);
+        return pass;
+    }
+
+    void EndPass(VkCommandBuffer command_buffer, uint32_t pass) {
+        if (pass != UINT32_MAX) {
+            vkCmdEndQuery(command_buffer, _query_pool, _current_first_query + pass);
+        }
+    }
+
+    /*
+     * Forget the last results and the queries still pending in the slots (ex: the
+     * benchmark warmup), the next frames start from empty statistics
+     */
+    void Reset() {
+        for (Slot& slot : _slots) {
+            slot.Names.clear();
+        }
+        _passes.clear();
+    }
+
+    /* Last results of every pass, by name */
+    const std::map<std::string, PassStatistics>& Passes() const { return _passes; }
+
+    /*
+     * One line per pass, with the vertex reuse (invocations / input vertices) and the
+     * fragments per visible primitive
+     */
+    void Report(std::ostream& out) const {
+        std::streamsize precision = out.precision();
+        for (const auto& pass : _passes) {
+            const PassStatistics& stats = pass.second;
+            out << "Stats " << pass.first << ": " << stats.InputVertices << " vertices, "
+                << stats.InputPrimitives << " primitives (" << stats.ClippingPrimitives
+                << " visible), VS " << stats.VertexInvocations << " ("
+                << std::setprecision(3)
+                << _Ratio(stats.VertexInvocations, stats.InputVertices) << "/vertex), FS "
+                << stats.FragmentInvocations << " ("
+                << _Ratio(stats.FragmentInvocations, stats.ClippingPrimitives)
+                << "/primitive)\n";
+        }
+        out.precision(precision);
+    }
+
+    /* Short form for a window title */
+    std::string Summary() const {
+        std::ostringstream summary;
+        for (const auto& pass : _passes) {
+            summary << pass.first << " VS " << pass.second.VertexInvocations << " FS "
+                    << pass.second.FragmentInvocations << " prims "
+                    << pass.second.ClippingPrimitives << "  ";
+        }
+        return summary.str();
+    }
+
+    void Destroy() {
+        if (_query_pool != VK_NULL_HANDLE) {
+            vkDestroyQueryPool(_device, _query_pool, HostCallbacks());
+            _query_pool = VK_NULL_HANDLE;
+        }
+    }
+
+  private:
+    struct Slot {
+        std::vector<const char*> Names; /* Passes written since the last reset */
+    };
+
+    void _Resolve(Slot& slot, uint32_t slot_index) {
+        if (slot.Names.empty()) {
+            return;
+        }
+        uint32_t query_count = static_cast<uint32_t>(slot.Names.size());
+        VkResult result      = vkGetQueryPoolResults(
+            _device, _query_pool, slot_index * _max_passes, query_count,
+            query_count * sizeof(PassStatistics), _results.data(), sizeof(PassStatistics),
+            VK_QUERY_RESULT_64_BIT);
+        if (result == VK_SUCCESS) {
+            for (size_t i = 0; i < slot.Names.size(); i++) {
+                _passes[slot.Names[i]] = _results[i];
+            }
+        }
+        slot.Names.clear();
+    }
+
+    static double _Ratio(uint64_t a, uint64_t b) { return b ? double(a) / b : 0.0; }
+
+    VkDevice                              _device;
+    VkQueryPool                           _query_pool = VK_NULL_HANDLE;
+    uint32_t                              _max_passes = 0;
+    std::vector<Slot>                     _slots;
+    Slot*                                 _current             = nullptr;
+    uint32_t                              _current_first_query = 0;
+    std::vector<PassStatistics>           _results;
+    std::map<std::string, PassStatistics> _passes;
+};
+
+} // namespace Backend
@@ -0,0 +1,67 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace Backend {
+
+/*
+ * Last N samples of a metric, for averages and percentiles without keeping the history
+ */
+class RollingStats {
+  public:
+    explicit RollingStats(size_t window = 256) : _window(window) {}
+
+    void Add(double value) {
+        if (_samples.size() < _window) {
+            _samples.push_back(value);
+        } else {
+            _samples[_next] = value;
+        }
+        _next = (_next + 1) % _window;
+        _count++;
+    }
+
+    double Average() const {
+        if (_samples.empty()) {
+            return 0.0;
+        }
+        double sum = 0.0;
+        for (double sample : _samples) {
+            sum += sample;
+        }
+        return sum / _samples.size();
+    }
+
+    /*
+     * @param percentile : In [0, 100], nearest rank over the window
+     */
+    double Percentile(double percentile) const {
+        if (_samples.empty()) {
+            return 0.0;
+        }
+        _sorted = _samples;
+        size_t rank =
+            static_cast<size_t>(percentile / 100.0 * (_sorted.size() - 1) + 0.5);
+        rank = std::min(rank, _sorted.size() - 1);
+        std::nth_element(_sorted.begin(), _sorted.begin() + rank, _sorted.end());
+        return _sorted[rank];
+    }
+
+    double Max() const {
+        return _samples.empty() ? 0.0 : *std::max_element(_samples.begin(), _samples.end());
+    }
+
+    size_t SampleCount() const { return _samples.size(); }
+    /* Every sample ever added */
+    uint64_t TotalCount() const { return _count; }
+
+  private:
+    size_t                      _window;
+    std::vector<double>         _samples;
+    mutable std::vector<double> _sorted; /* Percentile() scratch */
+    size_t                      _next  = 0;
+    uint64_t                    _count = 0;
+};
+
+} // namespace Backend
@@ -0,0 +1,205 @@
+#pragma once
+#include "HostAllocator.h"
+
+#include <vulkan/vulkan.h>
+
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <unordered_map>
+
+namespace Backend {
+
+enum class LightingModel : uint32_t { Unlit = 0, Phong = 1, Toon = 2 };
+
+/* Optional terms of the lighting models */
+enum ShaderFeatureBits : uint32_t {
+    SHADER_FEATURE_TEXTURE  = 1 << 0,
+    SHADER_FEATURE_DIFFUSE  = 1 << 1,
+    SHADER_FEATURE_SPECULAR = 1 << 2,
+    SHADER_FEATURE_RIM      = 1 << 3,
+};
+
+/*
+ * What a material asks for. Several materials can end up using the same
+ * variant once SelectVariant() has removed the terms that have no effect.
+ */
+struct MaterialShading {
+    LightingModel Model    = LightingModel::Toon;
+    uint32_t      Features = SHADER_FEATURE_DIFFUSE | SHADER_FEATURE_SPECULAR |
+                        SHADER_FEATURE_RIM;
+    float Glossiness      = 64.f;
+    float RimAmount       = 0.716f;
+    float AmbientStrength = 0.4f;
+    float AmbientColor[3]  = {0.24725f, 0.1995f, 0.0745f};
+    float DiffuseColor[3]  = {0.75164f, 0.60648f, 0.22648f};
+    float SpecularColor[3] = {0.628281f, 0.555802f, 0.366065f};
+    float ObjectColor[3]   = {0.4f, 0.3f, 0.2f};
+};
+
+/*
+ * Specialization constants of Shaders/shader.frag.
+ * Member i is bound to constant_id i, every member is 4 bytes so the struct has no
+ * padding and can be hashed/compared as raw bytes.
+ */
+struct ShaderConstants {
+    uint32_t LightingModel;
+    VkBool32 UseTexture;
+    VkBool32 UseDiffuse;
+    VkBool32 UseSpecular;
+    VkBool32 UseRim;
+    float    Glossiness;
+    float    RimAmount;
+    float    AmbientStrength;
+    float    AmbientColor[3];
+    float    DiffuseColor[3];
+    float    SpecularColor[3];
+    float    ObjectColor[3];
+};
+
+static const uint32_t SHADER_CONSTANT_COUNT = sizeof(ShaderConstants) / sizeof(uint32_t);
+
+/*
+ * Map entries for ShaderConstants (constant_id i <--> i-th 4 bytes)
+ */
+inline const std::array<VkSpecializationMapEntry, SHADER_CONSTANT_COUNT>&
+GetShaderConstantEntries() {
+    static std::array<VkSpecializationMapEntry, SHADER_CONSTANT_COUNT> entries = [] {
+        std::array<VkSpecializationMapEntry, SHADER_CONSTANT_COUNT> map = {};
+        for (uint32_t i = 0; i < SHADER_CONSTANT_COUNT; i++) {
+            map[i].constantID = i;
+            map[i].offset     = i * sizeof(uint32_t);
+            map[i].size       = sizeof(uint32_t);
+        }
+        return map;
+    }();
+    return entries;
+}
+
+/*
+ * Builds the minimal variant for a material : every term that can't change the
+ * output is turned off and its parameters are zeroed, so the branch is folded away
+ * when the pipeline is compiled and equivalent materials share the same key.
+ * @param material : The material to be rendered
+ */
+inline ShaderConstants SelectVariant(const MaterialShading& material) {
+    ShaderConstants constants = {};
+    constants.LightingModel   = static_cast<uint32_t>(material.Model);
+    memcpy(constants.ObjectColor, material.ObjectColor, sizeof(constants.ObjectColor));
+
+    if (material.Features & SHADER_FEATURE_TEXTURE) {
+        constants.UseTexture = VK_TRUE;
+    }
+    if (material.Model == LightingModel::Unlit) {
+        return constants;
+    }
+
+    constants.AmbientStrength = material.AmbientStrength;
+    memcpy(constants.AmbientColor, material.AmbientColor, sizeof(constants.AmbientColor));
+
+    auto is_black = [](const float* color) {
+        return color[0] <= 0.f && color[1] <= 0.f && color[2] <= 0.f;
+    };
+
+    if ((material.Features & SHADER_FEATURE_DIFFUSE) && !is_black(material.DiffuseColor)) {
+        constants.UseDiffuse = VK_TRUE;
+        memcpy(constants.DiffuseColor, material.DiffuseColor,
+               sizeof(constants.DiffuseColor));
+    }
+    if ((material.Features & SHADER_FEATURE_SPECULAR) && material.Glossiness > 0.f &&
+        !is_black(material.SpecularColor)) {
+        constants.UseSpecular = VK_TRUE;
+        constants.Glossiness  = material.Glossiness;
+        memcpy(constants.SpecularColor, material.SpecularColor,
+               sizeof(constants.SpecularColor));
+    }
+    /* Rim lighting only exists in the toon model, and 1 - dot(V, N) can't reach the
+     * smoothstep edge when RimAmount > 1 */
+    if (material.Model == LightingModel::Toon &&
+        (material.Features & SHADER_FEATURE_RIM) && material.RimAmount < 1.01f) {
+        constants.UseRim    = VK_TRUE;
+        constants.RimAmount = material.RimAmount;
+    }
+
+    return constants;
+}
+
+/*
+ * Pipelines are compiled the first time a variant is requested and shared by every
+ * material that maps to the same ShaderConstants.
+ */
+class ShaderVariantCache {
+  public:
+    /* Creates the pipeline of a variant from the fragment stage specialization */
+    using PipelineBuilder = std::function<VkPipeline(const VkSpecializationInfo&)>;
+
+    /*
+     * @param device : Device that owns the pipelines
+     * @param builder : Called once per new variant
+     */
+    void Init(VkDevice device, PipelineBuilder builder) {
+        _device  = device;
+        _builder = builder;
+    }
+
+    /*
+     * Returns the pipeline of the variant, compiling it if needed
+     * @param constants : Usually the result of SelectVariant()
+     */
+    VkPipeline Get(const ShaderConstants& constants) {
+        auto it = _variants.find(constants);
+        if (it != _variants.end()) {
+            return it->second;
+        }
+
+        const auto& entries = GetShaderConstantEntries();
+
+        VkSpecializationInfo specialization = {};
+        specialization.mapEntryCount        = static_cast<uint32_t>(entries.size());
+        specialization.pMapEntries          = entries.data();
+        specialization.dataSize             = sizeof(ShaderConstants);
+        specialization.pData                = &constants;
+
+        VkPipeline pipeline = _builder(specialization);
+        _variants.emplace(constants, pipeline);
+        return pipeline;
+    }
+
+    size_t VariantCount() const { return _variants.size(); }
+
+    /*
+     * Destroy every compiled variant
+     */
+    void Destroy() {
+        for (auto& variant : _variants) {
+            vkDestroyPipeline(_device, variant.second, HostCallbacks());
+        }
+        _variants.clear();
+    }
+
+  private:
+    struct ConstantsHash {
+        size_t operator()(const ShaderConstants& constants) const {
+            /* FNV-1a over the raw words */
+            const uint32_t* words = reinterpret_cast<const uint32_t*>(&constants);
+            uint64_t        hash  = 14695981039346656037ull;
+            for (uint32_t i = 0; i < SHADER_CONSTANT_COUNT; i++) {
+                hash = (hash ^ words[i]) * 1099511628211ull;
+            }
+            return static_cast<size_t>(hash);
+        }
+    };
+    struct ConstantsEqual {
+        bool operator()(const ShaderConstants& a, const ShaderConstants& b) const {
+            return memcmp(&a, &b, sizeof(ShaderConstants)) == 0;
+        }
+    };
+
+    VkDevice        _device = VK_NULL_HANDLE;
+    PipelineBuilder _builder;
+    std::unordered_map<ShaderConstants, VkPipeline, ConstantsHash, ConstantsEqual>
+        _variants;
+};
+
+} // namespace Backend
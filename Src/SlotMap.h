@@ -0,0 +1,152 @@
+#pragma once
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace Backend {
+
+/*
+ * Reference to a SlotMap<T> entry : slot index plus the generation of the slot when the
+ * entry was created. Once the entry is destroyed the slot's generation moves on and the
+ * handle is stale instead of dangling. A default handle is never valid.
+ */
+template <typename T>
+struct Handle {
+    uint32_t Index      = 0;
+    uint32_t Generation = 0; /* 0 : null handle */
+
+    bool IsNull() const { return Generation == 0; }
+    bool operator==(const Handle& other) const {
+        return Index == other.Index && Generation == other.Generation;
+    }
+    bool operator!=(const Handle& other) const { return !(*this == other); }
+};
+
+/*
+ * Generational pool : O(1) Create()/Destroy()/Get(), stale handle detection.
+ * The values are kept packed in one array (destroying swaps the last value into the
+ * hole), so iterating over the live entries is a linear walk without holes; the order
+ * isn't stable. Handles go through a slot array to their value, never a pointer :
+ * a T* from Get() is only valid until the next Create() or Destroy().
+ * Only used by DeferredRenderer (materials, lights, pipelines) so far, which isn't part
+ * of the build : nothing compiled instantiates it yet.
+ */
+template <typename T>
+class SlotMap {
+  public:
+    /*
+     * @param capacity : Entries reserved up front
+     */
+    void Reserve(size_t capacity) {
+        _values.reserve(capacity);
+        _dense_to_slot.reserve(capacity);
+        _slots.reserve(capacity);
+    }
+
+    Handle<T> Create(T value) {
+        uint32_t slot_index;
+        if (_free_head != NO_SLOT) {
+            slot_index = _free_head;
+            _free_head = _slots[slot_index].NextFree;
+        } else {
+            if (_slots.size() == NO_SLOT) {
+                throw std::runtime_error("SlotMap is full");
+            }
+            slot_index = static_cast<uint32_t>(_slots.size());
+            _slots.push_back({});
+        }
+
+        Slot& slot      = _slots[slot_index];
+        slot.DenseIndex = static_cast<uint32_t>(_values.size());
+        _values.push_back(std::move(value));
+        _dense_to_slot.push_back(slot_index);
+        return {slot_index, slot.Generation};
+    }
+
+    /*
+     * @return : False if the handle is stale (already destroyed) or null
+     */
+    bool Destroy(Handle<T> handle) {
+        if (!Contains(handle)) {
+            return false;
+        }
+        Slot&    slot = _slots[handle.Index];
+        uint32_t hole = slot.DenseIndex;
+        uint32_t last = static_cast<uint32_t>(_values.size() - 1);
+        if (hole != last) {
+            _values[hole]                           = std::move(_values[last]);
+            _dense_to_slot[hole]                    = _dense_to_slot[last];
+            _slots[_dense_to_slot[hole]].DenseIndex = hole;
+        }
+        _values.pop_back();
+        _dense_to_slot.pop_back();
+
+        slot.DenseIndex = NO_SLOT;
+        slot.Generation++;
+        if (slot.Generation == 0) {
+            /* Every generation was used : the slot is retired, old handles stay stale */
+            return true;
+        }
+        slot.NextFree = _free_head;
+        _free_head    = handle.Index;
+        return true;
+    }
+
+    bool Contains(Handle<T> handle) const {
+        return handle.Index < _slots.size() && !handle.IsNull() &&
+               _slots[handle.Index].Generation == handle.Generation &&
+               _slots[handle.Index].DenseIndex != NO_SLOT;
+    }
+
+    /* nullptr for a stale or null handle */
+    T* Get(Handle<T> handle) {
+        return Contains(handle) ? &_values[_slots[handle.Index].DenseIndex] : nullptr;
+    }
+    const T* Get(Handle<T> handle) const {
+        return Contains(handle) ? &_values[_slots[handle.Index].DenseIndex] : nullptr;
+    }
+
+    /* Handle of the value at a position of the packed array */
+    Handle<T> HandleAt(size_t dense_index) const {
+        uint32_t slot_index = _dense_to_slot[dense_index];
+        return {slot_index, _slots[slot_index].Generation};
+    }
+
+    size_t Size() const { return _values.size(); }
+    bool   Empty() const { return _values.empty(); }
+
+    /* The live values, packed */
+    T*       Data() { return _values.data(); }
+    const T* Data() const { return _values.data(); }
+
+    typename std::vector<T>::iterator       begin() { return _values.begin(); }
+    typename std::vector<T>::iterator       end() { return _values.end(); }
+    typename std::vector<T>::const_iterator begin() const { return _values.begin(); }
+    typename std::vector<T>::const_iterator end() const { return _values.end(); }
+
+    /*
+     * Destroy every entry, the handles given so far become stale
+     */
+    void Clear() {
+        while (!_values.empty()) {
+            Destroy(HandleAt(_values.size() - 1));
+        }
+    }
+
+  private:
+    static const uint32_t NO_SLOT = UINT32_MAX;
+
+    struct Slot {
+        uint32_t DenseIndex = NO_SLOT; /* Position in _values, NO_SLOT when free */
+        uint32_t Generation = 1;
+        uint32_t NextFree   = NO_SLOT; /* Free list, when free */
+    };
+
+    std::vector<T>        _values;
+    std::vector<uint32_t> _dense_to_slot; /* Position in _values -> slot */
+    std::vector<Slot>     _slots;
+    uint32_t              _free_head = NO_SLOT;
+};
+
+} // namespace Backend
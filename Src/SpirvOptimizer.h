@@ -0,0 +1,146 @@
+#pragma once
+#include <vulkan/spirv.hpp>
+
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace Backend {
+
+/*
+ * Load time SPIR-V passes.
+ * The heavy passes (inlining, dead code elimination, etc) are done offline by
+ * spirv-opt in compile_shaders.sh. The SDK doesn't ship the SPIRV-Tools libraries, so
+ * only the passes that need no knowledge of the operand grammar are done here.
+ */
+enum SpirvPassBits : uint32_t {
+    SPIRV_PASS_STRIP_DEBUG = 1 << 0, /* OpSource*, OpName, OpMemberName, OpString, OpLine */
+    SPIRV_PASS_STRIP_NOP   = 1 << 1, /* OpNop */
+};
+
+enum class SpirvOptimizationLevel { None, Performance, Size };
+
+struct SpirvStats {
+    uint32_t Instructions = 0;
+    size_t   Bytes        = 0;
+};
+
+/*
+ * Count the instructions of a module (every instruction starts with a word holding
+ * its own word count in the high 16 bits). Throws if an instruction is empty or runs
+ * past the end of the module.
+ * @param code : SPIR-V binary, as returned by ReadFile()
+ */
+inline SpirvStats CountInstructions(const std::vector<char>& code) {
+    const uint32_t* words      = reinterpret_cast<const uint32_t*>(code.data());
+    size_t          word_count = code.size() / sizeof(uint32_t);
+
+    if (code.size() % sizeof(uint32_t) != 0 || word_count < 5 ||
+        words[0] != spv::MagicNumber) {
+        throw std::runtime_error("Invalid SPIR-V module");
+    }
+
+    SpirvStats stats = {};
+    stats.Bytes      = code.size();
+    /* Skip header : magic, version, generator, bound, schema */
+    for (size_t i = 5; i < word_count;) {
+        uint32_t length = words[i] >> spv::WordCountShift;
+        if (length == 0 || i + length > word_count) {
+            throw std::runtime_error("Invalid SPIR-V instruction");
+        }
+        stats.Instructions++;
+        i += length;
+    }
+    return stats;
+}
+
+/*
+ * Pass list for a level. Release builds also strip the debug instructions, they only
+ * matter for RenderDoc and the validation layers.
+ * @param level : Performance drops the OpNops, Size also strips the debug instructions
+ *                (smaller modules and pipeline cache entries, no names in captures)
+ * @param release : Strip debug information
+ */
+inline uint32_t GetSpirvPasses(SpirvOptimizationLevel level, bool release) {
+    uint32_t passes = 0;
+    if (level != SpirvOptimizationLevel::None) {
+        passes |= SPIRV_PASS_STRIP_NOP;
+    }
+    if (release || level == SpirvOptimizationLevel::Size) {
+        passes |= SPIRV_PASS_STRIP_DEBUG;
+    }
+    return passes;
+}
+
+/*
+ * Run the passes on the module in place
+ * @param code : SPIR-V binary, as returned by ReadFile()
+ * @param passes : SpirvPassBits
+ */
+inline void OptimizeSpirv(std::vector<char>& code, uint32_t passes) {
+    if (passes == 0) {
+        return;
+    }
+    CountInstructions(code); /* Validates the module before rewriting it */
+
+    uint32_t* words      = reinterpret_cast<uint32_t*>(code.data());
+    size_t    word_count = code.size() / sizeof(uint32_t);
+    size_t    write      = 5;
+
+    for (size_t read = 5; read < word_count;) {
+        uint32_t length = words[read] >> spv::WordCountShift;
+        uint32_t opcode = words[read] & spv::OpCodeMask;
+        if (length == 0 || read + length > word_count) {
+            throw std::runtime_error("Invalid SPIR-V instruction");
+        }
+
+        bool strip = false;
+        if (passes & SPIRV_PASS_STRIP_DEBUG) {
+            switch (opcode) {
+            case spv::OpSourceContinued:
+            case spv::OpSource:
+            case spv::OpSourceExtension:
+            case spv::OpName:
+            case spv::OpMemberName:
+            case spv::OpString:
+            case spv::OpLine:
+            case spv::OpNoLine:
+            case spv::OpModuleProcessed:
+                strip = true;
+                break;
+            default:
+                break;
+            }
+        }
+        if ((passes & SPIRV_PASS_STRIP_NOP) && opcode == spv::OpNop) {
+            strip = true;
+        }
+
+        if (!strip) {
+            memmove(&words[write], &words[read], length * sizeof(uint32_t));
+            write += length;
+        }
+        read += length;
+    }
+
+    code.resize(write * sizeof(uint32_t));
+}
+
+/*
+ * Optimize a shader and print its instruction count before and after
+ * @param name : Used for the report
+ */
+inline void OptimizeSpirv(const std::string& name, std::vector<char>& code,
+                          uint32_t passes) {
+    SpirvStats before = CountInstructions(code);
+    OptimizeSpirv(code, passes);
+    SpirvStats after = CountInstructions(code);
+
+    std::cout << "SPIR-V " << name << ": " << before.Instructions << " -> "
+              << after.Instructions << " instructions, " << before.Bytes << " -> "
+              << after.Bytes << " bytes" << std::endl;
+}
+
+} // namespace Backend
@@ -0,0 +1,347 @@
+#pragma once
+#include "CpuProfiler.h"
+#include "HostAllocator.h"
+
+#include <vulkan/vulkan.h>
+
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+/*
+ * VK_KHR_timeline_semaphore is newer than the headers shipped in Lib/vulkan (1.1.97).
+ * Declare the parts we use when the headers don't.
+ */
+#ifndef VK_KHR_timeline_semaphore
+#define VK_KHR_timeline_semaphore 1
+#define VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME "VK_KHR_timeline_semaphore"
+
+#define VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR                \
+    ((VkStructureType)1000207000)
+#define VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR ((VkStructureType)1000207002)
+#define VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR ((VkStructureType)1000207003)
+#define VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR ((VkStructureType)1000207004)
+
+typedef enum VkSemaphoreTypeKHR {
+    VK_SEMAPHORE_TYPE_BINARY_KHR   = 0,
+    VK_SEMAPHORE_TYPE_TIMELINE_KHR = 1,
+} VkSemaphoreTypeKHR;
+typedef VkFlags VkSemaphoreWaitFlagsKHR;
+
+typedef struct VkPhysicalDeviceTimelineSemaphoreFeaturesKHR {
+    VkStructureType sType;
+    void*           pNext;
+    VkBool32        timelineSemaphore;
+} VkPhysicalDeviceTimelineSemaphoreFeaturesKHR;
+
+typedef struct VkSemaphoreTypeCreateInfoKHR {
+    VkStructureType    sType;
+    const void*        pNext;
+    VkSemaphoreTypeKHR semaphoreType;
+    uint64_t           initialValue;
+} VkSemaphoreTypeCreateInfoKHR;
+
+typedef struct VkTimelineSemaphoreSubmitInfoKHR {
+    VkStructureType sType;
+    const void*     pNext;
+    uint32_t        waitSemaphoreValueCount;
+    const uint64_t* pWaitSemaphoreValues;
+    uint32_t        signalSemaphoreValueCount;
+    const uint64_t* pSignalSemaphoreValues;
+} VkTimelineSemaphoreSubmitInfoKHR;
+
+typedef struct VkSemaphoreWaitInfoKHR {
+    VkStructureType         sType;
+    const void*             pNext;
+    VkSemaphoreWaitFlagsKHR flags;
+    uint32_t                semaphoreCount;
+    const VkSemaphore*      pSemaphores;
+    const uint64_t*         pValues;
+} VkSemaphoreWaitInfoKHR;
+
+typedef VkResult(VKAPI_PTR* PFN_vkGetSemaphoreCounterValueKHR)(VkDevice    device,
+                                                                VkSemaphore semaphore,
+                                                                uint64_t*   pValue);
+typedef VkResult(VKAPI_PTR* PFN_vkWaitSemaphoresKHR)(VkDevice                      device,
+                                                      const VkSemaphoreWaitInfoKHR* pWaitInfo,
+                                                      uint64_t                      timeout);
+#endif
+
+namespace Backend {
+
+/*
+ * Checks that the device can do timeline semaphores
+ * @param dev : The physical device (Vulkan 1.1 for vkGetPhysicalDeviceFeatures2)
+ * @param features : Filled with the feature struct to chain in VkDeviceCreateInfo::pNext
+ */
+inline bool QueryTimelineSupport(VkPhysicalDevice                              dev,
+                                 VkPhysicalDeviceTimelineSemaphoreFeaturesKHR& features) {
+    VkPhysicalDeviceProperties dev_properties;
+    vkGetPhysicalDeviceProperties(dev, &dev_properties);
+    if (dev_properties.apiVersion < VK_API_VERSION_1_1) {
+        return false;
+    }
+
+    uint32_t ext_count;
+    vkEnumerateDeviceExtensionProperties(dev, nullptr, &ext_count, nullptr);
+    std::vector<VkExtensionProperties> dev_available_ext(ext_count);
+    vkEnumerateDeviceExtensionProperties(dev, nullptr, &ext_count,
+                                         dev_available_ext.data());
+
+    bool ext_found = std::any_of(
+        dev_available_ext.begin(), dev_available_ext.end(),
+        [](const VkExtensionProperties& ext) {
+            return strcmp(ext.extensionName, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME) == 0;
+        });
+    if (!ext_found) {
+        return false;
+    }
+
+    features       = {};
+    features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+
+    VkPhysicalDeviceFeatures2 dev_features = {};
+    dev_features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    dev_features.pNext = &features;
+    vkGetPhysicalDeviceFeatures2(dev, &dev_features);
+
+    return features.timelineSemaphore == VK_TRUE;
+}
+
+/*
+ * Submissions to a queue numbered by a monotonically increasing counter.
+ * Every Submit() signals the next value; "is the GPU done with what was submitted
+ * with value N" is then a compare against the completed value.
+ * On a device without VK_KHR_timeline_semaphore every submit gets a fence instead,
+ * the completed value advances as the fences are signaled (in submission order).
+ */
+class QueueTimeline {
+  public:
+    /*
+     * @param device : Device that owns the queue
+     * @param queue : Every submission to this queue must go through Submit()
+     * @param use_timeline : Device created with VK_KHR_timeline_semaphore enabled
+     */
+    void Init(VkDevice device, VkQueue queue, bool use_timeline) {
+        _device       = device;
+        _queue        = queue;
+        _use_timeline = use_timeline;
+
+        if (!_use_timeline) {
+            return;
+        }
+
+        _get_counter_value = reinterpret_cast<PFN_vkGetSemaphoreCounterValueKHR>(
+            vkGetDeviceProcAddr(_device, "vkGetSemaphoreCounterValueKHR"));
+        _wait_semaphores = reinterpret_cast<PFN_vkWaitSemaphoresKHR>(
+            vkGetDeviceProcAddr(_device, "vkWaitSemaphoresKHR"));
+        if (_get_counter_value == nullptr || _wait_semaphores == nullptr) {
+            throw std::runtime_error("Failed to load VK_KHR_timeline_semaphore functions");
+        }
+
+        VkSemaphoreTypeCreateInfoKHR type_info = {};
+        type_info.sType         = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+        type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+        type_info.initialValue  = 0;
+
+        VkSemaphoreCreateInfo semaphore_info = {};
+        semaphore_info.sType                 = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+        semaphore_info.pNext                 = &type_info;
+
+        if (vkCreateSemaphore(_device, &semaphore_info, HostCallbacks(), &_timeline) !=
+            VK_SUCCESS) {
+            throw std::runtime_error("Failed to create timeline Semaphore");
+        }
+    }
+
+    /*
+     * Submit command buffers, with optional binary semaphores (swapchain)
+     * @param wait_semaphore (Optional) : Binary semaphore to wait on
+     * @param wait_stage (Optional) : Stage waiting on it
+     * @param signal_semaphore (Optional) : Binary semaphore to signal
+     * @return : Counter value of the submission
+     */
+    uint64_t Submit(uint32_t command_buffer_count, const VkCommandBuffer* command_buffers,
+                    VkSemaphore wait_semaphore = VK_NULL_HANDLE,
+                    VkPipelineStageFlags wait_stage = 0,
+                    VkSemaphore signal_semaphore    = VK_NULL_HANDLE) {
+        uint64_t value = _last_submitted + 1;
+
+        VkSubmitInfo submit_info       = {};
+        submit_info.sType              = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submit_info.commandBufferCount = command_buffer_count;
+        submit_info.pCommandBuffers    = command_buffers;
+        if (wait_semaphore != VK_NULL_HANDLE) {
+            submit_info.waitSemaphoreCount = 1;
+            submit_info.pWaitSemaphores    = &wait_semaphore;
+            submit_info.pWaitDstStageMask  = &wait_stage;
+        }
+
+        VkSemaphore signal_semaphores[2];
+        uint64_t    signal_values[2] = {0, 0}; /* Ignored for the binary semaphore */
+        uint32_t    signal_count     = 0;
+        if (signal_semaphore != VK_NULL_HANDLE) {
+            signal_semaphores[signal_count++] = signal_semaphore;
+        }
+
+        VkTimelineSemaphoreSubmitInfoKHR timeline_info = {};
+        VkFence                          fence         = VK_NULL_HANDLE;
+        if (_use_timeline) {
+            signal_values[signal_count]       = value;
+            signal_semaphores[signal_count++] = _timeline;
+
+            timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+            timeline_info.signalSemaphoreValueCount = signal_count;
+            timeline_info.pSignalSemaphoreValues    = signal_values;
+            submit_info.pNext                       = &timeline_info;
+        } else {
+            fence = _GrabFence();
+        }
+        submit_info.signalSemaphoreCount = signal_count;
+        submit_info.pSignalSemaphores    = signal_semaphores;
+
+        if (vkQueueSubmit(_queue, 1, &submit_info, fence) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to submit CommandBuffer");
+        }
+        if (!_use_timeline) {
+            _pending_fences.push_back({value, fence});
+        }
+        _last_submitted = value;
+        return value;
+    }
+
+    /*
+     * Counter compare, the GPU is only queried when the cached value is behind
+     */
+    bool IsComplete(uint64_t value) {
+        if (value <= _completed) {
+            return true;
+        }
+        return CompletedValue() >= value;
+    }
+
+    /*
+     * Throws when the device is lost (or the query fails), the cached value is kept
+     */
+    uint64_t CompletedValue() {
+        if (_use_timeline) {
+            uint64_t counter = 0;
+            if (_get_counter_value(_device, _timeline, &counter) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to read the timeline semaphore counter");
+            }
+            _completed = std::max(_completed, counter);
+        } else {
+            while (!_pending_fences.empty()) {
+                VkFence  fence  = _pending_fences.front().Fence;
+                VkResult status = vkGetFenceStatus(_device, fence);
+                if (status == VK_NOT_READY) {
+                    break;
+                }
+                if (status != VK_SUCCESS) {
+                    throw std::runtime_error("Failed to get the submission fence status");
+                }
+                _RetireFront();
+            }
+        }
+        return _completed;
+    }
+
+    /*
+     * Block until the submission with this value (and every one before it) is done.
+     * Throws on VK_ERROR_DEVICE_LOST, nothing is marked complete in that case.
+     */
+    void Wait(uint64_t value) {
+        if (value <= _completed) {
+            return;
+        }
+        CPU_SCOPE("QueueTimeline::Wait");
+        if (_use_timeline) {
+            VkSemaphoreWaitInfoKHR wait_info = {};
+            wait_info.sType                  = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+            wait_info.semaphoreCount         = 1;
+            wait_info.pSemaphores            = &_timeline;
+            wait_info.pValues                = &value;
+            uint64_t timeout = std::numeric_limits<uint64_t>::max();
+            if (_wait_semaphores(_device, &wait_info, timeout) != VK_SUCCESS) {
+                throw std::runtime_error("Failed to wait for the timeline semaphore");
+            }
+            _completed = std::max(_completed, value);
+        } else {
+            while (!_pending_fences.empty() && _pending_fences.front().Value <= value) {
+                if (vkWaitForFences(_device, 1, &_pending_fences.front().Fence, VK_TRUE,
+                                    std::numeric_limits<uint64_t>::max()) != VK_SUCCESS) {
+                    throw std::runtime_error("Failed to wait for the submission fence");
+                }
+                _RetireFront();
+            }
+        }
+    }
+
+    void WaitIdle() { Wait(_last_submitted); }
+
+    uint64_t LastSubmitted() const { return _last_submitted; }
+    bool     UsesTimeline() const { return _use_timeline; }
+
+    /*
+     * The queue must be idle
+     */
+    void Destroy() {
+        if (_timeline != VK_NULL_HANDLE) {
+            vkDestroySemaphore(_device, _timeline, HostCallbacks());
+            _timeline = VK_NULL_HANDLE;
+        }
+        for (const PendingFence& pending : _pending_fences) {
+            vkDestroyFence(_device, pending.Fence, HostCallbacks());
+        }
+        for (VkFence fence : _free_fences) {
+            vkDestroyFence(_device, fence, HostCallbacks());
+        }
+        _pending_fences.clear();
+        _free_fences.clear();
+    }
+
+  private:
+    struct PendingFence {
+        uint64_t Value;
+        VkFence  Fence;
+    };
+
+    VkFence _GrabFence() {
+        VkFence fence;
+        if (!_free_fences.empty()) {
+            fence = _free_fences.back();
+            _free_fences.pop_back();
+            vkResetFences(_device, 1, &fence);
+            return fence;
+        }
+
+        VkFenceCreateInfo fence_info = {};
+        fence_info.sType             = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+        if (vkCreateFence(_device, &fence_info, HostCallbacks(), &fence) != VK_SUCCESS) {
+            throw std::runtime_error("Failed to create Fences");
+        }
+        return fence;
+    }
+
+    void _RetireFront() {
+        _completed = _pending_fences.front().Value;
+        _free_fences.push_back(_pending_fences.front().Fence);
+        _pending_fences.pop_front();
+    }
+
+    VkDevice                          _device;
+    VkQueue                           _queue;
+    bool                              _use_timeline = false;
+    VkSemaphore                       _timeline     = VK_NULL_HANDLE;
+    PFN_vkGetSemaphoreCounterValueKHR _get_counter_value = nullptr;
+    PFN_vkWaitSemaphoresKHR           _wait_semaphores   = nullptr;
+    uint64_t                          _last_submitted    = 0;
+    uint64_t                          _completed         = 0;
+    std::deque<PendingFence>          _pending_fences; /* Fallback only */
+    std::vector<VkFence>              _free_fences;
+};
+
+} // namespace Backend
@@ -0,0 +1,363 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#include <xmmintrin.h>
+#define TRANSFORM_SYSTEM_SSE 1
+#endif
+
+namespace Backend {
+
+/* Column major, same layout as glm::mat4 and a GLSL mat4 */
+struct alignas(16) Matrix4 {
+    float M[16];
+};
+
+/*
+ * Local translation / rotation / scale of many objects, turned into world matrices.
+ * -Storage is SoA : one array per component, so 4 objects are converted per SSE op
+ * -Parents always come before their children (Add() only takes existing parents), one
+ *  forward pass resolves the hierarchy
+ * -Only the objects whose local TRS changed, and their descendants, are recomputed :
+ *  a static object costs a flag test per update
+ * Set*() -> Update() -> WriteChanged() into the per object buffer (mapped memory)
+ */
+class TransformSystem {
+  public:
+    static constexpr uint32_t NO_PARENT = UINT32_MAX;
+
+    void Reserve(size_t count) {
+        count = _Padded(count);
+        for (std::vector<float>* component : _Components()) {
+            component->reserve(count);
+        }
+        _parents.reserve(count);
+        _local_dirty.reserve(count);
+        _world_dirty.reserve(count);
+        _changed_at.reserve(count);
+        _local.reserve(count);
+        _world.reserve(count);
+    }
+
+    /*
+     * Object at the origin, identity rotation and scale
+     * @param parent : Index of an existing object, or NO_PARENT
+     * @return : Index of the object, stable
+     */
+    uint32_t Add(uint32_t parent = NO_PARENT) {
+        if (parent != NO_PARENT && parent >= _count) {
+            throw std::runtime_error("TransformSystem: the parent must be added first");
+        }
+        uint32_t index = _count++;
+        if (_count > _parents.size()) {
+            /* Grow by a SIMD batch, the padding objects are identities without parent */
+            size_t padded = _Padded(_count);
+            for (std::vector<float>* component : _Components()) {
+                component->resize(padded, 0.0f);
+            }
+            for (size_t i = index; i < padded; i++) {
+                _rotation_w[i] = 1.0f;
+                _scale_x[i] = _scale_y[i] = _scale_z[i] = 1.0f;
+            }
+            _parents.resize(padded, NO_PARENT);
+            _local_dirty.resize(padded, 0);
+            _world_dirty.resize(padded, 0);
+            _changed_at.resize(padded, 0);
+            _local.resize(padded);
+            _world.resize(padded);
+        }
+        _parents[index]     = parent;
+        _local_dirty[index] = 1;
+        return index;
+    }
+
+    void SetTranslation(uint32_t index, float x, float y, float z) {
+        _translation_x[index] = x;
+        _translation_y[index] = y;
+        _translation_z[index] = z;
+        _local_dirty[index]   = 1;
+    }
+
+    /* Unit quaternion */
+    void SetRotation(uint32_t index, float x, float y, float z, float w) {
+        _rotation_x[index]  = x;
+        _rotation_y[index]  = y;
+        _rotation_z[index]  = z;
+        _rotation_w[index]  = w;
+        _local_dirty[index] = 1;
+    }
+
+    void SetScale(uint32_t index, float x, float y, float z) {
+        _scale_x[index]     = x;
+        _scale_y[index]     = y;
+        _scale_z[index]     = z;
+        _local_dirty[index] = 1;
+    }
+
+    /*
+     * Recompute the matrices of the dirty objects and their descendants
+     * @param simd (Optional) : False forces the scalar path (comparisons)
+     * @return : Number of world matrices that changed
+     */
+    uint32_t Update(bool simd = true) {
+        _update++;
+
+        /* === LOCAL : batches of 4, skipped when none of them is dirty === */
+        for (uint32_t first = 0; first < _count; first += 4) {
+            uint32_t batch_dirty;
+            std::memcpy(&batch_dirty, &_local_dirty[first], sizeof(batch_dirty));
+            if (batch_dirty == 0) {
+                continue;
+            }
+#ifdef TRANSFORM_SYSTEM_SSE
+            if (simd) {
+                _ComposeBatchSse(first);
+                continue;
+            }
+#endif
+            for (uint32_t i = first; i < first + 4; i++) {
+                _ComposeScalar(i);
+            }
+        }
+
+        /* === WORLD : parents first, a dirty parent dirties its children === */
+        uint32_t changed = 0;
+        for (uint32_t i = 0; i < _count; i++) {
+            uint32_t parent = _parents[i];
+            bool     dirty  = _local_dirty[i] ||
+                         (parent != NO_PARENT && _world_dirty[parent]);
+            _world_dirty[i] = dirty;
+            _local_dirty[i] = 0;
+            if (!dirty) {
+                continue;
+            }
+            if (parent == NO_PARENT) {
+                _world[i] = _local[i];
+            } else if (simd) {
+                _Multiply(_world[parent], _local[i], _world[i]);
+            } else {
+                _MultiplyScalar(_world[parent], _local[i], _world[i]);
+            }
+            _changed_at[i] = _update;
+            changed++;
+        }
+        return changed;
+    }
+
+    /*
+     * Copy the world matrices that changed after an update to a per object array
+     * (mapped uniform / storage buffer). Each buffer of a ring keeps its own
+     * last_update : static objects are only written until every buffer has them.
+     * @param destination : Object i's matrix goes to destination + i * stride
+     * @param stride : Bytes between two objects, at least sizeof(Matrix4)
+     * @param last_update : Update number the buffer was last written at (0 : never),
+     *                      set to the current one
+     * @return : Matrices written
+     */
+    uint32_t WriteChanged(void* destination, size_t stride, uint64_t& last_update) const {
+        uint8_t* bytes   = static_cast<uint8_t*>(destination);
+        uint32_t written = 0;
+        for (uint32_t i = 0; i < _count; i++) {
+            if (_changed_at[i] > last_update) {
+                std::memcpy(bytes + i * stride, &_world[i], sizeof(Matrix4));
+                written++;
+            }
+        }
+        last_update = _update;
+        return written;
+    }
+
+    const Matrix4& World(uint32_t index) const { return _world[index]; }
+    uint32_t       Count() const { return _count; }
+
+  private:
+    static size_t _Padded(size_t count) { return (count + 3) & ~size_t(3); }
+
+    std::vector<std::vector<float>*> _Components() {
+        return {&_translation_x, &_translation_y, &_translation_z, &_rotation_x,
+                &_rotation_y,    &_rotation_z,    &_rotation_w,    &_scale_x,
+                &_scale_y,       &_scale_z};
+    }
+
+    void _ComposeScalar(uint32_t i) {
+        float x = _rotation_x[i], y = _rotation_y[i], z = _rotation_z[i];
+        float w = _rotation_w[i];
+        float sx = _scale_x[i], sy = _scale_y[i], sz = _scale_z[i];
+
+        float* m = _local[i].M;
+        m[0]     = (1.0f - 2.0f * (y * y + z * z)) * sx;
+        m[1]     = 2.0f * (x * y + w * z) * sx;
+        m[2]     = 2.0f * (x * z - w * y) * sx;
+        m[3]     = 0.0f;
+        m[4]     = 2.0f * (x * y - w * z) * sy;
+        m[5]     = (1.0f - 2.0f * (x * x + z * z)) * sy;
+        m[6]     = 2.0f * (y * z + w * x) * sy;
+        m[7]     = 0.0f;
+        m[8]     = 2.0f * (x * z + w * y) * sz;
+        m[9]     = 2.0f * (y * z - w * x) * sz;
+        m[10]    = (1.0f - 2.0f * (x * x + y * y)) * sz;
+        m[11]    = 0.0f;
+        m[12]    = _translation_x[i];
+        m[13]    = _translation_y[i];
+        m[14]    = _translation_z[i];
+        m[15]    = 1.0f;
+    }
+
+    static void _MultiplyScalar(const Matrix4& a, const Matrix4& b, Matrix4& out) {
+        for (int column = 0; column < 4; column++) {
+            for (int row = 0; row < 4; row++) {
+                out.M[column * 4 + row] = a.M[row] * b.M[column * 4] +
+                                          a.M[4 + row] * b.M[column * 4 + 1] +
+                                          a.M[8 + row] * b.M[column * 4 + 2] +
+                                          a.M[12 + row] * b.M[column * 4 + 3];
+            }
+        }
+    }
+
+#ifdef TRANSFORM_SYSTEM_SSE
+    /* Local matrices of objects [first, first + 4), one object per lane */
+    void _ComposeBatchSse(uint32_t first) {
+        __m128 x  = _mm_loadu_ps(&_rotation_x[first]);
+        __m128 y  = _mm_loadu_ps(&_rotation_y[first]);
+        __m128 z  = _mm_loadu_ps(&_rotation_z[first]);
+        __m128 w  = _mm_loadu_ps(&_rotation_w[first]);
+        __m128 sx = _mm_loadu_ps(&_scale_x[first]);
+        __m128 sy = _mm_loadu_ps(&_scale_y[first]);
+        __m128 sz = _mm_loadu_ps(&_scale_z[first]);
+
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 two = _mm_set1_ps(2.0f);
+        __m128       xx  = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+        __m128       xy  = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+        __m128       wx  = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+        auto diagonal = [&](__m128 a, __m128 b, __m128 scale) {
+            return _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(a, b))), scale);
+        };
+        auto sum = [&](__m128 a, __m128 b, __m128 scale) {
+            return _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(a, b)), scale);
+        };
+        auto difference = [&](__m128 a, __m128 b, __m128 scale) {
+            return _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(a, b)), scale);
+        };
+
+        /* Rows are objects once transposed : column c of the 4 matrices */
+        const __m128 zero          = _mm_setzero_ps();
+        __m128       columns[4][4] = {
+            {diagonal(yy, zz, sx), sum(xy, wz, sx), difference(xz, wy, sx), zero},
+            {difference(xy, wz, sy), diagonal(xx, zz, sy), sum(yz, wx, sy), zero},
+            {sum(xz, wy, sz), difference(yz, wx, sz), diagonal(xx, yy, sz), zero},
+            {_mm_loadu_ps(&_translation_x[first]), _mm_loadu_ps(&_translation_y[first]),
+             _mm_loadu_ps(&_translation_z[first]), one}};
+
+        for (int column = 0; column < 4; column++) {
+            __m128* c = columns[column];
+            _MM_TRANSPOSE4_PS(c[0], c[1], c[2], c[3]);
+            for (int lane = 0; lane < 4; lane++) {
+                _mm_store_ps(&_local[first + lane].M[column * 4], c[lane]);
+            }
+        }
+    }
+
+    static void _Multiply(const Matrix4& a, const Matrix4& b, Matrix4& out) {
+        __m128 a0 = _mm_load_ps(&a.M[0]);
+        __m128 a1 = _mm_load_ps(&a.M[4]);
+        __m128 a2 = _mm_load_ps(&a.M[8]);
+        __m128 a3 = _mm_load_ps(&a.M[12]);
+        for (int column = 0; column < 4; column++) {
+            const float* b_column = &b.M[column * 4];
+            __m128 result = _mm_mul_ps(a0, _mm_set1_ps(b_column[0]));
+            result = _mm_add_ps(result, _mm_mul_ps(a1, _mm_set1_ps(b_column[1])));
+            result = _mm_add_ps(result, _mm_mul_ps(a2, _mm_set1_ps(b_column[2])));
+            result = _mm_add_ps(result, _mm_mul_ps(a3, _mm_set1_ps(b_column[3])));
+            _mm_store_ps(&out.M[column * 4], result);
+        }
+    }
+#else
+    void _ComposeBatchSse(uint32_t first) {
+        for (uint32_t i = first; i < first + 4; i++) {
+            _ComposeScalar(i);
+        }
+    }
+
+    static void _Multiply(const Matrix4& a, const Matrix4& b, Matrix4& out) {
+        _MultiplyScalar(a, b, out);
+    }
+#endif
+
+    uint32_t _count  = 0;
+    uint64_t _update = 0;
+
+    /* SoA local TRS, padded to a multiple of 4 objects */
+    std::vector<float> _translation_x, _translation_y, _translation_z;
+    std::vector<float> _rotation_x, _rotation_y, _rotation_z, _rotation_w;
+    std::vector<float> _scale_x, _scale_y, _scale_z;
+
+    std::vector<uint32_t> _parents;
+    std::vector<uint8_t>  _local_dirty; /* Set by Set*(), cleared by Update() */
+    std::vector<uint8_t>  _world_dirty; /* Recomputed by the last Update() */
+    std::vector<uint64_t> _changed_at;  /* Update number of the last world change */
+    std::vector<Matrix4>  _local;
+    std::vector<Matrix4>  _world;
+};
+
+/*
+ * Update timings of a generated hierarchy : roots with 63 children each, a fraction of
+ * the roots animated, the world matrices written to a per object array
+ * @param object_count : Objects in the hierarchy
+ * @param dynamic_fraction : Roots whose rotation changes every update
+ * @param iterations : Number of updates ("frames")
+ */
+inline void BenchmarkTransforms(uint32_t object_count = 100000, float dynamic_fraction = 0.1f,
+                                uint32_t iterations = 100) {
+    TransformSystem transforms;
+    transforms.Reserve(object_count);
+    std::vector<uint32_t> roots;
+    for (uint32_t i = 0; i < object_count; i++) {
+        if (i % 64 == 0) {
+            roots.push_back(transforms.Add());
+        } else {
+            uint32_t child = transforms.Add(roots.back());
+            transforms.SetTranslation(child, float(i % 8), float(i % 7), 0.0f);
+        }
+    }
+    std::vector<Matrix4> output(object_count);
+    uint32_t dynamic_roots = static_cast<uint32_t>(roots.size() * dynamic_fraction);
+
+    using Clock = std::chrono::high_resolution_clock;
+    auto run = [&](bool simd, bool all) {
+        uint64_t last_update = 0;
+        auto     start       = Clock::now();
+        for (uint32_t it = 0; it < iterations; it++) {
+            uint32_t animated = all ? static_cast<uint32_t>(roots.size()) : dynamic_roots;
+            for (uint32_t r = 0; r < animated; r++) {
+                float angle = 0.01f * it + r;
+                transforms.SetRotation(roots[r], 0.0f, 0.0f, std::sin(angle * 0.5f),
+                                       std::cos(angle * 0.5f));
+            }
+            transforms.Update(simd);
+            transforms.WriteChanged(output.data(), sizeof(Matrix4), last_update);
+        }
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count() /
+               iterations;
+    };
+
+    double simd_all    = run(true, true);
+    double scalar_all  = run(false, true);
+    double simd_some   = run(true, false);
+    double scalar_some = run(false, false);
+    std::cout << "Transforms(" << object_count << " objects): all dirty " << simd_all
+              << "ms SIMD / " << scalar_all << "ms scalar, " << dynamic_fraction * 100
+              << "% dynamic " << simd_some << "ms SIMD / " << scalar_some << "ms scalar"
+              << std::endl;
+}
+
+} // namespace Backend
@@ -1,5 +1,7 @@
 #pragma once
 #include "Buffer.h"
+#include "DescriptorAllocator.h"
+#include "DescriptorWriter.h"
 #include "HelperFunctions.h"
 #include "RenderAllocator.h"
 
@@ -15,6 +17,7 @@ struct UniformBufferObject {
 
 /*
  * Descriptor pool : Descriptor set are allocated from the pool.
+ * (Backend::DescriptorAllocator chains new pools when one is full)
  */
 
 /*
@@ -58,45 +61,36 @@ void CreateDescriptorLayout(const VkDevice& device, VkDescriptorSetLayout& targe
  * (List size = N Images)
  * (The sets are bounds for the drawing command)
  */
-void AllocateDescriptorSets(const VkDevice& device, size_t img_count,
+void AllocateDescriptorSets(Backend::DescriptorAllocator& allocator, size_t img_count,
                             VkDescriptorSetLayout         layout,
                             std::vector<VkDescriptorSet>& target) {
-    /* Because pSetLayouts has to be the same size of the descriptorSetCount */
-    std::vector<VkDescriptorSetLayout> layouts(img_count, layout);
-
-    VkDescriptorSetAllocateInfo alloc_info = {};
-    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-    // alloc_info.descriptorPool     = descriptor_pool;
-    alloc_info.descriptorSetCount = static_cast<uint32>(layouts.size);
-    alloc_info.pSetLayouts        = layouts.data();
-
-    target.resize(img_count);
-    VK_ASSERT(vkAllocateDescriptorSets(device, &alloc_info, target.data()),
-              "Failed to allocate Descriptor Sets");
+    allocator.Allocate(layout, img_count, target);
 }
 
-void ConfigureDescriptorSets(const VkDevice& device, size_t img_count,
+/* Only the uniform buffer binding is written, the template covers nothing else */
+void ConfigureDescriptorSets(const VkDevice& device, const VkPhysicalDevice& physical_dev,
+                             size_t img_count,
                              std::vector<Backend::Buffer> buffers, uint32 binding,
-                             std::vector<VkDescriptorSet>& target) {
+                             VkDescriptorSetLayout layout, std::vector<VkDescriptorSet>& target) {
+    VkDescriptorSetLayoutBinding ubo_binding = {};
+    ubo_binding.binding                      = binding;
+    ubo_binding.descriptorType               = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    ubo_binding.descriptorCount              = 1;
+
+    Backend::DescriptorUpdateTemplate update_template;
+    update_template.Init(device, physical_dev, layout, {ubo_binding});
+    Backend::DescriptorWriter writer;
+    writer.Init(device);
     for (size_t i = 0; i < img_count; i++) {
         VkDescriptorBufferInfo buffer_info = {};
         buffer_info.buffer                 = buffers[i].Buffer;
         buffer_info.offset                 = 0;
         buffer_info.range                  = buffers[i].Size;
 
-        VkWriteDescriptorSet descriptor_write = {};
-        descriptor_write.sType                = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-        descriptor_write.dstSet               = target[i];
-        descriptor_write.dstBinding           = binding;
-        descriptor_write.dstArrayElement      = 0;
-        descriptor_write.descriptorType       = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptor_write.descriptorCount      = 1;
-        descriptor_write.pBufferInfo          = &buffer_info;
-        descriptor_write.pImageInfo           = nullptr; /* For img data */
-        descriptor_write.pTexelBufferView     = nullptr; /* For buffer views */
-
-        vkUpdateDescriptorSets(device, 1, &descriptor_write, 0, nullptr);
+        writer.Begin(target[i], update_template).WriteBuffer(binding, buffer_info);
     }
+    writer.Flush(); /* Every image at once */
+    update_template.Destroy();
 }
 
 /* Create the Uniform Buffer
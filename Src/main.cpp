@@ -1,5 +1,88 @@
 #include "Application.h"
 
+#ifdef ENABLE_HEAP_COUNTER
+/* Counts every heap allocation for Backend::HeapCounter. The whole set is replaced, so
+ * every delete frees what the matching new allocated with malloc/aligned_alloc.
+ * The ones calling malloc/free aren't inlined : GCC would pair a malloc inlined in the
+ * caller with an operator delete and report a mismatch (-Wmismatched-new-delete). */
+__attribute__((noinline)) void* operator new(size_t size) {
+    Backend::HeapCounter::OnAllocation();
+    if (void* memory = std::malloc(size ? size : 1)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void* operator new(size_t size, std::align_val_t alignment) {
+    Backend::HeapCounter::OnAllocation();
+    size_t align = std::max(static_cast<size_t>(alignment), sizeof(void*));
+    /* aligned_alloc needs a multiple of the alignment */
+    size = (std::max<size_t>(size, 1) + align - 1) & ~(align - 1);
+    if (void* memory = std::aligned_alloc(align, size)) {
+        return memory;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return operator new(size);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void* operator new(size_t size, std::align_val_t alignment,
+                   const std::nothrow_t&) noexcept {
+    try {
+        return operator new(size, alignment);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void* operator new[](size_t size) { return operator new(size); }
+void* operator new[](size_t size, std::align_val_t alignment) {
+    return operator new(size, alignment);
+}
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept {
+    return operator new(size, tag);
+}
+void* operator new[](size_t size, std::align_val_t alignment,
+                     const std::nothrow_t& tag) noexcept {
+    return operator new(size, alignment, tag);
+}
+
+__attribute__((noinline)) void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+void operator delete(void* memory, std::align_val_t) noexcept { operator delete(memory); }
+void operator delete(void* memory, size_t) noexcept { operator delete(memory); }
+void operator delete(void* memory, size_t, std::align_val_t) noexcept {
+    operator delete(memory);
+}
+void operator delete(void* memory, const std::nothrow_t&) noexcept {
+    operator delete(memory);
+}
+void operator delete(void* memory, std::align_val_t, const std::nothrow_t&) noexcept {
+    operator delete(memory);
+}
+void operator delete[](void* memory) noexcept { operator delete(memory); }
+void operator delete[](void* memory, std::align_val_t) noexcept {
+    operator delete(memory);
+}
+void operator delete[](void* memory, size_t) noexcept { operator delete(memory); }
+void operator delete[](void* memory, size_t, std::align_val_t) noexcept {
+    operator delete(memory);
+}
+void operator delete[](void* memory, const std::nothrow_t&) noexcept {
+    operator delete(memory);
+}
+void operator delete[](void* memory, std::align_val_t, const std::nothrow_t&) noexcept {
+    operator delete(memory);
+}
+#endif
+
 int main() {
     Application app;
 
@@ -1,3 +1,57 @@
-rm ./Shaders/*.spv
-./Lib/vulkan/x86_64/bin/glslangValidator -V ./Shaders/shader.vert -o ./Shaders/vert.spv
-./Lib/vulkan/x86_64/bin/glslangValidator -V ./Shaders/shader.frag -o ./Shaders/frag.spv
\ No newline at end of file
+#!/bin/sh
+# Usage: ./compile_shaders.sh [performance|size|none] [debug|release]
+#   performance : spirv-opt -O,  size : spirv-opt -Os,  none : glslangValidator output
+#   release     : strips the debug info and remaps the ids with spirv-remap
+OPT_LEVEL=${1:-performance}
+CONFIG=${2:-debug}
+
+SDK_BIN=./Lib/vulkan/x86_64/bin
+GLSLANG=$SDK_BIN/glslangValidator
+SPIRV_OPT=$SDK_BIN/spirv-opt
+SPIRV_REMAP=$SDK_BIN/spirv-remap
+[ -x "$GLSLANG" ] || GLSLANG=glslangValidator
+[ -x "$SPIRV_OPT" ] || SPIRV_OPT=$(command -v spirv-opt)
+[ -x "$SPIRV_REMAP" ] || SPIRV_REMAP=$(command -v spirv-remap)
+
+case $OPT_LEVEL in
+    performance) OPT_PASSES="-O" ;;
+    size)        OPT_PASSES="-Os" ;;
+    none)        OPT_PASSES="" ;;
+    *)           echo "Unknown optimization level: $OPT_LEVEL"; exit 1 ;;
+esac
+if [ "$CONFIG" = "release" ]; then
+    OPT_PASSES="$OPT_PASSES --strip-debug"
+fi
+
+# Every instruction starts with a word holding its word count in the high 16 bits
+count_instructions() {
+    od -An -v -tu4 -w4 "$1" | awk 'NR > 5 { if (skip > 0) { skip--; next } n++; skip = int($1 / 65536) - 1 } END { print n }'
+}
+
+# compile <source> <output> [glslangValidator options (ex: -DBINDLESS)]
+compile() {
+    SOURCE=$1
+    OUTPUT=$2
+    shift 2
+    "$GLSLANG" -V "$@" "$SOURCE" -o "$OUTPUT" || exit 1
+    BEFORE=$(count_instructions "$OUTPUT")
+
+    if [ -n "$OPT_PASSES" ]; then
+        if [ -n "$SPIRV_OPT" ]; then
+            "$SPIRV_OPT" $OPT_PASSES "$OUTPUT" -o "$OUTPUT" || exit 1
+        else
+            echo "spirv-opt not found, skipping $OPT_PASSES"
+        fi
+    fi
+    if [ "$CONFIG" = "release" ] && [ -n "$SPIRV_REMAP" ]; then
+        # Canonical ids : better pipeline cache hits and compression
+        "$SPIRV_REMAP" --map all --dce all --opt all -i "$OUTPUT" -o "$(dirname "$OUTPUT")" || exit 1
+    fi
+
+    echo "$OUTPUT: $BEFORE -> $(count_instructions "$OUTPUT") instructions"
+}
+
+rm -f ./Shaders/*.spv
+compile ./Shaders/shader.vert ./Shaders/vert.spv
+compile ./Shaders/shader.frag ./Shaders/frag.spv
+compile ./Shaders/shader.frag ./Shaders/frag_bindless.spv -DBINDLESS